@@ -0,0 +1,741 @@
+// Standalone microbenchmarks for the browser data structures.
+// Build: g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark
+#include "historyLog.h"
+#include "fileManager.h"
+#include "bookmarkIndex.h"
+#include "searchIndex.h"
+#include "visitCounter.h"
+#include "frecency.h"
+#include "tabTable.h"
+#include "timeIndex.h"
+#include "browser.h"
+#include "canonicalUrl.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stack>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const string& name, size_t ops, double secs) {
+    printf("%-40s %12zu ops %10.3f s %14.0f ops/s\n", name.c_str(), ops, secs, ops / secs);
+}
+
+// ------------------ History append ------------------
+// The pre-arena history: a singly linked list walked to the tail on every visit.
+struct LegacyHistoryNode {
+    Page page;
+    LegacyHistoryNode* next;
+    LegacyHistoryNode(const Page& p) : page(p), next(nullptr) {}
+};
+
+static void benchLegacyHistory(size_t n) {
+    Page p("example.com", "Example");
+    LegacyHistoryNode* head = nullptr;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        LegacyHistoryNode* node = new LegacyHistoryNode(p);
+        if (!head) head = node;
+        else {
+            LegacyHistoryNode* temp = head;
+            while (temp->next) temp = temp->next;
+            temp->next = node;
+        }
+    }
+    report("legacy linked-list append n=" + to_string(n), n, secondsSince(start));
+    while (head) {
+        LegacyHistoryNode* next = head->next;
+        delete head;
+        head = next;
+    }
+}
+
+static void benchHistoryLog(size_t n) {
+    Page p("example.com", "Example");
+    HistoryLog history;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) history.append(p);
+    report("HistoryLog append n=" + to_string(n), n, secondsSince(start));
+}
+
+// ------------------ Interned pages: resident memory ------------------
+// Synthetic trace: N visits spread over 10 tabs and 250k distinct URLs,
+// bookmarking every 100th visit, mirroring what Browser keeps resident.
+static const size_t TRACE_TABS = 10, TRACE_DISTINCT = 250000;
+
+static string traceUrl(size_t i) { return "https://www.site" + to_string(i % TRACE_DISTINCT) + ".example.com/articles/index.html"; }
+static string traceTitle(size_t i) { return "Example article number " + to_string(i % TRACE_DISTINCT); }
+
+static long residentKb() {
+#ifdef __linux__
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return 0;
+#endif
+}
+
+struct LegacyPage {
+    string url, title;
+    time_t timestamp;
+};
+
+static void traceLegacyPages(size_t n) {
+    long before = residentKb();
+    vector<LegacyPage> history;
+    vector<stack<LegacyPage>> backStacks(TRACE_TABS);
+    unordered_map<string, LegacyPage> bookmarks;
+    unordered_map<string, int> visitCount;
+    for (size_t i = 0; i < n; i++) {
+        LegacyPage p{traceUrl(i), traceTitle(i), time(nullptr)};
+        history.push_back(p);
+        backStacks[i % TRACE_TABS].push(p);
+        visitCount[p.url]++;
+        if (i % 100 == 0) bookmarks[p.url] = p;
+    }
+    printf("%-40s %12zu visits %10ld KB resident\n", "std::string pages", n, residentKb() - before);
+}
+
+static void traceInternedPages(size_t n) {
+    long before = residentKb();
+    HistoryLog history;
+    vector<stack<Page>> backStacks(TRACE_TABS);
+    unordered_map<UrlId, Page> bookmarks;
+    VisitCounter visitCount;
+    for (size_t i = 0; i < n; i++) {
+        Page p(traceUrl(i), traceTitle(i));
+        history.append(p);
+        backStacks[i % TRACE_TABS].push(p);
+        visitCount.add(p.urlId);
+        if (i % 100 == 0) bookmarks[p.urlId] = p;
+    }
+    printf("%-40s %12zu visits %10ld KB resident\n", "interned pages", n, residentKb() - before);
+}
+
+// Runs fn in a child process so each measurement starts from a clean heap.
+static void isolated(void (*fn)(size_t), size_t n) {
+#ifdef __linux__
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn(n);
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+#else
+    fn(n);
+#endif
+}
+
+// ------------------ Bookmark search ------------------
+// The pre-index path: copy every bookmark, merge sort by title, binary search.
+static void legacyMerge(vector<Page>& arr, int left, int mid, int right) {
+    vector<Page> L(arr.begin() + left, arr.begin() + mid + 1);
+    vector<Page> R(arr.begin() + mid + 1, arr.begin() + right + 1);
+    size_t i = 0, j = 0;
+    int k = left;
+    while (i < L.size() && j < R.size()) {
+        if (L[i].title() < R[j].title()) arr[k++] = L[i++];
+        else arr[k++] = R[j++];
+    }
+    while (i < L.size()) arr[k++] = L[i++];
+    while (j < R.size()) arr[k++] = R[j++];
+}
+
+static void legacyMergeSort(vector<Page>& arr, int left, int right) {
+    if (left < right) {
+        int mid = (left + right) / 2;
+        legacyMergeSort(arr, left, mid);
+        legacyMergeSort(arr, mid + 1, right);
+        legacyMerge(arr, left, mid, right);
+    }
+}
+
+static int legacySearch(unordered_map<UrlId, Page>& bookmarks, string_view key) {
+    vector<Page> arr;
+    for (auto& b : bookmarks) arr.push_back(b.second);
+    legacyMergeSort(arr, 0, arr.size() - 1);
+    int left = 0, right = arr.size() - 1;
+    while (left <= right) {
+        int mid = (left + right) / 2;
+        if (arr[mid].title() == key) return mid;
+        if (arr[mid].title() < key) left = mid + 1;
+        else right = mid - 1;
+    }
+    return -1;
+}
+
+static void benchBookmarks(size_t n) {
+    unordered_map<UrlId, Page> bookmarks;
+    BookmarkIndex index;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        Page p("bookmark" + to_string(i) + ".example.com", "Bookmark title " + to_string((i * 7919) % n));
+        bookmarks[p.urlId] = p;
+        index.insert(p);
+    }
+    report("BookmarkIndex insert n=" + to_string(n), n, secondsSince(start));
+
+    size_t legacyQueries = 3, found = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < legacyQueries; q++)
+        found += legacySearch(bookmarks, "Bookmark title " + to_string(q * 31 % n)) >= 0;
+    report("legacy merge sort + search n=" + to_string(n), legacyQueries, secondsSince(start));
+
+    size_t queries = 100000;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries; q++) {
+        BookmarkIndex::Range r = index.find("Bookmark title " + to_string(q * 31 % n));
+        found += r.first != r.second;
+    }
+    report("BookmarkIndex exact lookup n=" + to_string(n), queries, secondsSince(start));
+
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries; q++) {
+        BookmarkIndex::Range r = index.prefix("Bookmark title " + to_string(q % 1000) + "9");
+        for (auto it = r.first; it != r.second; ++it) found++;
+    }
+    report("BookmarkIndex prefix query n=" + to_string(n), queries, secondsSince(start));
+    if (found == 0) cout << "(no matches)\n";
+}
+
+// ------------------ Full-text search ------------------
+// Titles are three words drawn from a 20k-word vocabulary of pronounceable
+// made-up words, so common words match many pages and the ranking has work to do.
+static string searchWord(size_t i) {
+    static const char* syllables[] = {"ka", "lo", "mi", "ne", "su", "tra", "ven", "dor", "pil", "gu", "sha", "rex"};
+    size_t h = (i % 20000) * 2654435761u, length = 2 + h % 3;
+    string w;
+    for (size_t s = 0; s < length; s++, h /= 12) w += syllables[h % 12];
+    return w + to_string(i % 20000 % 97);
+}
+
+static void benchSearch(size_t n) {
+    HistoryLog history;
+    for (size_t i = 0; i < n; i++) {
+        Page p("https://host" + to_string(i % 5000) + ".example.com/page" + to_string(i),
+               searchWord(i * 7) + " " + searchWord(i * 13 + 1) + " " + searchWord(i / 3));
+        p.timestamp -= i % 100000;
+        history.append(p);
+    }
+    SearchIndex index;
+    auto start = chrono::steady_clock::now();
+    index.build(history);
+    report("SearchIndex build n=" + to_string(n), n, secondsSince(start));
+
+    const pair<const char*, function<string(size_t)>> kinds[] = {
+        {"exact", [](size_t q) { return searchWord(q * 37); }},
+        {"prefix", [](size_t q) { return searchWord(q * 37).substr(0, 4); }},
+        {"typo", [](size_t q) { string w = searchWord(q * 37 + 10000); w[1] = 'z'; return w; }},
+        {"two words", [](size_t q) { return searchWord(q * 7) + " " + searchWord(q * 13 + 1); }},
+    };
+    size_t queries = 2000, found = 0;
+    for (auto& kind : kinds) {
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < queries; q++) found += index.search(kind.second(q), 10).size();
+        report(string("SearchIndex ") + kind.first + " query n=" + to_string(n), queries, secondsSince(start));
+    }
+    if (found == 0) cout << "(no matches)\n";
+}
+
+// ------------------ Most visited ------------------
+// Skewed stream: visit i goes to URL floor(d * u^3) for u uniform in [0, 1),
+// so a few URLs collect most visits and a long tail is seen once or twice.
+static vector<UrlId> visitStream(size_t n, size_t distinct) {
+    vector<UrlId> stream(n);
+    uint64_t x = 88172645463325252ULL;
+    for (auto& id : stream) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        double u = (x >> 11) * (1.0 / 9007199254740992.0);
+        id = (UrlId)(distinct * u * u * u);
+    }
+    return stream;
+}
+
+static void benchMostVisited(size_t n, size_t distinct) {
+    vector<UrlId> stream = visitStream(n, distinct);
+    const size_t K = 10, QUERIES = 1000;
+
+    unordered_map<UrlId, int> legacy;
+    auto start = chrono::steady_clock::now();
+    for (UrlId id : stream) legacy[id]++;
+    report("unordered_map increment", n, secondsSince(start));
+    size_t legacyQueries = 5;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < legacyQueries; q++) {
+        vector<pair<UrlId, int>> sorted(legacy.begin(), legacy.end());
+        sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.second > b.second; });
+    }
+    report("legacy copy + full sort, " + to_string(legacy.size()) + " URLs", legacyQueries, secondsSince(start));
+
+    for (size_t capacity : {(size_t)0, (size_t)10000}) {
+        VisitCounter counter(capacity);
+        string mode = capacity ? "bounded " + to_string(capacity) : "exact";
+        start = chrono::steady_clock::now();
+        for (UrlId id : stream) counter.add(id);
+        report("VisitCounter " + mode + " increment", n, secondsSince(start));
+        size_t seen = 0;
+        start = chrono::steady_clock::now();
+        for (size_t q = 0; q < QUERIES; q++) seen += counter.top(K).size();
+        report("VisitCounter " + mode + " top-10", QUERIES, secondsSince(start));
+
+        size_t exactHits = 0;
+        uint32_t worst = 0;
+        for (auto& v : counter.top(K)) {
+            exactHits += legacy[v.urlId] == (int)v.count;
+            worst = max(worst, v.count - legacy[v.urlId]);
+        }
+        printf("%-40s %zu/%zu exact, max overcount %u (bound %u, sketch bound %.0f)\n", "  top-10 accuracy",
+               exactHits, K, worst, counter.errorBound(), counter.sketchErrorBound());
+        if (seen == 0) cout << "(empty)\n";
+    }
+}
+
+// Decayed scores over the same kind of skewed stream, one visit per second.
+static void benchFrecency(size_t n, size_t distinct) {
+    vector<UrlId> stream = visitStream(n, distinct);
+    vector<UrlId> urls(distinct);
+    for (size_t i = 0; i < distinct; i++)
+        urls[i] = urlPool().intern("https://site" + to_string(i % 20000) + ".com/page" + to_string(i));
+    Frecency frecency;
+    time_t t = time(nullptr) - n;
+    auto start = chrono::steady_clock::now();
+    for (UrlId id : stream) frecency.visit(urls[id], t++);
+    report("Frecency visit", n, secondsSince(start));
+
+    const size_t QUERIES = 10000;
+    size_t seen = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < QUERIES; q++) seen += frecency.topDomains(10, t).size();
+    report("Frecency top-10 domains", QUERIES, secondsSince(start));
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < QUERIES; q++)
+        seen += frecency.topPagesIn("site" + to_string(q % 100) + ".com", 10, t).size();
+    report("Frecency top-10 pages in a domain", QUERIES, secondsSince(start));
+    if (seen == 0) cout << "(empty)\n";
+}
+
+// ------------------ State file startup ------------------
+static const char* BENCH_STATE_PATH = "benchmark-state.bin";
+static const char* BENCH_JOURNAL_PATH = "benchmark-journal.log";
+
+static void writeProfile(size_t n) {
+    HistoryLog history;
+    unordered_map<UrlId, Page> bookmarks;
+    BookmarkIndex bookmarkIndex;
+    ShardedVisitCounter visitCount;
+    for (size_t i = 0; i < n; i++) {
+        Page p(traceUrl(i), traceTitle(i));
+        history.append(p);
+        visitCount.add(p.urlId);
+        if (i % 1000 == 0 && !bookmarks.count(p.urlId)) {
+            bookmarks[p.urlId] = p;
+            bookmarkIndex.insert(p);
+        }
+    }
+    TabTable tabs;
+    tabs.open(1, 1);
+    deque<SessionSnapshot> sessions;
+    StateWriter writer;
+    auto start = chrono::steady_clock::now();
+    FileManager::saveHistory(writer, history);
+    FileManager::saveBookmarks(writer, bookmarks, bookmarkIndex);
+    FileManager::saveVisitCount(writer, visitCount);
+    FileManager::saveTabs(writer, tabs, 0, 2);
+    FileManager::saveSessionHistory(writer, sessions);
+    FileManager::commitState(writer);
+    printf("%-40s %12zu visits %10.3f s\n", "save state.bin", n, secondsSince(start));
+}
+
+static void loadProfile(size_t n) {
+    HistoryLog history;
+    unordered_map<UrlId, Page> bookmarks;
+    BookmarkIndex bookmarkIndex;
+    ShardedVisitCounter visitCount;
+    auto start = chrono::steady_clock::now();
+    FileManager::openState();
+    FileManager::loadHistory(history);
+    double historySecs = secondsSince(start);
+    FileManager::loadBookmarks(bookmarks, bookmarkIndex);
+    FileManager::loadVisitCount(visitCount);
+    printf("%-40s %12zu visits %10.3f s\n", "open + map history", history.size(), historySecs);
+    printf("%-40s %12zu visits %10.3f s\n", "full load incl. visit counts", n, secondsSince(start));
+}
+
+// Time to first command on the same file; bookmarks and counts wait for first use.
+static void startBrowser(size_t n) {
+    FileManager::JOURNAL_PATH = BENCH_JOURNAL_PATH;
+    remove(BENCH_JOURNAL_PATH);
+    {
+        Browser browser(true);
+        printf("%-40s %12zu visits %10.3f s\n", "Browser startup", n, browser.startupTime());
+    }
+    remove(BENCH_JOURNAL_PATH);
+}
+
+// ------------------ Session snapshots ------------------
+// One snapshot after every visit, over 16 tabs of up to 100 pages each: the
+// legacy text file, one full record per changed tab, and the delta-encoded
+// records actually written, then restoring the newest snapshot versus
+// decoding every one.
+static void benchSessions(size_t count) {
+    static const size_t TABS = 16;
+    static const char* SESSIONS_PATH = "benchmark-sessions.bin";
+    vector<Tab*> tabs;
+    for (size_t t = 0; t < TABS; t++) tabs.push_back(new Tab(t + 1));
+    deque<SessionSnapshot> sessions;
+    size_t legacyBytes = 0, fullBytes = 0;
+    unordered_map<const TabRecord*, bool> distinct;
+    for (size_t i = 0; i < count; i++) {
+        Tab* tab = tabs[(i * 7) % TABS];
+        if (i % 5 == 4) tab->nav.back();
+        else tab->nav.visit(Page(traceUrl(i), traceTitle(i)));
+        tab->frozen.reset();
+        SessionSnapshot snapshot("Snapshot " + to_string(i));
+        auto list = make_shared<TabList>();
+        legacyBytes += snapshot.description.size() + 32;
+        for (auto t : tabs) {
+            auto record = t->freeze();
+            list->push_back(record);
+            legacyBytes += 16;
+            for (auto& p : record->entries) legacyBytes += p.url().size() + 4;
+            if (!distinct[record.get()]) fullBytes += sizeof(NavRecord) + record->entries.size() * sizeof(Page);
+            distinct[record.get()] = true;
+        }
+        snapshot.tabs = list;
+        sessions.push_back(snapshot);
+    }
+    for (auto t : tabs) delete t;
+
+    StateWriter writer;
+    FileManager::saveSessionHistory(writer, sessions);
+    writer.commit(SESSIONS_PATH);
+    ifstream written(SESSIONS_PATH, ios::binary | ios::ate);
+    size_t deltaBytes = written.tellg();
+    printf("%-40s %12zu snapshots %10.1f MB\n", "legacy sessionHistory.txt", count, legacyBytes / 1e6);
+    printf("%-40s %12zu snapshots %10.1f MB\n", "full record per changed tab", count, fullBytes / 1e6);
+    printf("%-40s %12zu snapshots %10.1f MB\n", "delta-encoded records", count, deltaBytes / 1e6);
+
+    const char* statePath = FileManager::STATE_PATH;
+    FileManager::STATE_PATH = SESSIONS_PATH;
+    FileManager::openState();
+    deque<SessionSnapshot> loaded;
+    auto start = chrono::steady_clock::now();
+    FileManager::loadSessionHistory(loaded);
+    FileManager::loadSnapshotTabs(loaded.back());
+    printf("%-40s %12zu snapshots %10.3f ms\n", "restore newest snapshot", count, secondsSince(start) * 1000);
+    loaded.clear();
+    start = chrono::steady_clock::now();
+    FileManager::loadSessionHistory(loaded);
+    for (auto& snapshot : loaded) FileManager::loadSnapshotTabs(snapshot);
+    printf("%-40s %12zu snapshots %10.3f ms\n", "decode every snapshot", count, secondsSince(start) * 1000);
+    FileManager::STATE_PATH = statePath;
+    remove(SESSIONS_PATH);
+}
+
+// ------------------ History by time ------------------
+// One visit per second with a few stragglers a little out of order: the last
+// hour through the time index versus a scan of the whole history, then
+// expiring the oldest tenth by walking just that prefix.
+static void benchTimeRange(size_t n) {
+    HistoryLog history;
+    Page p("example.com", "Example");
+    for (size_t i = 0; i < n; i++) {
+        p.timestamp = (time_t)i - (i % 97 == 0 ? 5 : 0);
+        history.append(p);
+    }
+    time_t from = (time_t)n - 3600, to = (time_t)n;
+    const size_t queries = 1000;
+
+    auto start = chrono::steady_clock::now();
+    TimeIndex index;
+    index.build(history);
+    printf("%-40s %12zu visits %10.3f s\n", "build time index", n, secondsSince(start));
+
+    size_t found = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries; q++) {
+        auto range = index.range(from, to);
+        for (size_t i = range.first; i < range.second; i++)
+            found += history[i].timestamp >= from && history[i].timestamp <= to;
+    }
+    report("last hour via time index n=" + to_string(n), queries, secondsSince(start));
+
+    size_t scanned = 0;
+    start = chrono::steady_clock::now();
+    for (size_t q = 0; q < queries / 100; q++)
+        for (auto& visit : history) scanned += visit.timestamp >= from && visit.timestamp <= to;
+    report("last hour via full scan n=" + to_string(n), queries / 100, secondsSince(start));
+    if (found / queries != scanned / (queries / 100)) printf("  mismatch: %zu vs %zu\n", found, scanned);
+
+    start = chrono::steady_clock::now();
+    size_t end = history.start();
+    while (end < history.size() && history[end].timestamp < (time_t)(n / 10)) end++;
+    history.expire(end);
+    index.expire(end);
+    printf("%-40s %12zu visits %10.3f s\n", "expire oldest tenth", end, secondsSince(start));
+}
+
+// ------------------ Tab table ------------------
+// n open tabs, then rounds of: look a tab up by id, close a random one, open
+// a new one. The legacy path is the old vector<Tab*> with a linear id scan,
+// erase from the middle and a heap allocation per tab.
+static void benchTabs(size_t n) {
+    const size_t rounds = 100000;
+    mt19937 rng(7);
+    vector<Tab*> legacy;
+    for (size_t i = 0; i < n; i++) legacy.push_back(new Tab(i + 1));
+    int nextId = n + 1;
+    auto start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        int wanted = legacy[rng() % legacy.size()]->id;
+        for (size_t i = 0; i < legacy.size(); i++)
+            if (legacy[i]->id == wanted) {
+                delete legacy[i];
+                legacy.erase(legacy.begin() + i);
+                break;
+            }
+        legacy.push_back(new Tab(nextId++));
+    }
+    report("vector<Tab*> find+close+open tabs=" + to_string(n), rounds, secondsSince(start));
+    for (auto tab : legacy) delete tab;
+
+    TabTable table;
+    vector<int> ids;
+    for (size_t i = 0; i < n; i++) {
+        table.open(i + 1, 1);
+        ids.push_back(i + 1);
+    }
+    nextId = n + 1;
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        size_t k = rng() % ids.size();
+        table.close(table.find(ids[k]));
+        table.open(nextId, 1);
+        ids[k] = nextId++;
+    }
+    report("TabTable find+close+open tabs=" + to_string(n), rounds, secondsSince(start));
+}
+
+// ------------------ Tab groups ------------------
+// n tabs in groups of `size`. Reaching a group's tabs by filtering every tab
+// (what a flat tab list allows) against walking the group's own chain, then
+// moving random groups to a second window and back.
+static void benchGroups(size_t n, size_t size) {
+    const size_t rounds = 1000;
+    mt19937 rng(11);
+    TabTable table;
+    size_t groups = n / size;
+    table.openWindow(1);
+    table.openWindow(2);
+    for (size_t g = 1; g <= groups; g++) table.createGroup(g, 1, "group " + to_string(g));
+    for (size_t i = 0; i < n; i++) table.open(i + 1, 1, i / size + 1);
+
+    size_t found = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        int g = rng() % groups + 1;
+        for (Tab* tab : table)
+            if (tab->groupId == g) found++;
+    }
+    report("scan all tabs for a group n=" + to_string(n), rounds, secondsSince(start));
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+        for (Tab* tab : table.groupTabs(rng() % groups + 1)) found += tab->id > 0;
+    report("walk group chain n=" + to_string(n), rounds, secondsSince(start));
+    start = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        int g = rng() % groups + 1;
+        table.moveGroup(g, 2);
+        table.moveGroup(g, 1);
+    }
+    report("move group there and back n=" + to_string(n), rounds, secondsSince(start));
+    if (found != 2 * rounds * size) cerr << "group walk mismatch\n";
+}
+
+// ------------------ Tab hibernation ------------------
+// n tabs of 100 pages each: packing every tab, moving the packed pages to
+// the spill file, then thawing them back from memory and from the file.
+static void benchHibernation(size_t n) {
+    vector<unique_ptr<Tab>> tabs;
+    for (size_t t = 0; t < n; t++) {
+        tabs.emplace_back(new Tab(t + 1));
+        for (size_t i = 0; i < 100; i++) tabs.back()->nav.visit(Page(traceUrl(t * 100 + i), traceTitle(i)));
+    }
+    size_t resident = n * tabs[0]->nav.capacity() * sizeof(Page), packed = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& tab : tabs) packed += tab->hibernate();
+    report("hibernate tab n=" + to_string(n), n, secondsSince(start));
+    printf("%-40s %12zu tabs %10.1f MB resident %8.1f MB packed\n", "navigation pages", n, resident / 1e6, packed / 1e6);
+    start = chrono::steady_clock::now();
+    for (auto& tab : tabs) tab->thawed();
+    report("thaw packed tab n=" + to_string(n), n, secondsSince(start));
+
+    SpillFile spill;
+    for (auto& tab : tabs) tab->hibernate();
+    start = chrono::steady_clock::now();
+    for (auto& tab : tabs) tab->spill(spill);
+    report("spill packed tab n=" + to_string(n), n, secondsSince(start));
+    start = chrono::steady_clock::now();
+    for (auto& tab : tabs) tab->thawed();
+    report("thaw spilled tab n=" + to_string(n), n, secondsSince(start));
+    if (tabs[0]->nav.size() != 100) cerr << "thaw lost pages\n";
+}
+
+// ------------------ URL canonicalization ------------------
+// The trace's URLs written the ways users and links do (scheme or not,
+// upper-case hosts, default ports, trailing slashes, shuffled queries):
+// canonicalizing alone, then interning with the canonical hash versus
+// interning the raw text, and how many distinct keys each leaves.
+static string variantUrl(size_t i, mt19937& rng) {
+    static const char* prefixes[] = {"", "http://", "https://", "HTTPS://"};
+    string host = "www.site" + to_string(i % TRACE_DISTINCT) + ".example.com";
+    if (rng() % 4 == 0) host[0] = 'W';
+    string url = prefixes[rng() % 4] + host + (rng() % 4 == 0 ? ":443" : "") + "/articles/index.html";
+    if (rng() % 2) url += '/';
+    if (i % 3 == 0) url += rng() % 2 ? "?page=2&sort=new" : "?sort=new&page=2";
+    return url;
+}
+
+static void benchCanonicalUrls(size_t n) {
+    mt19937 rng(5);
+    vector<string> urls;
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        urls.push_back(variantUrl(i, rng));
+        bytes += urls.back().size();
+    }
+    string canonical;
+    uint64_t check = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& url : urls) check += canonicalizeUrl(url, canonical);
+    double secs = secondsSince(start);
+    report("canonicalizeUrl n=" + to_string(n), n, secs);
+    printf("%-40s %12zu URLs %10.1f MB/s\n", "canonicalizeUrl throughput", n, bytes / secs / 1e6);
+
+    StringPool raw, canonicalPool;
+    start = chrono::steady_clock::now();
+    for (auto& url : urls) raw.intern(url);
+    report("intern raw URL n=" + to_string(n), n, secondsSince(start));
+    start = chrono::steady_clock::now();
+    for (auto& url : urls) {
+        uint64_t h = canonicalizeUrl(url, canonical);
+        canonicalPool.intern(canonical, h);
+    }
+    report("canonicalize + intern n=" + to_string(n), n, secondsSince(start));
+    printf("%-40s %12zu raw %12zu canonical\n", "distinct URL keys", raw.size() - 1, canonicalPool.size() - 1);
+    if (!check) cerr << "no hashes\n";
+}
+
+// ------------------ Concurrent tabs ------------------
+// `threads` workers each drive their own tab through the tab-id API, journal
+// included, until the visit queue is drained; the total work is fixed so runs
+// are comparable.
+
+static void benchContention(size_t threads) {
+    static const size_t TOTAL_VISITS = 320000;
+    size_t each = TOTAL_VISITS / threads;
+    FileManager::STATE_PATH = BENCH_STATE_PATH;
+    FileManager::JOURNAL_PATH = BENCH_JOURNAL_PATH;
+    remove(BENCH_STATE_PATH);
+    remove(BENCH_JOURNAL_PATH);
+    cout.setstate(ios::failbit);        // the browser's own messages
+    {
+        Browser browser;
+        vector<int> ids;
+        vector<vector<string>> urls(threads);
+        for (size_t t = 0; t < threads; t++) {
+            ids.push_back(browser.openTab());
+            for (size_t i = 0; i < each; i++) urls[t].push_back(traceUrl(t * each + i));
+        }
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (size_t t = 0; t < threads; t++)
+            workers.emplace_back([&, t] {
+                for (auto& url : urls[t]) browser.visitPage(ids[t], url, "Trace page");
+            });
+        for (auto& w : workers) w.join();
+        browser.flush();
+        report("visitPage, " + to_string(threads) + " threads", each * threads, secondsSince(start));
+    }
+    remove(BENCH_STATE_PATH);
+    remove(BENCH_JOURNAL_PATH);
+}
+
+
+int main() {
+    // Runs first so the forked children start with empty string pools.
+    cout << "--- state.bin startup, 10M history entries ---\n";
+    FileManager::STATE_PATH = BENCH_STATE_PATH;
+    isolated(writeProfile, 10000000);
+    isolated(loadProfile, 10000000);
+    isolated(startBrowser, 10000000);
+    remove(BENCH_STATE_PATH);
+
+    cout << "--- history append ---\n";
+    benchLegacyHistory(10000);
+    benchLegacyHistory(20000);
+    benchHistoryLog(1000000);
+    benchHistoryLog(10000000);
+
+    cout << "--- bookmark search ---\n";
+    benchBookmarks(100000);
+    benchBookmarks(1000000);
+
+    cout << "--- most visited, 10M visits ---\n";
+    benchMostVisited(10000000, 5000000);
+    isolated([](size_t n) { benchFrecency(n, 1000000); }, 10000000);
+
+    cout << "--- concurrent tabs, " << thread::hardware_concurrency() << " hardware threads ---\n";
+    for (size_t threads : {1, 2, 4, 8, 16, 32}) isolated(benchContention, threads);
+
+    cout << "--- URL canonicalization ---\n";
+    benchCanonicalUrls(1000000);
+
+    cout << "--- history & bookmark search ---\n";
+    benchSearch(100000);
+    benchSearch(1000000);
+
+    cout << "--- tab open/close/lookup ---\n";
+    benchTabs(100);
+    benchTabs(10000);
+
+    cout << "--- tab groups, 8 tabs each ---\n";
+    benchGroups(1000, 8);
+    benchGroups(100000, 8);
+
+    cout << "--- tab hibernation, 100 pages each ---\n";
+    benchHibernation(1000);
+    benchHibernation(10000);
+
+    cout << "--- history by time ---\n";
+    benchTimeRange(1000000);
+    benchTimeRange(10000000);
+
+    cout << "--- session snapshots ---\n";
+    benchSessions(1000);
+    benchSessions(10000);
+
+    cout << "--- resident memory, 5M-visit trace ---\n";
+    isolated(traceLegacyPages, 5000000);
+    isolated(traceInternedPages, 5000000);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef BOOKMARKINDEX_H
+#define BOOKMARKINDEX_H
+
+#include "structures.h"
+#include <algorithm>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+struct BookmarkEntry {
+    TitleId titleId;
+    UrlId urlId;
+};
+
+// Bookmarks ordered by title (then URL), maintained on every add instead of
+// being re-sorted for every view or search.
+// Entries live in a list of small sorted blocks (a two-level B+-tree): a
+// binary search over the blocks' last entries picks the block, a second one
+// finds the slot, and an insert only shifts entries within one block.
+// Bookmarks sharing a title are adjacent, so an exact lookup returns all of
+// them as one contiguous range.
+class BookmarkIndex {
+private:
+    static const size_t BLOCK_FILL = 256, BLOCK_MAX = 512;
+    vector<vector<BookmarkEntry>> blocks;   // non-empty, each sorted, in order
+    size_t count;
+
+    static bool less(const BookmarkEntry& a, const BookmarkEntry& b) {
+        if (a.titleId != b.titleId) return titlePool().get(a.titleId) < titlePool().get(b.titleId);
+        return urlPool().get(a.urlId) < urlPool().get(b.urlId);
+    }
+
+    static string_view titleOf(const BookmarkEntry& e) { return titlePool().get(e.titleId); }
+
+    // Block that holds, or should hold, entry e.
+    size_t blockFor(const BookmarkEntry& e) const {
+        size_t b = partition_point(blocks.begin(), blocks.end(),
+                                   [&](const vector<BookmarkEntry>& blk) { return less(blk.back(), e); }) -
+                   blocks.begin();
+        return b < blocks.size() ? b : blocks.size() - 1;
+    }
+
+public:
+    class iterator {
+    private:
+        const BookmarkIndex* index;
+        size_t block, pos;
+    public:
+        iterator(const BookmarkIndex* i, size_t b, size_t p) : index(i), block(b), pos(p) {}
+        const BookmarkEntry& operator*() const { return index->blocks[block][pos]; }
+        const BookmarkEntry* operator->() const { return &index->blocks[block][pos]; }
+        iterator& operator++() {
+            if (++pos == index->blocks[block].size()) {
+                block++;
+                pos = 0;
+            }
+            return *this;
+        }
+        bool operator==(const iterator& other) const { return block == other.block && pos == other.pos; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+    typedef pair<iterator, iterator> Range;
+
+    BookmarkIndex() : count(0) {}
+
+    void insert(const Page& p) {
+        BookmarkEntry e = {p.titleId, p.urlId};
+        count++;
+        if (blocks.empty()) {
+            blocks.push_back({e});
+            return;
+        }
+        size_t b = blockFor(e);
+        vector<BookmarkEntry>& blk = blocks[b];
+        blk.insert(upper_bound(blk.begin(), blk.end(), e, less), e);
+        if (blk.size() > BLOCK_MAX) {
+            vector<BookmarkEntry> upper(blk.begin() + blk.size() / 2, blk.end());
+            blk.resize(blk.size() / 2);
+            blocks.insert(blocks.begin() + b + 1, move(upper));
+        }
+    }
+
+    void erase(const Page& p) {
+        if (blocks.empty()) return;
+        BookmarkEntry e = {p.titleId, p.urlId};
+        size_t b = blockFor(e);
+        vector<BookmarkEntry>& blk = blocks[b];
+        auto it = lower_bound(blk.begin(), blk.end(), e, less);
+        if (it == blk.end() || it->titleId != e.titleId || it->urlId != e.urlId) return;
+        blk.erase(it);
+        count--;
+        if (blk.empty()) blocks.erase(blocks.begin() + b);
+    }
+
+    // Replaces the contents; `sorted` entries are trusted to already be in index order.
+    void assign(vector<BookmarkEntry> all, bool sorted) {
+        if (!sorted) sort(all.begin(), all.end(), less);
+        blocks.clear();
+        for (size_t i = 0; i < all.size(); i += BLOCK_FILL)
+            blocks.emplace_back(all.begin() + i, all.begin() + min(all.size(), i + BLOCK_FILL));
+        count = all.size();
+    }
+
+    // First entry whose title is >= key (orEqual) or > key (!orEqual).
+    iterator lowerBound(string_view key, bool orEqual = true) const {
+        auto before = [&](const BookmarkEntry& e) { return orEqual ? titleOf(e) < key : titleOf(e) <= key; };
+        size_t b = partition_point(blocks.begin(), blocks.end(),
+                                   [&](const vector<BookmarkEntry>& blk) { return before(blk.back()); }) -
+                   blocks.begin();
+        if (b == blocks.size()) return end();
+        size_t pos = partition_point(blocks[b].begin(), blocks[b].end(), before) - blocks[b].begin();
+        return iterator(this, b, pos);
+    }
+
+    // Every bookmark titled exactly `title`.
+    Range find(string_view title) const { return {lowerBound(title), lowerBound(title, false)}; }
+
+    // Titles in [from, to).
+    Range range(string_view from, string_view to) const { return {lowerBound(from), lowerBound(to)}; }
+
+    // Titles starting with `prefix`; the end is found by walking the matches.
+    Range prefix(string_view prefix) const {
+        iterator first = lowerBound(prefix), last = first;
+        while (last != end() && titleOf(*last).substr(0, prefix.size()) == prefix) ++last;
+        return {first, last};
+    }
+
+    iterator begin() const { return iterator(this, 0, 0); }
+    iterator end() const { return iterator(this, blocks.size(), 0); }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    vector<BookmarkEntry> all() const {
+        vector<BookmarkEntry> out;
+        out.reserve(count);
+        for (auto& blk : blocks) out.insert(out.end(), blk.begin(), blk.end());
+        return out;
+    }
+};
+
+#endif
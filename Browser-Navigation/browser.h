@@ -2,357 +2,1577 @@
 #define BROWSER_H
 
 #include "structures.h"
+#include "historyLog.h"
+#include "bookmarkIndex.h"
 #include "fileManager.h"
+#include "journal.h"
+#include "searchIndex.h"
+#include "tabTable.h"
+#include "timeIndex.h"
+#include "visitQueue.h"
 #include <iostream>
 #include <algorithm>
 #include <vector>
+#include <deque>
 #include <unordered_map>
-#include <stack>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
 using namespace std;
 
+// Where tab memory stands; see Browser::hibernationStats.
+struct HibernationStats {
+    size_t residentTabs = 0, hibernatedTabs = 0;
+    size_t bytesSaved = 0;          // memory freed: navigation rings, less what hibernated tabs still hold in memory
+    size_t packedBytes = 0;         // packed pages in memory
+    size_t spilledBytes = 0;        // packed pages in the spill file, on disk
+    size_t spillFileBytes = 0;      // the spill file's length, holes included
+    uint64_t thaws = 0;
+    double meanThawMicros = 0, maxThawMicros = 0;
+};
+
+// Tabs can be driven from many threads at once through the tab-id API
+// (openTab, visitPage(tabId, ...), goBack(tabId), ...). Locks are taken in
+// this order:
+//   tabsLock     shared by per-tab operations, exclusive for anything that
+//                changes the tab list, snapshots or compacts
+//   Tab::lock    one tab's navigation
+//   leaf locks   bookmarksLock (then searchLock), searchLock, frecencyLock,
+//                lruLock, the spill file's and the journal's own; none is
+//                held while taking another
+// A visit only touches its own tab and the journal on the caller's thread.
+// History, visit counts, frecency and the search index are fed in batches by
+// the consumer of `visits`; flush() waits for it to catch up.
+//
+// Startup only maps state.bin, attaches the history to it, lists the tabs as
+// stubs (see Tab) and replays the journal, so it stays flat as the profile
+// grows. Bookmarks, visit counts with frecency, and saved sessions are each
+// loaded by the first operation that needs them and merged with whatever
+// changed since startup; compaction loads them all first.
 class Browser {
 private:
-    vector<Tab*> tabs;
-    int currentTabIndex, nextTabId;
-    unordered_map<string, Page> bookmarks;
-    unordered_map<string, int> visitCount;
-    HistoryNode* historyHead;
-    vector<SessionSnapshot> sessionHistory;
+    mutable shared_mutex tabsLock;
+    mutable mutex bookmarksLock, searchLock, frecencyLock;
+    mutex lruLock;                             // the tab table's order of use
+    ostream out;                               // cout, or nowhere when quiet
+    SpillFile spill;                           // before tabs, which drop their spilled pages as they go
+    TabTable tabs;
+    TabHandle currentTab;                      // also the active tab of its window and group
+    int nextTabId;
+    int nextWindowId = 1, nextGroupId = 1;     // past the largest ids in use
+    unordered_map<UrlId, Page> bookmarks;      // only those added since startup until bookmarksLoaded
+    BookmarkIndex bookmarkIndex;
+    bool bookmarksLoaded = false;              // guarded by bookmarksLock
+    static const size_t MAX_TRACKED_URLS = 0;  // 0 counts every URL exactly; otherwise bounds visit-count memory
+    ShardedVisitCounter visitCount{MAX_TRACKED_URLS};
+    Frecency frecency;
+    bool countsLoaded = false;                 // visitCount and frecency; guarded by searchLock
+    size_t countedVisits = 0;                  // history entries the stored counts already include
+    HistoryLog history;
+    SearchIndex searchIndex;
+    bool searchIndexed = false;                // built on the first search, then kept up to date; guarded by searchLock
+    TimeIndex timeIndex;
+    bool timeIndexed = false;                  // likewise for time range queries; guarded by searchLock
+    deque<SessionSnapshot> sessionHistory;     // only those taken since startup until sessionsLoaded
+    bool sessionsLoaded = false;               // guarded by tabsLock
+    shared_ptr<const TabList> sessionTabs;     // tab list of the latest snapshot
+    atomic<bool> tabsDirty{true};              // sessionTabs is stale
 
     static const int MAX_SNAPSHOTS = 20;
     time_t lastSnapshotTime = 0;
+    bool lastSnapshotAutomatic = false;
     static const int SNAPSHOT_INTERVAL = 300;  // 5 minutes
 
+    Journal journal;
+    bool replaying = false;
+    static const size_t COMPACT_BYTES = 4 << 20;  // fold the journal into state.bin past this size
+    atomic<bool> compactPending{false};
+
+    // Hibernation (see hibernateIdle); the settings are guarded by tabsLock.
+    time_t idleSeconds = 30 * 60;
+    size_t residentBudget = 32 << 20;          // bytes of navigation rings kept resident
+    size_t packedBudget = 8 << 20;             // bytes of packed pages kept in memory
+    static const int SWEEP_INTERVAL_MS = 1000;
+    atomic<int64_t> nextSweep{0};              // steady clock, in ms
+    atomic<uint64_t> thaws{0}, thawNanos{0}, maxThawNanos{0};
+
+    double startupSeconds = 0;                 // constructor start to first command
+    VisitQueue visits;                         // last, so its consumer stops before the rest goes away
+
     // ------------------ Helper Functions ------------------
-    void addToHistory(Page p) {
-        HistoryNode* node = new HistoryNode(p);
-        if (!historyHead) historyHead = node;
-        else {
-            HistoryNode* temp = historyHead;
-            while (temp->next) temp = temp->next;
-            temp->next = node;
+    // The shared side of a batch of visits: run by the queue's consumer, or
+    // directly while replaying the journal.
+    // Until the counts are loaded, visits only reach history; loadCounts()
+    // catches up from there.
+    void absorb(const Page* pages, size_t n) {
+        {
+            lock_guard<mutex> guard(searchLock);
+            for (size_t i = 0; i < n; i++) history.append(pages[i]);
+            if (searchIndexed)
+                for (size_t i = 0; i < n; i++) searchIndex.addVisit(pages[i]);
+            if (timeIndexed)
+                for (size_t i = 0; i < n; i++) timeIndex.add(pages[i].timestamp);
+            if (!countsLoaded) return;
         }
+        for (size_t i = 0; i < n; i++) visitCount.add(pages[i].urlId);
+        lock_guard<mutex> guard(frecencyLock);
+        for (size_t i = 0; i < n; i++) frecency.visit(pages[i].urlId, pages[i].timestamp);
     }
 
-    void captureSessionSnapshot(const string& desc) {
-        SessionSnapshot snapshot(desc);
+    void tabChanged(Tab* tab) {
+        tab->frozen.reset();
+        if (!tabsDirty.load(memory_order_relaxed)) tabsDirty = true;
+    }
 
-        for (auto tab : tabs) {
-            string tabRecord;
-
-            // Back stack (oldest to newest)
-            vector<Page> backHistory;
-            {
-                stack<Page> temp = tab->backStack;
-                while (!temp.empty()) {
-                    backHistory.push_back(temp.top());
-                    temp.pop();
-                }
-                reverse(backHistory.begin(), backHistory.end());
-            }
+    Tab* findTab(int id) const { return tabs.findTab(id); }
 
-            for (size_t i = 0; i < backHistory.size(); ++i) {
-                tabRecord += backHistory[i].url;
-                tabRecord += " -> ";
-            }
+    int currentTabId() const {
+        shared_lock<shared_mutex> shared(tabsLock);
+        return tabs.get(currentTab)->id;
+    }
 
-            // Current page
-            if (!tab->currentPage.url.empty())
-                tabRecord += tab->currentPage.url;
-            else
-                tabRecord += "[empty]";
-
-            // Forward stack
-            {
-                stack<Page> temp = tab->forwardStack;
-                while (!temp.empty()) {
-                    tabRecord += " -> " + temp.top().url;
-                    temp.pop();
-                }
+    // Callers hold tabsLock exclusively, as for everything that changes tabs.
+    void setCurrent(TabHandle h) {
+        currentTab = h;
+        tabs.activate(h);
+    }
+
+    // The window new tabs open in: the current tab's.
+    int currentWindow() const {
+        Tab* tab = tabs.get(currentTab);
+        if (tab) return tab->windowId;
+        return tabs.windowIds().empty() ? 1 : tabs.windowIds()[0];
+    }
+
+    // A window left empty closes, unless it is the only one.
+    void dropIfEmpty(int windowId) {
+        Window* w = tabs.window(windowId);
+        if (w && !w->tabs.size && tabs.windowIds().size() > 1) tabs.closeWindow(windowId);
+    }
+
+    // Where the current tab goes when it closes: the window's active tab,
+    // or the first window's once the window is gone.
+    TabHandle fallbackTab(int windowId) const {
+        const Window* w = tabs.window(windowId);
+        if (!w || !w->tabs.size) w = tabs.window(tabs.windowIds()[0]);
+        return w->active;
+    }
+
+    // Taken before closing any of them, so the walk does not see its own closes.
+    static vector<TabHandle> handlesIn(const TabTable::Range& range) {
+        vector<TabHandle> handles;
+        for (auto it = range.begin(); it != range.end(); ++it) handles.push_back(it.handle());
+        return handles;
+    }
+
+    void printVisits(const string& heading, const vector<Page>& pages) {
+        if (pages.empty()) {
+            out << "\n No matching visits.\n";
+            return;
+        }
+        out << "\n========= " << heading << " =========\n";
+        for (auto& p : pages) {
+            char timeStr[100];
+            strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&p.timestamp));
+            out << timeStr << " - " << p.title() << " (" << p.url() << ")\n";
+        }
+        out << "====================================\n";
+    }
+
+    // ------------------ Lazy Loading ------------------
+    // Callers hold bookmarksLock. Bookmarks added since startup replace stored ones.
+    void loadBookmarks() {
+        if (bookmarksLoaded) return;
+        vector<Page> recent;
+        for (auto& b : bookmarks) recent.push_back(b.second);
+        bookmarks.clear();
+        FileManager::loadBookmarks(bookmarks, bookmarkIndex);
+        bookmarksLoaded = true;
+        for (auto& p : recent) storeBookmark(p);
+    }
+
+    // The stored counts cover the first countedVisits history entries; the
+    // rest are added here. absorb() appends under searchLock and only counts
+    // once countsLoaded is set, so every visit is counted exactly once.
+    void loadCounts() {
+        lock_guard<mutex> guard(searchLock);
+        if (countsLoaded) return;
+        FileManager::loadVisitCount(visitCount);
+        FileManager::loadFrecency(frecency, history, countedVisits);
+        for (size_t i = countedVisits; i < history.size(); i++) {
+            visitCount.add(history[i].urlId);
+            frecency.visit(history[i].urlId, history[i].timestamp);
+        }
+        countsLoaded = true;
+    }
+
+    // Callers hold tabsLock exclusively. Stored snapshots decode their tabs on
+    // first use, so a restore only reads the records it reopens.
+    const TabList& snapshotTabs(size_t index) {
+        if (!sessionHistory[index].tabs) FileManager::loadSnapshotTabs(sessionHistory[index]);
+        return *sessionHistory[index].tabs;
+    }
+
+    // Callers hold tabsLock exclusively. Snapshots taken since startup are
+    // all newer than the stored ones, so they go after them.
+    void loadSessions() {
+        if (sessionsLoaded) return;
+        deque<SessionSnapshot> stored;
+        FileManager::loadSessionHistory(stored);
+        sessionHistory.insert(sessionHistory.begin(), stored.begin(), stored.end());
+        while (sessionHistory.size() > MAX_SNAPSHOTS) sessionHistory.pop_front();
+        sessionsLoaded = true;
+    }
+
+    // ------------------ State Changes & Journal ------------------
+    // Every persistent change goes through one of these functions and is then
+    // recorded in the journal. Replay feeds journal entries back through the
+    // same functions with recording switched off.
+    // Compaction needs tabsLock exclusively, so record() only flags it and
+    // maybeCompact() runs it once the caller has released its locks.
+    void record(const JournalEntry& e) {
+        if (replaying) return;
+        journal.append(e);
+        if (journal.size() > COMPACT_BYTES) compactPending = true;
+    }
+
+    // Also where idle tabs get hibernated.
+    void maybeCompact() {
+        if (compactPending.exchange(false)) compact();
+        maybeHibernate();
+    }
+
+    // At most once per SWEEP_INTERVAL_MS, by whichever operation gets there first.
+    void maybeHibernate() {
+        int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t due = nextSweep.load(memory_order_relaxed);
+        if (now < due || !nextSweep.compare_exchange_strong(due, now + SWEEP_INTERVAL_MS)) return;
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        hibernateIdle(idleSeconds);
+    }
+
+    // Callers hold tabsLock exclusively. Walks from the most recently used
+    // tab, keeping tabs resident while they were used within `idle` seconds
+    // and fit residentBudget, and hibernates the rest. Only use thaws a tab,
+    // and use also makes it the most recent, so the walk stops at the first
+    // tab already hibernated: every one after it is too. Packed pages beyond
+    // packedBudget then go to the spill file, least recently used first.
+    size_t hibernateIdle(time_t idle) {
+        INSTRUMENT("Browser::hibernateIdle");
+        time_t now = time(nullptr);
+        size_t resident = 0, slept = 0;
+        for (TabHandle h = tabs.mostRecent(); Tab* tab = tabs.get(h); h = tabs.lessRecent(h)) {
+            if (tab->hibernated()) break;
+            size_t bytes = tab->nav.capacity() * sizeof(Page);
+            if (now - tabs.lastUsed(h) < idle && resident + bytes <= residentBudget)
+                resident += bytes;
+            else {
+                tab->hibernate();
+                slept++;
             }
+        }
+        if (!slept) return 0;
+        size_t packed = 0;
+        for (TabHandle h = tabs.leastRecent(); Tab* tab = tabs.get(h); h = tabs.moreRecent(h)) {
+            if (!tab->hibernated()) break;
+            if (tab->packed && !tab->packed->spill) packed += tab->packed->bytes.size();
+        }
+        for (TabHandle h = tabs.leastRecent(); packed > packedBudget; h = tabs.moreRecent(h)) {
+            Tab* tab = tabs.get(h);
+            if (!tab || !tab->hibernated()) break;
+            size_t bytes = tab->packed && !tab->packed->spill ? tab->packed->bytes.size() : 0;
+            if (bytes && tab->spill(spill)) packed -= bytes;
+        }
+        return slept;
+    }
 
-            snapshot.tabData.push_back({tab->id, tabRecord});
+    // Callers hold the tab's lock, or tabsLock exclusively. Marks the tab as
+    // used, thawing it first if it hibernated.
+    NavigationRing& wake(Tab* tab) {
+        if (tab->hibernated()) thaw(tab);
+        {
+            lock_guard<mutex> guard(lruLock);
+            tabs.touch(tab->id, time(nullptr));
         }
+        return tab->thawed();
+    }
 
-        sessionHistory.push_back(snapshot);
-        cout << "Captured snapshot: " << snapshot.tabData.size() << " tabs.\n";
+    void thaw(Tab* tab) {
+        INSTRUMENT("Browser::thaw");
+        auto start = chrono::steady_clock::now();
+        tab->thawed();
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        thaws++;
+        thawNanos += ns;
+        uint64_t seen = maxThawNanos.load(memory_order_relaxed);
+        while (ns > seen && !maxThawNanos.compare_exchange_weak(seen, ns, memory_order_relaxed)) {}
+    }
+
+    // Callers hold the tab's lock.
+    void applyVisit(Tab* tab, const Page& page) {
+        wake(tab).visit(page);
+        tabChanged(tab);
+        if (replaying) absorb(&page, 1);
+        else visits.push(page);
+    }
+
+    // Callers hold bookmarksLock.
+    void storeBookmark(const Page& page) {
+        auto old = bookmarks.find(page.urlId);
+        if (old != bookmarks.end()) bookmarkIndex.erase(old->second);
+        bookmarks[page.urlId] = page;
+        bookmarkIndex.insert(page);
     }
 
-    // ------------------ Divide & Conquer Section ------------------
-    void merge(vector<Page>& arr, int left, int mid, int right) {
-        vector<Page> L(arr.begin() + left, arr.begin() + mid + 1);
-        vector<Page> R(arr.begin() + mid + 1, arr.begin() + right + 1);
-        int i = 0, j = 0, k = left;
+    void applyBookmark(const Page& page) {
+        lock_guard<mutex> guard(bookmarksLock);
+        storeBookmark(page);
+        lock_guard<mutex> indexing(searchLock);
+        if (searchIndexed) searchIndex.addBookmark(page);
+    }
 
-        while (i < L.size() && j < R.size()) {
-            if (L[i].title < R[j].title)
-                arr[k++] = L[i++];
-            else
-                arr[k++] = R[j++];
+    // Opens at the end of a window (0 for the current tab's), created if new.
+    void applyTabOpen(int id, int windowId = 0) {
+        if (!windowId) windowId = currentWindow();
+        setCurrent(tabs.open(id, windowId));
+        if (id >= nextTabId) nextTabId = id + 1;
+        if (windowId >= nextWindowId) nextWindowId = windowId + 1;
+        tabsDirty = true;
+    }
+
+    // Closing the current tab moves to the one after it in its window, or
+    // before it at the end. A group or window left empty goes too.
+    void applyTabClose(TabHandle h) {
+        Tab* tab = tabs.get(h);
+        int windowId = tab->windowId, groupId = tab->groupId;
+        tabs.close(h);
+        if (groupId) tabs.removeGroup(groupId);
+        dropIfEmpty(windowId);
+        if (h == currentTab) setCurrent(fallbackTab(windowId));
+        tabsDirty = true;
+    }
+
+    // Closes the window's tabs, one by one as applyTabClose; the last window stays.
+    bool applyWindowClose(int windowId) {
+        if (!tabs.window(windowId) || tabs.windowIds().size() == 1) return false;
+        for (auto h : handlesIn(tabs.windowTabs(windowId))) applyTabClose(h);
+        return true;
+    }
+
+    bool applyGroupCreate(int groupId, int windowId, const string& name) {
+        if (!tabs.createGroup(groupId, windowId, name)) return false;
+        if (groupId >= nextGroupId) nextGroupId = groupId + 1;
+        return true;
+    }
+
+    // A tab joining a group in another window moves there; whatever it
+    // leaves empty goes.
+    bool applyGroupSet(TabHandle h, int groupId) {
+        Tab* tab = tabs.get(h);
+        int oldGroup = tab->groupId, oldWindow = tab->windowId;
+        if (!tabs.setGroup(h, groupId)) return false;
+        if (oldGroup) tabs.removeGroup(oldGroup);
+        dropIfEmpty(oldWindow);
+        if (h == currentTab) setCurrent(h);
+        tabChanged(tab);
+        return true;
+    }
+
+    // Never closes the last tabs.
+    bool applyGroupClose(int groupId) {
+        TabGroup* g = tabs.group(groupId);
+        if (!g || g->tabs.size == tabs.size()) return false;
+        for (auto h : handlesIn(tabs.groupTabs(groupId))) applyTabClose(h);
+        tabs.removeGroup(groupId);
+        return true;
+    }
+
+    // Opens the window if it is new. Only the group's tabs are touched.
+    bool applyGroupMove(int groupId, int windowId) {
+        TabGroup* g = tabs.group(groupId);
+        if (!g || g->windowId == windowId) return false;
+        int from = g->windowId;
+        tabs.openWindow(windowId);
+        if (windowId >= nextWindowId) nextWindowId = windowId + 1;
+        tabs.moveGroup(groupId, windowId);
+        for (Tab* tab : tabs.groupTabs(groupId)) tabChanged(tab);
+        dropIfEmpty(from);
+        setCurrent(currentTab);
+        return true;
+    }
+
+    // Callers have loaded the sessions. A snapshot of the whole session
+    // replaces every tab, each reopening in its window and, if that still
+    // exists there, its group. One of a window or group replaces only that
+    // window's or group's tabs, so it costs what they hold: a group closed
+    // since comes back under the snapshot's description, and a tab whose id
+    // is now taken elsewhere gets a new one. Tabs imported from the legacy
+    // text format kept URLs only; their pages take the bookmark's title, or
+    // else the URL.
+    void applyRestore(int index) {
+        const SessionSnapshot& snapshot = sessionHistory[index];
+        int windowId = snapshot.windowId, groupId = snapshot.groupId;
+        bool scoped = windowId || groupId;
+        vector<int> left;       // groups the replaced tabs were in, removed below if left empty
+        if (groupId) {
+            if (TabGroup* g = tabs.group(groupId))
+                windowId = g->windowId;
+            else {
+                if (!tabs.window(windowId)) windowId = currentWindow();
+                applyGroupCreate(groupId, windowId, snapshot.description);
+            }
+            left.push_back(groupId);
+            for (auto h : handlesIn(tabs.groupTabs(groupId))) tabs.close(h);
+        } else if (windowId) {
+            for (auto h : handlesIn(tabs.windowTabs(windowId))) {
+                left.push_back(tabs.get(h)->groupId);
+                tabs.close(h);
+            }
+        } else {
+            windowId = currentWindow();
+            for (auto& g : tabs.allGroups()) left.push_back(g.first);
+            tabs.clear();
+        }
+        lock_guard<mutex> guard(bookmarksLock);
+        for (auto& record : snapshotTabs(index)) {
+            int id = scoped && tabs.findTab(record->id) ? nextTabId : record->id;
+            int w = scoped || !record->windowId ? windowId : record->windowId;
+            Tab* newTab = tabs.get(tabs.open(id, w, groupId ? groupId : record->groupId));
+            for (auto p : record->entries) {
+                if (record->urlsOnly) {
+                    loadBookmarks();
+                    auto b = bookmarks.find(p.urlId);
+                    p.titleId = b != bookmarks.end() ? b->second.titleId : titlePool().intern(p.url());
+                }
+                newTab->nav.visit(p);
+            }
+            size_t evicted = record->entries.size() - newTab->nav.size();
+            newTab->nav.setCursor(record->cursor >= evicted ? record->cursor - evicted : 0);
+            if (id >= nextTabId) nextTabId = id + 1;
+            if (w >= nextWindowId) nextWindowId = w + 1;
         }
+        tabsDirty = true;
+        for (int id : left)
+            if (id) tabs.removeGroup(id);
+        if (scoped) {
+            dropIfEmpty(windowId);
+            if (!tabs.get(currentTab) && !tabs.empty()) setCurrent(fallbackTab(windowId));
+        } else {
+            for (int id : vector<int>(tabs.windowIds())) dropIfEmpty(id);
+            setCurrent(tabs.at(0));
+        }
+        if (tabs.empty()) applyTabOpen(nextTabId);
+    }
+
+    // Callers hold tabsLock exclusively with the visit queue flushed, or are
+    // replaying. History is in visit order, so the expired visits are the
+    // prefix up to the first one at or after `before` (an older straggler
+    // after it stays) and only that prefix is walked. Visit counts and
+    // frecency keep expired visits, so they are loaded first if they would
+    // otherwise miss some; the search index is rebuilt from what is left on
+    // the next search.
+    size_t applyExpire(time_t before) {
+        size_t end = history.start();
+        while (end < history.size() && history[end].timestamp < before) end++;
+        if (end > countedVisits) loadCounts();
+        lock_guard<mutex> guard(searchLock);
+        size_t dropped = end - history.start();
+        history.expire(end);
+        if (timeIndexed) timeIndex.expire(end);
+        if (dropped) searchIndexed = false;
+        return dropped;
+    }
 
-        while (i < L.size()) arr[k++] = L[i++];
-        while (j < R.size()) arr[k++] = R[j++];
+    // Callers hold searchLock.
+    void indexTimes() {
+        if (timeIndexed) return;
+        timeIndex.build(history);
+        timeIndexed = true;
     }
 
-    void mergeSort(vector<Page>& arr, int left, int right) {
-        if (left < right) {
-            int mid = (left + right) / 2;
-            mergeSort(arr, left, mid);
-            mergeSort(arr, mid + 1, right);
-            merge(arr, left, mid, right);
+    void replay(const JournalEntry& e) {
+        TabHandle handle = tabs.find(e.tabId);
+        Tab* tab = tabs.get(handle);
+        Page page;
+        if (e.op == J_VISIT || e.op == J_BOOKMARK) {
+            page = Page(e.text, e.extra);
+            page.timestamp = e.timestamp;
         }
+        switch (e.op) {
+            case J_VISIT: if (tab) applyVisit(tab, page); break;
+            case J_BACK: if (tab && wake(tab).back()) tabChanged(tab); break;
+            case J_FORWARD: if (tab && wake(tab).forward()) tabChanged(tab); break;
+            case J_BOOKMARK: applyBookmark(page); break;
+            case J_TAB_OPEN: applyTabOpen(e.tabId, e.value); break;
+            case J_TAB_CLOSE: if (tab && tabs.size() > 1) applyTabClose(handle); break;
+            case J_TAB_SWITCH: if (tab) setCurrent(handle); break;
+            case J_SNAPSHOT: captureSessionSnapshot(e.text, e.value != 0, e.timestamp); break;
+            case J_SCOPED_SNAPSHOT: captureScopedSnapshot(e.text, e.tabId, e.value, e.timestamp); break;
+            case J_RESTORE:
+                loadSessions();
+                if (e.value >= 0 && (size_t)e.value < sessionHistory.size()) applyRestore(e.value);
+                break;
+            case J_EXPIRE: applyExpire(e.timestamp); break;
+            case J_WINDOW_CLOSE: applyWindowClose(e.value); break;
+            case J_GROUP_CREATE: applyGroupCreate(e.value, e.tabId, e.text); break;
+            case J_GROUP_SET: if (tab) applyGroupSet(handle, e.value); break;
+            case J_GROUP_CLOSE: applyGroupClose(e.value); break;
+            case J_GROUP_MOVE: applyGroupMove(e.value, e.tabId); break;
+        }
+    }
+
+    // Callers hold tabsLock exclusively, which the pool's tasks rely on too;
+    // with it held and the visit queue flushed nothing else changes state.
+    // Whatever is not loaded yet loads in parallel, then every section is
+    // serialized in parallel into its own writer and state.bin is written once.
+    // Returns false, leaving the old state.bin in place, if it could not be written.
+    bool saveState() {
+        ioPool().run({[this] { loadCounts(); },
+                      [this] { loadSessions(); },
+                      [this] {
+                          lock_guard<mutex> guard(bookmarksLock);
+                          loadBookmarks();
+                      }});
+        StateWriter parts[6];
+        ioPool().run({[&] { FileManager::saveHistory(parts[0], history); },
+                      [&] {
+                          lock_guard<mutex> guard(bookmarksLock);
+                          FileManager::saveBookmarks(parts[1], bookmarks, bookmarkIndex);
+                      },
+                      [&] { FileManager::saveVisitCount(parts[2], visitCount); },
+                      [&] { FileManager::saveFrecency(parts[3], frecency); },
+                      [&] { FileManager::saveTabs(parts[4], tabs, tabs.positionOf(currentTab), nextTabId); },
+                      [&] { FileManager::saveSessionHistory(parts[5], sessionHistory); }});
+        StateWriter writer;
+        for (auto& part : parts) writer.append(move(part));
+        FileManager::saveSessionMeta(writer, lastSnapshotTime, lastSnapshotAutomatic);
+        FileManager::saveWorkspaceMeta(writer, nextWindowId, nextGroupId);
+        FileManager::saveJournalPosition(writer, journal.sequence());
+        if (FileManager::commitState(writer)) return true;
+        cerr << "Failed to write " << FileManager::STATE_PATH << "\n";
+        return false;
     }
 
-    int binarySearch(vector<Page>& arr, string key) {
-        int left = 0, right = arr.size() - 1;
-        while (left <= right) {
-            int mid = (left + right) / 2;
-            if (arr[mid].title == key)
-                return mid;
-            else if (arr[mid].title < key)
-                left = mid + 1;
-            else
-                right = mid - 1;
+    // Snapshots are persistent: unchanged tabs reuse their frozen TabRecord and
+    // an unchanged session reuses the whole tab list, so only modified tabs are
+    // copied. Automatic snapshots taken within SNAPSHOT_INTERVAL of the previous
+    // automatic one replace it instead of growing the history. That decision
+    // depends only on lastSnapshotTime and lastSnapshotAutomatic, which are
+    // saved in state.bin, and never on whether the stored snapshots happen to
+    // be loaded yet, so replaying the journal rebuilds the same list.
+    // Callers hold tabsLock exclusively.
+    void captureSessionSnapshot(const string& desc, bool automatic = true, time_t when = time(nullptr)) {
+        if (tabsDirty.exchange(false) || !sessionTabs) {
+            auto list = make_shared<TabList>();
+            list->reserve(tabs.size());
+            for (auto tab : tabs) list->push_back(tab->freeze());
+            sessionTabs = list;
         }
-        return -1;
+
+        SessionSnapshot snapshot(desc);
+        snapshot.timestamp = when;
+        snapshot.tabs = sessionTabs;
+        bool replaces = automatic && lastSnapshotAutomatic && snapshot.timestamp - lastSnapshotTime < SNAPSHOT_INTERVAL;
+        if (replaces) loadSessions();
+        if (replaces && !sessionHistory.empty())
+            sessionHistory.back() = snapshot;
+        else
+            sessionHistory.push_back(snapshot);
+        while (sessionHistory.size() > MAX_SNAPSHOTS) sessionHistory.pop_front();
+
+        if (automatic) lastSnapshotTime = snapshot.timestamp;
+        lastSnapshotAutomatic = automatic;
+        if (replaying) return;
+        record(JournalEntry(J_SNAPSHOT, 0, when, automatic, desc));
+        out << "Captured snapshot: " << snapshot.tabs->size() << " tabs.\n";
+    }
+
+    // Freezes only the window's or group's tabs. It is never replaced by an
+    // automatic snapshot. Callers hold tabsLock exclusively.
+    void captureScopedSnapshot(const string& desc, int windowId, int groupId, time_t when = time(nullptr)) {
+        auto list = make_shared<TabList>();
+        for (Tab* tab : groupId ? tabs.groupTabs(groupId) : tabs.windowTabs(windowId)) list->push_back(tab->freeze());
+        SessionSnapshot snapshot(desc);
+        snapshot.timestamp = when;
+        snapshot.tabs = list;
+        snapshot.windowId = windowId;
+        snapshot.groupId = groupId;
+        sessionHistory.push_back(snapshot);
+        while (sessionHistory.size() > MAX_SNAPSHOTS) sessionHistory.pop_front();
+        lastSnapshotAutomatic = false;
+        if (replaying) return;
+        record(JournalEntry(J_SCOPED_SNAPSHOT, windowId, when, groupId, desc));
+        out << "Captured snapshot: " << list->size() << " tabs.\n";
     }
 
 public:
     // ------------------ Constructor & Destructor ------------------
-    Browser() : currentTabIndex(-1), nextTabId(1), historyHead(nullptr) {
-        historyHead = FileManager::loadHistory();
-        FileManager::loadBookmarks(bookmarks);
-        FileManager::loadVisitCount(visitCount);
-        FileManager::loadTabs(tabs, currentTabIndex, nextTabId);
-        FileManager::loadSessionHistory(sessionHistory);
+    // State is the last compacted state.bin plus every journal entry after it.
+    // Each tab keeps its last `tabDepth` pages.
+    explicit Browser(bool quiet = false, size_t tabDepth = NavigationRing::DEFAULT_DEPTH)
+        : out(quiet ? nullptr : cout.rdbuf()), tabs(tabDepth), nextTabId(1) {
+        INSTRUMENT("Browser::Browser");
+        auto start = chrono::steady_clock::now();
+        bool imported = !FileManager::openState();
+        FileManager::loadHistory(history);
+        countedVisits = history.size();
+        int currentIndex = -1;
+        FileManager::loadTabs(tabs, currentIndex, nextTabId);
+        setCurrent(tabs.at(currentIndex < 0 || currentIndex >= (int)tabs.size() ? 0 : currentIndex));
+        for (int id : tabs.windowIds()) nextWindowId = max(nextWindowId, id + 1);
+        for (auto& g : tabs.allGroups()) nextGroupId = max(nextGroupId, g.first + 1);
+        FileManager::loadWorkspaceMeta(nextWindowId, nextGroupId);
+        FileManager::loadSessionMeta(lastSnapshotTime, lastSnapshotAutomatic);
+        replaying = true;
+        journal.open(FileManager::JOURNAL_PATH, FileManager::loadJournalPosition(),
+                     [this](const JournalEntry& e) { replay(e); });
+        replaying = false;
+        visits.start([this](const Page* pages, size_t n) { absorb(pages, n); });
         if (tabs.empty()) createNewTab();
+        // One-shot conversion of the legacy text files, or of URLs stored in an older canonical form
+        if (imported || FileManager::migratedUrls()) compact();
+        startupSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
     }
 
     ~Browser() {
+        INSTRUMENT("Browser::~Browser");
         captureSessionSnapshot("Auto-saved on exit");
-        FileManager::saveHistory(historyHead);
-        FileManager::saveBookmarks(bookmarks);
-        FileManager::saveVisitCount(visitCount);
-        FileManager::saveTabs(tabs, currentTabIndex, nextTabId);
-        FileManager::saveSessionHistory(sessionHistory);
-        for (auto tab : tabs) delete tab;
+        journal.sync();
+        visits.stop();
+        if (Instrumentation::ENABLED) Instrumentation::report(cerr, sizes());
+    }
+
+    // Folds the journal into a fresh state.bin and empties it. With tabsLock
+    // held no visit can be queued, so after the flush the state is complete.
+    // If state.bin cannot be written the journal is kept, and still holds
+    // every change since the last good one.
+    bool compact() {
+        INSTRUMENT("Browser::compact");
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        visits.flush();
+        if (!saveState()) return false;
+        journal.reset();
+        return true;
+    }
+
+    // Silences (or restores) everything the browser prints; errors still go to cerr.
+    void setQuiet(bool quiet) { out.rdbuf(quiet ? nullptr : cout.rdbuf()); }
+
+    // Time the constructor took, i.e. until the first command can run.
+    double startupTime() const { return startupSeconds; }
+
+    // Waits until every visit made so far shows in history, counts and search.
+    void flush() {
+        INSTRUMENT("Browser::flush");
+        visits.flush();
+    }
+
+    // Structure sizes for the instrumentation report; per-operation numbers
+    // come from Instrumentation::stats(). Nothing is loaded for it, so a
+    // subsystem still on disk only counts what changed since startup.
+    vector<pair<string, size_t>> sizes() {
+        HibernationStats sleep = hibernationStats();
+        shared_lock<shared_mutex> shared(tabsLock);
+        size_t back = 0, forward = 0, deepest = 0, stubs = 0;
+        for (auto tab : tabs) {
+            lock_guard<mutex> guard(tab->lock);
+            stubs += tab->stub();
+            size_t behind = tab->backSize(), ahead = tab->forwardSize();
+            back += behind;
+            forward += ahead;
+            deepest = max(deepest, max(behind, ahead));
+        }
+        size_t bookmarkCount;
+        {
+            lock_guard<mutex> guard(bookmarksLock);
+            bookmarkCount = bookmarks.size();
+        }
+        return {{"history length", history.size() - history.start()},
+                {"tabs", tabs.size()},
+                {"windows", tabs.windowIds().size()},
+                {"tab groups", tabs.allGroups().size()},
+                {"stub tabs", stubs},
+                {"hibernated tabs", sleep.hibernatedTabs},
+                {"hibernated bytes saved", sleep.bytesSaved},
+                {"spilled bytes", sleep.spilledBytes},
+                {"spill file bytes", sleep.spillFileBytes},
+                {"back stack entries", back},
+                {"forward stack entries", forward},
+                {"deepest stack", deepest},
+                {"snapshots", sessionHistory.size()},
+                {"bookmarks", bookmarkCount},
+                {"tracked urls", visitCount.size()},
+                {"queued visits", visits.pending()},
+                {"journal bytes", journal.size()}};
+    }
+
+    // ------------------ Tabs by id (thread-safe, silent) ------------------
+    // Operations on different tabs run in parallel; each returns false (or an
+    // empty page) when the tab is gone.
+    int openTab() {
+        INSTRUMENT("Browser::openTab");
+        int id;
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            id = nextTabId;
+            applyTabOpen(id);
+            record(JournalEntry(J_TAB_OPEN, id));
+        }
+        maybeCompact();
+        return id;
+    }
+
+    // The last tab cannot be closed.
+    bool closeTab(int tabId) {
+        INSTRUMENT("Browser::closeTab");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            TabHandle handle = tabs.find(tabId);
+            if (!tabs.get(handle) || tabs.size() == 1) return false;
+            applyTabClose(handle);
+            record(JournalEntry(J_TAB_CLOSE, tabId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    bool visitPage(int tabId, string_view url, string_view title) {
+        INSTRUMENT("Browser::visitPage(tab)");
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            Tab* tab = findTab(tabId);
+            if (!tab) return false;
+            Page page(url, title);
+            lock_guard<mutex> guard(tab->lock);
+            applyVisit(tab, page);
+            record(JournalEntry(J_VISIT, tabId, page.timestamp, 0, page.url(), title));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    bool goBack(int tabId) {
+        INSTRUMENT("Browser::goBack(tab)");
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            Tab* tab = findTab(tabId);
+            if (!tab) return false;
+            lock_guard<mutex> guard(tab->lock);
+            if (!wake(tab).back()) return false;
+            tabChanged(tab);
+            record(JournalEntry(J_BACK, tabId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    bool goForward(int tabId) {
+        INSTRUMENT("Browser::goForward(tab)");
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            Tab* tab = findTab(tabId);
+            if (!tab) return false;
+            lock_guard<mutex> guard(tab->lock);
+            if (!wake(tab).forward()) return false;
+            tabChanged(tab);
+            record(JournalEntry(J_FORWARD, tabId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // Bookmarks the tab's current page.
+    bool addBookmark(int tabId) {
+        INSTRUMENT("Browser::addBookmark(tab)");
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            Tab* tab = findTab(tabId);
+            if (!tab) return false;
+            lock_guard<mutex> guard(tab->lock);
+            const Page& page = tab->current();
+            if (page.empty()) return false;
+            applyBookmark(page);
+            record(JournalEntry(J_BOOKMARK, tabId, page.timestamp, 0, page.url(), page.title()));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    Page currentPage(int tabId) const {
+        INSTRUMENT("Browser::currentPage(tab)");
+        shared_lock<shared_mutex> shared(tabsLock);
+        Tab* tab = findTab(tabId);
+        if (!tab) return Page();
+        lock_guard<mutex> guard(tab->lock);
+        return tab->current();
+    }
+
+    vector<int> tabIds() const {
+        INSTRUMENT("Browser::tabIds");
+        shared_lock<shared_mutex> shared(tabsLock);
+        vector<int> ids;
+        for (auto tab : tabs) ids.push_back(tab->id);
+        return ids;
+    }
+
+    // The tab the menu's operations apply to.
+    int selectedTab() const { return currentTabId(); }
+
+    // Makes the tab current for the menu's operations.
+    bool selectTab(int tabId) {
+        INSTRUMENT("Browser::selectTab");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            TabHandle handle = tabs.find(tabId);
+            if (!tabs.get(handle)) return false;
+            setCurrent(handle);
+            wake(tabs.get(handle));
+            record(JournalEntry(J_TAB_SWITCH, tabId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // ------------------ Windows & groups (thread-safe, silent) ------------------
+    // Each window and group keeps its own active tab, the current one being
+    // the active tab of the current window. Closing or moving a group or
+    // window walks only its own tabs.
+
+    // Opens a window with one new tab and switches to it; returns the window's id.
+    int openWindow() {
+        INSTRUMENT("Browser::openWindow");
+        int windowId;
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            windowId = nextWindowId;
+            int id = nextTabId;
+            applyTabOpen(id, windowId);
+            record(JournalEntry(J_TAB_OPEN, id, 0, windowId));
+        }
+        maybeCompact();
+        return windowId;
+    }
+
+    // Closes the window and its tabs. The last window cannot be closed.
+    bool closeWindow(int windowId) {
+        INSTRUMENT("Browser::closeWindow");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            if (!applyWindowClose(windowId)) return false;
+            record(JournalEntry(J_WINDOW_CLOSE, 0, 0, windowId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // Makes the window's active tab current.
+    bool selectWindow(int windowId) {
+        INSTRUMENT("Browser::selectWindow");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            Window* w = tabs.window(windowId);
+            if (!w || !w->tabs.size) return false;
+            setCurrent(w->active);
+            wake(tabs.get(w->active));
+            record(JournalEntry(J_TAB_SWITCH, tabs.get(w->active)->id));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    vector<int> windowIds() const {
+        INSTRUMENT("Browser::windowIds");
+        shared_lock<shared_mutex> shared(tabsLock);
+        return tabs.windowIds();
+    }
+
+    // In tab order; empty for an unknown window or group.
+    vector<int> windowTabIds(int windowId) const {
+        INSTRUMENT("Browser::windowTabIds");
+        shared_lock<shared_mutex> shared(tabsLock);
+        vector<int> ids;
+        for (Tab* tab : tabs.windowTabs(windowId)) ids.push_back(tab->id);
+        return ids;
+    }
+
+    vector<int> groupTabIds(int groupId) const {
+        INSTRUMENT("Browser::groupTabIds");
+        shared_lock<shared_mutex> shared(tabsLock);
+        vector<int> ids;
+        for (Tab* tab : tabs.groupTabs(groupId)) ids.push_back(tab->id);
+        return ids;
+    }
+
+    // Starts a group in the tab's window holding that tab; returns the
+    // group's id, or 0 if the tab is gone.
+    int createGroup(int tabId, const string& name) {
+        INSTRUMENT("Browser::createGroup");
+        int groupId;
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            TabHandle handle = tabs.find(tabId);
+            Tab* tab = tabs.get(handle);
+            if (!tab) return 0;
+            groupId = nextGroupId;
+            applyGroupCreate(groupId, tab->windowId, name);
+            record(JournalEntry(J_GROUP_CREATE, tab->windowId, 0, groupId, name));
+            applyGroupSet(handle, groupId);
+            record(JournalEntry(J_GROUP_SET, tabId, 0, groupId));
+        }
+        maybeCompact();
+        return groupId;
+    }
+
+    // Adds the tab to the end of a group, moving it to the group's window;
+    // 0 takes it out of its group.
+    bool setTabGroup(int tabId, int groupId) {
+        INSTRUMENT("Browser::setTabGroup");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            TabHandle handle = tabs.find(tabId);
+            if (!tabs.get(handle) || !applyGroupSet(handle, groupId)) return false;
+            record(JournalEntry(J_GROUP_SET, tabId, 0, groupId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // Closes the group and its tabs, unless they are all the tabs there are.
+    bool closeGroup(int groupId) {
+        INSTRUMENT("Browser::closeGroup");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            if (!applyGroupClose(groupId)) return false;
+            record(JournalEntry(J_GROUP_CLOSE, 0, 0, groupId));
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // Moves the group's tabs to the end of a window, or of a new one for 0;
+    // returns the window's id, or 0 if the group is gone or already there.
+    int moveGroup(int groupId, int windowId) {
+        INSTRUMENT("Browser::moveGroup");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            if (!windowId) windowId = nextWindowId;
+            if (!applyGroupMove(groupId, windowId)) return 0;
+            record(JournalEntry(J_GROUP_MOVE, windowId, 0, groupId));
+        }
+        maybeCompact();
+        return windowId;
+    }
+
+    // ------------------ Hibernation (thread-safe) ------------------
+    // Tabs unused for `idle` seconds, and the least recently used beyond
+    // `residentBudget` bytes of navigation rings, hibernate: their pages are
+    // packed with the state file's page codec and the ring is freed. Packed
+    // pages beyond `packedBudget` bytes go to a temporary spill file. A
+    // hibernated tab thaws when it is navigated or switched to; listing it
+    // or snapshotting it does not. Checked at most once a second.
+    void setHibernation(time_t idle, size_t residentBytes, size_t packedBytes) {
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        idleSeconds = idle;
+        residentBudget = residentBytes;
+        packedBudget = packedBytes;
+    }
+
+    // Hibernates now every tab unused for `idle` seconds (0 for every tab),
+    // and any beyond the budget; returns how many.
+    size_t hibernateTabs(time_t idle) {
+        INSTRUMENT("Browser::hibernateTabs");
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        return hibernateIdle(idle);
+    }
+
+    HibernationStats hibernationStats() const {
+        HibernationStats stats;
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            size_t freed = 0, held = 0;     // in memory; spilled pages are on disk and cost none
+            for (Tab* tab : tabs) {
+                lock_guard<mutex> guard(tab->lock);
+                if (!tab->hibernated()) {
+                    stats.residentTabs++;
+                    continue;
+                }
+                stats.hibernatedTabs++;
+                freed += tab->nav.capacity() * sizeof(Page);
+                if (!tab->packed) continue;
+                held += sizeof(PackedNav);
+                if (tab->packed->spill) {
+                    stats.spilledBytes += tab->packed->size;
+                    continue;
+                }
+                stats.packedBytes += tab->packed->bytes.size();
+                held += tab->packed->bytes.capacity();
+            }
+            stats.bytesSaved = freed - min(freed, held);
+        }
+        stats.spillFileBytes = spill.fileBytes();
+        stats.thaws = thaws;
+        if (stats.thaws) stats.meanThawMicros = thawNanos / 1000.0 / stats.thaws;
+        stats.maxThawMicros = maxThawNanos / 1000.0;
+        return stats;
     }
 
     // ------------------ Core Browser Features ------------------
+    // The menu operates on the current tab, through the tab-id API.
     void createNewTab() {
-        tabs.push_back(new Tab(nextTabId++));
-        currentTabIndex = tabs.size() - 1;
-        cout << "\n New tab created (Tab #" << tabs.back()->id << ")\n";
-        captureSessionSnapshot("New tab created");
+        INSTRUMENT("Browser::createNewTab");
+        int id = openTab();
+        out << "\n New tab created (Tab #" << id << ")\n";
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            captureSessionSnapshot("New tab created");
+        }
+        maybeCompact();
     }
 
     void switchTab(int index) {
-        if (index < 0 || index >= tabs.size()) {
-            cout << "\n Invalid tab index!\n";
-            return;
+        INSTRUMENT("Browser::switchTab");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            Tab* tab = index >= 0 ? tabs.get(tabs.at(index)) : nullptr;
+            if (!tab) {
+                out << "\n Invalid tab index!\n";
+                return;
+            }
+            setCurrent(tabs.at(index));
+            record(JournalEntry(J_TAB_SWITCH, tab->id));
+            out << "\n Switched to Tab #" << tab->id;
+            const Page& page = wake(tab).current();
+            if (!page.empty()) out << " - " << page.title();
+            out << "\n";
         }
-        currentTabIndex = index;
-        cout << "\n Switched to Tab #" << tabs[index]->id;
-        if (!tabs[index]->currentPage.url.empty())
-            cout << " - " << tabs[index]->currentPage.title;
-        cout << "\n";
+        maybeCompact();
     }
 
     void closeCurrentTab() {
-        if (tabs.size() == 1) {
-            cout << "\n Cannot close the last tab!\n";
+        INSTRUMENT("Browser::closeCurrentTab");
+        int id = currentTabId();
+        if (!closeTab(id)) {
+            out << "\n Cannot close the last tab!\n";
             return;
         }
-        cout << "\n🗙 Closing Tab #" << tabs[currentTabIndex]->id << "\n";
-        delete tabs[currentTabIndex];
-        tabs.erase(tabs.begin() + currentTabIndex);
-        if (currentTabIndex >= tabs.size()) currentTabIndex = tabs.size() - 1;
-        cout << "Now on Tab #" << tabs[currentTabIndex]->id << "\n";
-        captureSessionSnapshot("Tab closed");
+        out << "\n🗙 Closing Tab #" << id << "\n";
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            out << "Now on Tab #" << tabs.get(currentTab)->id << "\n";
+            captureSessionSnapshot("Tab closed");
+        }
+        maybeCompact();
+    }
+
+    void newWindow() {
+        INSTRUMENT("Browser::newWindow");
+        int windowId = openWindow();
+        out << "\n New window opened (Window #" << windowId << ", Tab #" << currentTabId() << ")\n";
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            captureSessionSnapshot("New window opened");
+        }
+        maybeCompact();
+    }
+
+    void switchWindow(int windowId) {
+        INSTRUMENT("Browser::switchWindow");
+        if (!selectWindow(windowId)) {
+            out << "\n Invalid window!\n";
+            return;
+        }
+        out << "\n Switched to Window #" << windowId << ", Tab #" << currentTabId() << "\n";
+    }
+
+    // Adds the current tab to the group of that name in its window, starting
+    // one if there is none.
+    void groupCurrentTab(const string& name) {
+        INSTRUMENT("Browser::groupCurrentTab");
+        int id, groupId = 0;
+        {
+            shared_lock<shared_mutex> shared(tabsLock);
+            Tab* tab = tabs.get(currentTab);
+            id = tab->id;
+            for (auto& g : tabs.allGroups())
+                if (g.second.windowId == tab->windowId && g.second.name == name) groupId = g.first;
+        }
+        if (groupId) setTabGroup(id, groupId);
+        else groupId = createGroup(id, name);
+        out << "\n Tab #" << id << " is in group #" << groupId << " (" << name << ")\n";
+    }
+
+    void closeTabGroup(int groupId) {
+        INSTRUMENT("Browser::closeTabGroup");
+        size_t count = groupTabIds(groupId).size();
+        if (!closeGroup(groupId)) {
+            out << "\n Cannot close that group!\n";
+            return;
+        }
+        out << "\n🗙 Closed group #" << groupId << " (" << count << " tabs)\n";
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            out << "Now on Tab #" << tabs.get(currentTab)->id << "\n";
+            captureSessionSnapshot("Group closed");
+        }
+        maybeCompact();
+    }
+
+    // Window 0 is a new one.
+    void moveTabGroup(int groupId, int windowId) {
+        INSTRUMENT("Browser::moveTabGroup");
+        int to = moveGroup(groupId, windowId);
+        if (!to) {
+            out << "\n Cannot move that group there!\n";
+            return;
+        }
+        out << "\n Moved group #" << groupId << " to Window #" << to << "\n";
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            captureSessionSnapshot("Group moved");
+        }
+        maybeCompact();
     }
 
     void viewAllTabs() {
-        cout << "\n========= Open Tabs (" << tabs.size() << ") =========\n";
-        for (int i = 0; i < tabs.size(); i++) {
-            cout << "[" << i << "] Tab #" << tabs[i]->id;
-            if (i == currentTabIndex) cout << " (Current)";
-            if (!tabs[i]->currentPage.url.empty())
-                cout << " - " << tabs[i]->currentPage.title << " (" << tabs[i]->currentPage.url << ")";
-            else cout << " - Empty";
-            cout << "\n";
+        INSTRUMENT("Browser::viewAllTabs");
+        shared_lock<shared_mutex> shared(tabsLock);
+        out << "\n========= Open Tabs (" << tabs.size() << ") =========\n";
+        Tab* current = tabs.get(currentTab);
+        bool windowed = tabs.windowIds().size() > 1;
+        int i = 0, windowId = 0;
+        for (Tab* tab : tabs) {
+            lock_guard<mutex> guard(tab->lock);
+            if (windowed && tab->windowId != windowId) {
+                windowId = tab->windowId;
+                out << "--- Window #" << windowId << (windowId == current->windowId ? " (Current)" : "") << " ---\n";
+            }
+            out << "[" << i++ << "] Tab #" << tab->id;
+            if (tab == current) out << " (Current)";
+            if (tab->groupId) out << " [" << tabs.group(tab->groupId)->name << " #" << tab->groupId << "]";
+            const Page& page = tab->current();
+            if (!page.empty()) out << " - " << page.title() << " (" << page.url() << ")";
+            else out << " - Empty";
+            out << "\n";
         }
-        cout << "====================================\n";
+        out << "====================================\n";
     }
 
     void visitPage(string url, string title) {
-        Tab* tab = tabs[currentTabIndex];
-        if (!tab->currentPage.url.empty()) tab->backStack.push(tab->currentPage);
-        while (!tab->forwardStack.empty()) tab->forwardStack.pop();
-        tab->currentPage = Page(url, title);
-        addToHistory(tab->currentPage);
-        visitCount[url]++;
-        cout << "\n Now visiting: " << title << " (" << url << ") in Tab #" << tab->id << "\n";
+        INSTRUMENT("Browser::visitPage");
+        int id = currentTabId();
+        visitPage(id, url, title);
+        out << "\n Now visiting: " << title << " (" << url << ") in Tab #" << id << "\n";
     }
 
     void goBack() {
-        Tab* tab = tabs[currentTabIndex];
-        if (tab->backStack.empty()) {
-            cout << "\n No previous page!\n";
+        INSTRUMENT("Browser::goBack");
+        int id = currentTabId();
+        if (!goBack(id)) {
+            out << "\n No previous page!\n";
             return;
         }
-        tab->forwardStack.push(tab->currentPage);
-        tab->currentPage = tab->backStack.top();
-        tab->backStack.pop();
-        cout << "\n⬅ Back to: " << tab->currentPage.title << "\n";
+        out << "\n⬅ Back to: " << currentPage(id).title() << "\n";
     }
 
     void goForward() {
-        Tab* tab = tabs[currentTabIndex];
-        if (tab->forwardStack.empty()) {
-            cout << "\n No forward page!\n";
+        INSTRUMENT("Browser::goForward");
+        int id = currentTabId();
+        if (!goForward(id)) {
+            out << "\n No forward page!\n";
             return;
         }
-        tab->backStack.push(tab->currentPage);
-        tab->currentPage = tab->forwardStack.top();
-        tab->forwardStack.pop();
-        cout << "\nForward to: " << tab->currentPage.title << "\n";
+        out << "\nForward to: " << currentPage(id).title() << "\n";
     }
 
-    // ------------------ Bookmarks with Divide & Conquer ------------------
+    // ------------------ Bookmarks (sorted title index) ------------------
     void addBookmark() {
-        Tab* tab = tabs[currentTabIndex];
-        if (tab->currentPage.url.empty()) {
-            cout << "\n No active page to bookmark.\n";
+        INSTRUMENT("Browser::addBookmark");
+        int id = currentTabId();
+        if (!addBookmark(id)) {
+            out << "\n No active page to bookmark.\n";
             return;
         }
-        bookmarks[tab->currentPage.url] = tab->currentPage;
-        cout << "\n Bookmarked: " << tab->currentPage.title << "\n";
+        out << "\n Bookmarked: " << currentPage(id).title() << "\n";
+    }
+
+    // Every bookmark, in title order.
+    vector<Page> bookmarkList() {
+        lock_guard<mutex> guard(bookmarksLock);
+        loadBookmarks();
+        vector<Page> list;
+        for (auto& e : bookmarkIndex) {
+            Page p;
+            p.urlId = e.urlId;
+            p.titleId = e.titleId;
+            list.push_back(p);
+        }
+        return list;
     }
 
     void viewBookmarks() {
-        if (bookmarks.empty()) {
-            cout << "\n No bookmarks.\n";
+        INSTRUMENT("Browser::viewBookmarks");
+        lock_guard<mutex> guard(bookmarksLock);
+        loadBookmarks();
+        if (bookmarkIndex.empty()) {
+            out << "\n No bookmarks.\n";
             return;
         }
-
-        vector<Page> sortedBookmarks;
-        for (auto& b : bookmarks)
-            sortedBookmarks.push_back(b.second);
-
-        mergeSort(sortedBookmarks, 0, sortedBookmarks.size() - 1);
-
-        cout << "\n========= Sorted Bookmarks =========\n";
-        for (auto& p : sortedBookmarks)
-            cout << "- " << p.title << " (" << p.url << ")\n";
-        cout << "====================================\n";
+        out << "\n========= Sorted Bookmarks =========\n";
+        for (auto& e : bookmarkIndex)
+            out << "- " << titlePool().get(e.titleId) << " (" << urlPool().get(e.urlId) << ")\n";
+        out << "====================================\n";
     }
 
+    // Exact title matches (all of them, if titles repeat); otherwise titles starting with the query.
     void searchBookmarks(string title) {
-        if (bookmarks.empty()) {
-            cout << "\n No bookmarks to search.\n";
+        INSTRUMENT("Browser::searchBookmarks");
+        lock_guard<mutex> guard(bookmarksLock);
+        loadBookmarks();
+        if (bookmarkIndex.empty()) {
+            out << "\n No bookmarks to search.\n";
             return;
         }
+        static const int MAX_SUGGESTIONS = 10;
+        BookmarkIndex::Range found = bookmarkIndex.find(title);
 
-        vector<Page> sortedBookmarks;
-        for (auto& b : bookmarks)
-            sortedBookmarks.push_back(b.second);
+        out << "\n========= Bookmark Search =========\n";
+        if (found.first != found.second) {
+            for (auto it = found.first; it != found.second; ++it)
+                out << " Found: " << titlePool().get(it->titleId) << " (" << urlPool().get(it->urlId) << ")\n";
+        } else {
+            found = bookmarkIndex.prefix(title);
+            if (found.first == found.second)
+                out << " Bookmark not found.\n";
+            int shown = 0;
+            for (auto it = found.first; it != found.second && shown < MAX_SUGGESTIONS; ++it, ++shown)
+                out << " Did you mean: " << titlePool().get(it->titleId) << " (" << urlPool().get(it->urlId) << ")\n";
+        }
+        out << "===================================\n";
+    }
 
-        mergeSort(sortedBookmarks, 0, sortedBookmarks.size() - 1);
-        int index = binarySearch(sortedBookmarks, title);
+    // ------------------ Search (history & bookmarks) ------------------
+    // The index is built from the loaded history on first use so startup stays
+    // independent of history size; later visits and bookmarks update it in place.
+    // History is appended under searchLock, so no visit can slip between the
+    // scan of history and searchIndexed being set.
+    void search(const string& query) {
+        INSTRUMENT("Browser::search");
+        static const size_t MAX_RESULTS = 10;
+        flush();
+        lock_guard<mutex> guard(bookmarksLock);
+        loadBookmarks();
+        vector<SearchResult> results;
+        {
+            lock_guard<mutex> indexing(searchLock);
+            if (!searchIndexed) {
+                searchIndex = SearchIndex();
+                searchIndex.build(history);
+                for (auto& b : bookmarks) searchIndex.addBookmark(b.second);
+                searchIndexed = true;
+            }
+            results = searchIndex.search(query, MAX_RESULTS);
+        }
 
-        cout << "\n========= Bookmark Search =========\n";
-        if (index != -1)
-            cout << " Found: " << sortedBookmarks[index].title << " (" << sortedBookmarks[index].url << ")\n";
-        else
-            cout << " Bookmark not found.\n";
-        cout << "===================================\n";
+        out << "\n========= Search Results =========\n";
+        if (results.empty()) out << " No matches.\n";
+        for (auto& r : results) {
+            out << "- " << titlePool().get(r.titleId) << " (" << urlPool().get(r.urlId) << ")";
+            if (bookmarks.count(r.urlId)) out << " [bookmarked]";
+            out << "\n";
+        }
+        out << "==================================\n";
     }
 
     // ------------------ Other Features ------------------
     void viewHistory() {
-        if (!historyHead) {
-            cout << "\n No browsing history.\n";
+        INSTRUMENT("Browser::viewHistory");
+        flush();
+        shared_lock<shared_mutex> shared(tabsLock);    // keeps expireHistory out
+        if (history.empty()) {
+            out << "\n No browsing history.\n";
             return;
         }
-        cout << "\n========= Browsing History =========\n";
-        HistoryNode* temp = historyHead;
-        while (temp) {
-            cout << "- " << temp->page.title << " (" << temp->page.url << ")\n";
-            temp = temp->next;
+        out << "\n========= Browsing History =========\n";
+        for (auto& p : history)
+            out << "- " << p.title() << " (" << p.url() << ")\n";
+        out << "====================================\n";
+    }
+
+    // ------------------ History by time ------------------
+    // A cursor is a history position and a page lists the visits before it,
+    // newest first. Positions never shift, so paging stays stable while visits
+    // are added, and a cursor into expired history simply ends the listing.
+    // Queries with a time range use the time index, built on the first one.
+    static const size_t NEWEST = SIZE_MAX;      // cursor for the first page
+    static constexpr time_t EARLIEST = numeric_limits<time_t>::min(), LATEST = numeric_limits<time_t>::max();
+
+    // Up to `limit` visits in [from, to] made before `cursor`.
+    HistoryPage historyPage(size_t cursor = NEWEST, size_t limit = 50, time_t from = EARLIEST, time_t to = LATEST) {
+        INSTRUMENT("Browser::historyPage");
+        flush();
+        HistoryPage page;
+        lock_guard<mutex> guard(searchLock);
+        pair<size_t, size_t> range = {history.start(), history.size()};
+        if (from != EARLIEST || to != LATEST) {
+            indexTimes();
+            range = timeIndex.range(from, to);
         }
-        cout << "====================================\n";
+        size_t first = max(range.first, history.start()), i = min(cursor, range.second);
+        while (i > first && page.visits.size() < limit) {
+            const Page& p = history[--i];
+            if (p.timestamp >= from && p.timestamp <= to) page.visits.push_back(p);
+        }
+        page.next = i > first ? i : 0;
+        return page;
+    }
+
+    // The last n visits, newest first.
+    vector<Page> recentVisits(size_t n) { return historyPage(NEWEST, n).visits; }
+
+    // Every visit in [from, to], oldest first.
+    vector<Page> visitsBetween(time_t from, time_t to) {
+        INSTRUMENT("Browser::visitsBetween");
+        flush();
+        vector<Page> found;
+        lock_guard<mutex> guard(searchLock);
+        indexTimes();
+        auto range = timeIndex.range(from, to);
+        for (size_t i = max(range.first, history.start()); i < range.second; i++)
+            if (history[i].timestamp >= from && history[i].timestamp <= to) found.push_back(history[i]);
+        return found;
+    }
+
+    // Drops the visits made before `before` and returns how many went.
+    size_t expireHistory(time_t before) {
+        INSTRUMENT("Browser::expireHistory");
+        size_t dropped;
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            visits.flush();
+            dropped = applyExpire(before);
+            if (dropped) record(JournalEntry(J_EXPIRE, 0, before));
+        }
+        maybeCompact();
+        return dropped;
+    }
+
+    void viewRecentHistory(size_t n) {
+        INSTRUMENT("Browser::viewRecentHistory");
+        printVisits("Recent History", recentVisits(n));
+    }
+
+    void viewHistorySince(time_t from) {
+        INSTRUMENT("Browser::viewHistorySince");
+        vector<Page> found = visitsBetween(from, LATEST);
+        reverse(found.begin(), found.end());
+        printVisits("History Since", found);
+    }
+
+    void clearHistoryBefore(time_t before) {
+        INSTRUMENT("Browser::clearHistoryBefore");
+        size_t dropped = expireHistory(before);
+        out << "\n Removed " << dropped << " visits from history.\n";
     }
 
     void showMostVisited() {
+        INSTRUMENT("Browser::showMostVisited");
+        flush();
+        loadCounts();
         if (visitCount.empty()) {
-            cout << "\n No visit data.\n";
+            out << "\n No visit data.\n";
             return;
         }
-        vector<pair<string, int>> sorted(visitCount.begin(), visitCount.end());
-        sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.second > b.second; });
-        cout << "\n========= Most Visited Sites =========\n";
-        for (auto& s : sorted)
-            cout << "- " << s.first << " (" << s.second << " visits)\n";
-        cout << "=====================================\n";
+        static const size_t MAX_SHOWN = 10;
+        out << "\n========= Most Visited Sites =========\n";
+        auto top = visitCount.top(MAX_SHOWN);
+        for (size_t i = 0; i < top.size(); i++) {
+            out << "- " << urlPool().get(top[i].urlId) << " (" << top[i].count << " visits";
+            if (top[i].error) out << ", at least " << top[i].count - top[i].error;
+            if (!visitCount.guaranteed(i)) out << ", rank approximate";
+            out << ")\n";
+        }
+        if (visitCount.size() > top.size())
+            out << "  ... and " << visitCount.size() - top.size() << " more sites\n";
+        out << "=====================================\n";
+    }
+
+    // ------------------ Frecency (decayed visits) ------------------
+    void showTopDomains() {
+        INSTRUMENT("Browser::showTopDomains");
+        flush();
+        loadCounts();
+        lock_guard<mutex> guard(frecencyLock);
+        if (frecency.empty()) {
+            out << "\n No visit data.\n";
+            return;
+        }
+        static const size_t MAX_SHOWN = 10, PAGES_EACH = 3;
+        out << "\n========= Top Sites (recent & frequent) =========\n";
+        for (auto& d : frecency.topDomains(MAX_SHOWN)) {
+            string_view domain = frecency.domainName(d.id);
+            out << "- " << domain << " (score " << round(d.score * 10) / 10 << ")\n";
+            for (auto& p : frecency.topPagesIn(domain, PAGES_EACH))
+                out << "    " << urlPool().get(p.id) << "\n";
+        }
+        out << "=================================================\n";
+    }
+
+    void showTopPagesIn(const string& site) {
+        INSTRUMENT("Browser::showTopPagesIn");
+        static const size_t MAX_SHOWN = 10;
+        string_view domain = Frecency::domainOf(site);
+        vector<FrecencyScore> top;
+        flush();
+        loadCounts();
+        {
+            lock_guard<mutex> guard(frecencyLock);
+            top = frecency.topPagesIn(domain, MAX_SHOWN);
+        }
+        if (top.empty()) {
+            out << "\n No visits to " << domain << ".\n";
+            return;
+        }
+        out << "\n========= Top Pages on " << domain << " =========\n";
+        for (auto& p : top) out << "- " << urlPool().get(p.id) << " (score " << round(p.score * 10) / 10 << ")\n";
+        out << "==========================================\n";
     }
+
     void showCurrent() {
-        Tab* tab = tabs[currentTabIndex];
-        cout << "\n===== Current Tab #" << tab->id << " =====\n";
-        if (tab->currentPage.url.empty())
-            cout << "No page currently open.\n";
+        INSTRUMENT("Browser::showCurrent");
+        shared_lock<shared_mutex> shared(tabsLock);
+        Tab* tab = tabs.get(currentTab);
+        lock_guard<mutex> guard(tab->lock);
+        out << "\n===== Current Tab #" << tab->id << " =====\n";
+        const Page& page = tab->current();
+        if (page.empty())
+            out << "No page currently open.\n";
         else
-            cout << "Current Page: " << tab->currentPage.title << " (" << tab->currentPage.url << ")\n";
-        cout << "Back: " << tab->backStack.size() << ", Forward: " << tab->forwardStack.size()
+            out << "Current Page: " << page.title() << " (" << page.url() << ")\n";
+        out << "Back: " << tab->backSize() << ", Forward: " << tab->forwardSize()
              << ", Total tabs: " << tabs.size() << "\n";
     }
 
+    void viewTabMemory() {
+        INSTRUMENT("Browser::viewTabMemory");
+        HibernationStats s = hibernationStats();
+        out << "\n========= Tab Memory =========\n";
+        out << "Resident tabs: " << s.residentTabs << ", hibernated: " << s.hibernatedTabs << "\n";
+        out << "Saved by hibernation: " << s.bytesSaved << " bytes (packed: " << s.packedBytes
+            << " in memory, " << s.spilledBytes << " spilled in a " << s.spillFileBytes << " byte file)\n";
+        out << "Thaws: " << s.thaws << ", mean " << s.meanThawMicros << " us, max " << s.maxThawMicros << " us\n";
+        out << "==============================\n";
+    }
+
+    void hibernateAllTabs() {
+        INSTRUMENT("Browser::hibernateAllTabs");
+        out << "\n Hibernated " << hibernateTabs(0) << " tabs.\n";
+    }
+
     void saveCurrentSession() {
+        INSTRUMENT("Browser::saveCurrentSession");
         string desc;
-        cout << "Enter session description: ";
+        out << "Enter session description: ";
         getline(cin, desc);
-        captureSessionSnapshot(desc);
-        cout << "\n Session snapshot saved!\n";
+        saveSession(desc);
+    }
+
+    void saveSession(const string& desc) {
+        INSTRUMENT("Browser::saveSession");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            captureSessionSnapshot(desc, false);
+        }
+        maybeCompact();
+        out << "\n Session snapshot saved!\n";
+    }
+
+    // Snapshots of one group, or of the current window; restoring one only
+    // replaces that group's or window's tabs. False for an unknown group.
+    bool saveGroupSession(int groupId, const string& desc) {
+        INSTRUMENT("Browser::saveGroupSession");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            TabGroup* g = tabs.group(groupId);
+            if (!g) {
+                out << "\n Invalid group!\n";
+                return false;
+            }
+            captureScopedSnapshot(desc, g->windowId, groupId);
+        }
+        maybeCompact();
+        out << "\n Group snapshot saved!\n";
+        return true;
+    }
+
+    void saveWindowSession(const string& desc) {
+        INSTRUMENT("Browser::saveWindowSession");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            captureScopedSnapshot(desc, currentWindow(), 0);
+        }
+        maybeCompact();
+        out << "\n Window snapshot saved!\n";
     }
 
     void viewSessionHistory() {
+        INSTRUMENT("Browser::viewSessionHistory");
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        loadSessions();
         if (sessionHistory.empty()) {
-            cout << "\n No session snapshots recorded.\n";
+            out << "\n No session snapshots recorded.\n";
             return;
         }
-        cout << "\n========= Session History =========\n";
-        for (int i = 0; i < sessionHistory.size(); i++) {
+        out << "\n========= Session History =========\n";
+        for (size_t i = 0; i < sessionHistory.size(); i++) {
             char timeStr[100];
             strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&sessionHistory[i].timestamp));
-            cout << "[" << i << "] " << timeStr << " - " << sessionHistory[i].description << "\n";
-            cout << "    Tabs (" << sessionHistory[i].tabData.size() << "): ";
-            for (auto& td : sessionHistory[i].tabData)
-                cout << "Tab#" << td.first << "(" << td.second << ") ";
-            cout << "\n";
+            out << "[" << i << "] " << timeStr << " - " << sessionHistory[i].description;
+            if (sessionHistory[i].groupId) out << " (group #" << sessionHistory[i].groupId << ")";
+            else if (sessionHistory[i].windowId) out << " (window #" << sessionHistory[i].windowId << ")";
+            out << "\n";
+            const TabList& tabList = snapshotTabs(i);
+            out << "    Tabs (" << tabList.size() << "): ";
+            for (auto& record : tabList) {
+                out << "Tab#" << record->id << "(";
+                if (record->entries.empty()) out << "[empty]";
+                for (size_t j = 0; j < record->entries.size(); j++)
+                    out << (j ? " -> " : "") << record->entries[j].url();
+                out << ") ";
+            }
+            out << "\n";
         }
-        cout << "===================================\n";
+        out << "===================================\n";
     }
 
-    void restoreSession(int index) {
-        if (index < 0 || index >= sessionHistory.size()) {
-            cout << "\n Invalid snapshot index!\n";
-            return;
-        }
-        for (auto tab : tabs) delete tab;
-        tabs.clear();
-        for (auto& td : sessionHistory[index].tabData) {
-            Tab* newTab = new Tab(td.first);
-            if (td.second != "empty") {
-                if (bookmarks.find(td.second) != bookmarks.end())
-                    newTab->currentPage = bookmarks[td.second];
-                else
-                    newTab->currentPage = Page(td.second, td.second);
+    // Descriptions of the session snapshots, oldest first.
+    vector<string> sessionDescriptions() {
+        INSTRUMENT("Browser::sessionDescriptions");
+        unique_lock<shared_mutex> exclusive(tabsLock);
+        loadSessions();
+        vector<string> descriptions;
+        for (auto& s : sessionHistory) descriptions.push_back(s.description);
+        return descriptions;
+    }
+
+    // False for an index past the snapshots.
+    bool restoreSession(int index) {
+        INSTRUMENT("Browser::restoreSession");
+        {
+            unique_lock<shared_mutex> exclusive(tabsLock);
+            loadSessions();
+            if (index < 0 || (size_t)index >= sessionHistory.size()) {
+                out << "\n Invalid snapshot index!\n";
+                return false;
             }
-            tabs.push_back(newTab);
-            if (td.first >= nextTabId) nextTabId = td.first + 1;
+            bool scoped = sessionHistory[index].windowId || sessionHistory[index].groupId;
+            applyRestore(index);
+            record(JournalEntry(J_RESTORE, 0, 0, index));
+            out << "\n Session restored! " << (scoped ? snapshotTabs(index).size() : tabs.size()) << " tabs reopened.\n";
         }
-        currentTabIndex = 0;
-        cout << "\n Session restored! " << tabs.size() << " tabs reopened.\n";
+        maybeCompact();
+        return true;
     }
 };
 
@@ -0,0 +1,437 @@
+// Google Benchmark suite for Browser operations and every FileManager load/save pair.
+// Each operation runs along three axes (history size, tab count, bookmark
+// count), varying one while the other two stay at their defaults, and a
+// complexity is fitted per axis, so a regression such as history append going
+// from O(1) to O(N) shows up as a different big-O in the results.
+// Build the browser_benchmarks target with CMake; results are written to
+// browser-benchmarks.json unless --benchmark_out is given.
+//
+// All runs share one process and so one set of string pools: loads take the
+// remapping path, not the attach-to-pristine-pool path of a cold start (that
+// one is measured by benchmark.cpp in forked children).
+#include "browser.h"
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+static const char* PROFILE_PATH = "bench-profile.bin";
+static const char* WORK_STATE_PATH = "bench-state.bin";
+static const char* WORK_JOURNAL_PATH = "bench-journal.bin";
+
+// ------------------ Axes ------------------
+enum Axis { BY_HISTORY, BY_TABS, BY_BOOKMARKS, AXES };
+static const char* AXIS_NAMES[AXES] = {"history", "tabs", "bookmarks"};
+static const int64_t AXIS_DEFAULTS[AXES] = {10000, 16, 1000};
+static const vector<int64_t> AXIS_VALUES[AXES] = {
+    {1000, 10000, 100000, 1000000}, {1, 8, 64, 512}, {100, 1000, 10000, 100000}};
+static const size_t PAGES_PER_TAB = 20, SAVED_SESSIONS = 5;
+
+static string pageUrl(size_t i) {
+    return "https://site" + to_string(i % 5000) + ".example.com/page" + to_string(i % 100003);
+}
+
+// ------------------ Synthetic profiles ------------------
+// Browser state of the requested size, kept in memory for the save benchmarks
+// and written once to PROFILE_PATH for the load and Browser benchmarks.
+struct Profile {
+    HistoryLog history;
+    unordered_map<UrlId, Page> bookmarks;
+    BookmarkIndex bookmarkIndex;
+    ShardedVisitCounter visitCount;
+    Frecency frecency;
+    TabTable tabs;
+    deque<SessionSnapshot> sessions;
+
+    Profile(int64_t historySize, int64_t tabCount, int64_t bookmarkCount) {
+        time_t now = time(nullptr);
+        for (int64_t i = 0; i < historySize; i++) {
+            Page p(pageUrl(i), "Page " + to_string(i % 1000));
+            p.timestamp = now - (historySize - i);
+            history.append(p);
+            visitCount.add(p.urlId);
+            frecency.visit(p.urlId, p.timestamp);
+        }
+        for (int64_t j = 0; j < bookmarkCount; j++) {
+            Page p("https://bookmark" + to_string(j) + ".example.org/", "Bookmark " + to_string(j));
+            bookmarks[p.urlId] = p;
+            bookmarkIndex.insert(p);
+        }
+        for (int64_t t = 0; t < tabCount; t++) {
+            Tab* tab = tabs.get(tabs.open(t + 1, 1));
+            for (size_t i = 0; i < PAGES_PER_TAB; i++) tab->nav.visit(Page(pageUrl(t * PAGES_PER_TAB + i), "Tab page"));
+        }
+        auto list = make_shared<TabList>();
+        for (auto tab : tabs) list->push_back(tab->freeze());
+        for (size_t s = 0; s < SAVED_SESSIONS; s++) {
+            SessionSnapshot snapshot("Saved " + to_string(s));
+            snapshot.tabs = list;
+            sessions.push_back(snapshot);
+        }
+    }
+    Profile(const Profile&) = delete;
+    Profile& operator=(const Profile&) = delete;
+
+    void save(StateWriter& writer) {
+        FileManager::saveHistory(writer, history);
+        FileManager::saveBookmarks(writer, bookmarks, bookmarkIndex);
+        FileManager::saveVisitCount(writer, visitCount);
+        FileManager::saveFrecency(writer, frecency);
+        FileManager::saveTabs(writer, tabs, 0, tabs.size() + 1);
+        FileManager::saveSessionHistory(writer, sessions);
+        FileManager::saveJournalPosition(writer, 0);
+    }
+};
+
+// Profiles are built once per size; the file on disk always matches the last one asked for.
+static Profile& profileFor(const benchmark::State& state) {
+    static map<tuple<int64_t, int64_t, int64_t>, unique_ptr<Profile>> built;
+    static tuple<int64_t, int64_t, int64_t> written(-1, -1, -1);
+    auto key = make_tuple(state.range(BY_HISTORY), state.range(BY_TABS), state.range(BY_BOOKMARKS));
+    unique_ptr<Profile>& profile = built[key];
+    if (!profile) profile = make_unique<Profile>(get<0>(key), get<1>(key), get<2>(key));
+    if (written != key) {
+        StateWriter writer;
+        profile->save(writer);
+        FileManager::STATE_PATH = PROFILE_PATH;
+        FileManager::commitState(writer);
+        written = key;
+    }
+    return *profile;
+}
+
+// A fresh copy of the profile, with an empty journal.
+static void copyProfile(const benchmark::State& state) {
+    profileFor(state);
+    remove(WORK_STATE_PATH);        // unlinked, so an older mapping of it stays intact
+    remove(WORK_JOURNAL_PATH);
+    {
+        ifstream in(PROFILE_PATH, ios::binary);
+        ofstream out(WORK_STATE_PATH, ios::binary);
+        out << in.rdbuf();
+    }
+    FileManager::STATE_PATH = WORK_STATE_PATH;
+    FileManager::JOURNAL_PATH = WORK_JOURNAL_PATH;
+}
+
+// A quiet Browser on a fresh copy of the profile.
+static unique_ptr<Browser> openBrowser(const benchmark::State& state) {
+    copyProfile(state);
+    return make_unique<Browser>(true);
+}
+
+static void openProfileState(const benchmark::State& state) {
+    profileFor(state);
+    FileManager::STATE_PATH = PROFILE_PATH;
+    FileManager::openState();
+}
+
+// ------------------ Browser operations ------------------
+// Time to first command. Bookmarks, counts and sessions load on first use,
+// so it should not grow with bookmarks; with this process's pools already
+// populated, opening the file remaps every string and still grows with
+// history (the cold start is in benchmark.cpp).
+static void BM_Startup(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        copyProfile(state);
+        state.ResumeTiming();
+        Browser* browser = new Browser(true);
+        state.PauseTiming();
+        delete browser;
+        state.ResumeTiming();
+    }
+}
+
+// Visits are absorbed by a background thread; flushing every batch keeps that work in the timing.
+static void BM_VisitPage(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    size_t i = 0;
+    vector<string> urls;
+    for (size_t u = 0; u < 4096; u++) urls.push_back(pageUrl(u * 7919));
+    for (auto _ : state) {
+        browser->visitPage(urls[i % urls.size()], "Visited");
+        if (++i % VisitQueue::BATCH == 0) browser->flush();
+    }
+    browser->flush();
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_BackForward(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) {
+        browser->goBack();
+        browser->goForward();
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+static void BM_NewAndCloseTab(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) {
+        browser->createNewTab();
+        browser->closeCurrentTab();
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// A snapshot after one tab changed: the tab list is rebuilt, the other tabs' records reused.
+static void BM_VisitAndSnapshot(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) {
+        browser->visitPage("https://snapshot.example.com/", "Snapshot");
+        browser->saveSession("Benchmark");
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_ViewBookmarks(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) browser->viewBookmarks();
+    state.SetItemsProcessed(state.iterations());
+}
+
+// One exact hit, one prefix fallback.
+static void BM_SearchBookmarks(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) {
+        browser->searchBookmarks("Bookmark 42");
+        browser->searchBookmarks("Bookmark");
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+static void BM_ShowMostVisited(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    for (auto _ : state) browser->showMostVisited();
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The newest 50 of the last hour's visits, then the page after them. The
+// time index is built before timing starts.
+static void BM_HistoryPage(benchmark::State& state) {
+    auto browser = openBrowser(state);
+    time_t hourAgo = time(nullptr) - 3600;
+    browser->historyPage(Browser::NEWEST, 1, hourAgo);
+    for (auto _ : state) {
+        HistoryPage page = browser->historyPage(Browser::NEWEST, 50, hourAgo);
+        benchmark::DoNotOptimize(browser->historyPage(page.next, 50, hourAgo));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// ------------------ FileManager save/load pairs ------------------
+// Saves serialize one section into a StateWriter; loads read it back from the mapped profile.
+static void BM_SaveHistory(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveHistory(writer, profile.history);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadHistory(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) {
+        HistoryLog history;
+        FileManager::loadHistory(history);
+        benchmark::DoNotOptimize(history.size());
+    }
+}
+
+static void BM_SaveBookmarks(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveBookmarks(writer, profile.bookmarks, profile.bookmarkIndex);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadBookmarks(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) {
+        unordered_map<UrlId, Page> bookmarks;
+        BookmarkIndex index;
+        FileManager::loadBookmarks(bookmarks, index);
+        benchmark::DoNotOptimize(bookmarks.size());
+    }
+}
+
+static void BM_SaveVisitCount(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveVisitCount(writer, profile.visitCount);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadVisitCount(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) {
+        ShardedVisitCounter visitCount;
+        FileManager::loadVisitCount(visitCount);
+        benchmark::DoNotOptimize(visitCount.total());
+    }
+}
+
+static void BM_SaveFrecency(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveFrecency(writer, profile.frecency);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadFrecency(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    openProfileState(state);
+    for (auto _ : state) {
+        Frecency frecency;
+        FileManager::loadFrecency(frecency, profile.history, profile.history.size());
+        benchmark::DoNotOptimize(frecency.size());
+    }
+}
+
+static void BM_SaveTabs(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveTabs(writer, profile.tabs, 0, profile.tabs.size() + 1);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadTabs(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) {
+        TabTable tabs;
+        int current = -1, nextId = 1;
+        FileManager::loadTabs(tabs, current, nextId);
+    }
+}
+
+static void BM_SaveSessionHistory(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveSessionHistory(writer, profile.sessions);
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadSessionHistory(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) {
+        deque<SessionSnapshot> sessions;
+        FileManager::loadSessionHistory(sessions);
+        for (auto& snapshot : sessions) FileManager::loadSnapshotTabs(snapshot);
+        benchmark::DoNotOptimize(sessions.size());
+    }
+}
+
+static void BM_SaveJournalPosition(benchmark::State& state) {
+    for (auto _ : state) {
+        StateWriter writer;
+        FileManager::saveJournalPosition(writer, state.iterations());
+        benchmark::DoNotOptimize(writer);
+    }
+}
+
+static void BM_LoadJournalPosition(benchmark::State& state) {
+    openProfileState(state);
+    for (auto _ : state) benchmark::DoNotOptimize(FileManager::loadJournalPosition());
+}
+
+// The whole file: every section plus the string pools, written and renamed into place.
+static void BM_CommitState(benchmark::State& state) {
+    Profile& profile = profileFor(state);
+    FileManager::STATE_PATH = WORK_STATE_PATH;
+    for (auto _ : state) {
+        StateWriter writer;
+        profile.save(writer);
+        FileManager::commitState(writer);
+    }
+}
+
+// Each open maps the file anew and keeps the mapping alive for attached pools,
+// so this one runs a fixed, small number of iterations.
+static void BM_OpenState(benchmark::State& state) {
+    profileFor(state);
+    FileManager::STATE_PATH = PROFILE_PATH;
+    for (auto _ : state) benchmark::DoNotOptimize(FileManager::openState());
+}
+
+// ------------------ Registration ------------------
+static void registerAxes(const string& name, void (*fn)(benchmark::State&), int64_t iterations = 0) {
+    for (int axis = 0; axis < AXES; axis++) {
+        auto* b = benchmark::RegisterBenchmark((name + "/by_" + AXIS_NAMES[axis]).c_str(),
+                                               [fn, axis](benchmark::State& state) {
+                                                   fn(state);
+                                                   state.SetComplexityN(state.range(axis));
+                                               });
+        b->ArgNames({AXIS_NAMES[BY_HISTORY], AXIS_NAMES[BY_TABS], AXIS_NAMES[BY_BOOKMARKS]});
+        for (int64_t value : AXIS_VALUES[axis]) {
+            vector<int64_t> args(AXIS_DEFAULTS, AXIS_DEFAULTS + AXES);
+            args[axis] = value;
+            b->Args(args);
+        }
+        b->Complexity()->Unit(benchmark::kMicrosecond);
+        if (iterations) b->Iterations(iterations);
+        else b->MinTime(0.1);
+    }
+}
+
+int main(int argc, char** argv) {
+    registerAxes("Browser/Startup", BM_Startup, 8);
+    registerAxes("Browser/VisitPage", BM_VisitPage);
+    registerAxes("Browser/BackForward", BM_BackForward);
+    registerAxes("Browser/NewAndCloseTab", BM_NewAndCloseTab);
+    registerAxes("Browser/VisitAndSnapshot", BM_VisitAndSnapshot);
+    registerAxes("Browser/ViewBookmarks", BM_ViewBookmarks);
+    registerAxes("Browser/SearchBookmarks", BM_SearchBookmarks);
+    registerAxes("Browser/ShowMostVisited", BM_ShowMostVisited);
+    registerAxes("Browser/HistoryPage", BM_HistoryPage);
+    registerAxes("FileManager/SaveHistory", BM_SaveHistory);
+    registerAxes("FileManager/LoadHistory", BM_LoadHistory);
+    registerAxes("FileManager/SaveBookmarks", BM_SaveBookmarks);
+    registerAxes("FileManager/LoadBookmarks", BM_LoadBookmarks);
+    registerAxes("FileManager/SaveVisitCount", BM_SaveVisitCount);
+    registerAxes("FileManager/LoadVisitCount", BM_LoadVisitCount);
+    registerAxes("FileManager/SaveFrecency", BM_SaveFrecency);
+    registerAxes("FileManager/LoadFrecency", BM_LoadFrecency);
+    registerAxes("FileManager/SaveTabs", BM_SaveTabs);
+    registerAxes("FileManager/LoadTabs", BM_LoadTabs);
+    registerAxes("FileManager/SaveSessionHistory", BM_SaveSessionHistory);
+    registerAxes("FileManager/LoadSessionHistory", BM_LoadSessionHistory);
+    registerAxes("FileManager/SaveJournalPosition", BM_SaveJournalPosition);
+    registerAxes("FileManager/LoadJournalPosition", BM_LoadJournalPosition);
+    registerAxes("FileManager/CommitState", BM_CommitState);
+    registerAxes("FileManager/OpenState", BM_OpenState, 8);
+
+    // JSON results by default, so runs can be compared for complexity regressions.
+    vector<char*> args(argv, argv + argc);
+    string out = "--benchmark_out=browser-benchmarks.json", format = "--benchmark_out_format=json";
+    bool hasOut = false;
+    for (int i = 1; i < argc; i++) hasOut |= string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+    if (!hasOut) {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+    int count = args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    remove(PROFILE_PATH);
+    remove(WORK_STATE_PATH);
+    remove(WORK_JOURNAL_PATH);
+    return 0;
+}
@@ -0,0 +1,228 @@
+#ifndef CANONICALURL_H
+#define CANONICALURL_H
+
+#include "stringPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CANONICAL_URL_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+using namespace std;
+
+// ------------------ URL canonicalization ------------------
+// Every URL is interned in its canonical form, so "http://A.com:80/",
+// "https://a.com" and "a.com" are one UrlId in history, visit counts and
+// bookmarks:
+//   - surrounding whitespace is trimmed;
+//   - the scheme is lower-cased, and http/https are dropped altogether,
+//     since addresses in this browser are written without one, unless what
+//     is left would read differently without it: https keeps its scheme
+//     when a port remains, and either keeps it when the rest would be taken
+//     for another scheme ("http://mailto:x");
+//   - the host is lower-cased and loses trailing dots, and a port that is
+//     the default for the URL's own scheme is dropped: 80 for http and for
+//     an address without a scheme, 443 for https;
+//   - trailing slashes are stripped from the path;
+//   - empty query parameters are dropped and the rest sorted by name,
+//     keeping the order of repeated names;
+//   - user info, path case and the fragment are left as they are.
+// A scheme without "//" ("about:blank", "mailto:x") keeps everything after
+// the colon verbatim. Canonical URLs map to themselves, which the model
+// check verifies.
+//
+// CANONICAL_URL_FORM goes up whenever these rules change; URLs stored under
+// an older form are canonicalized again when state.bin is opened.
+static const uint32_t CANONICAL_URL_FORM = 3;
+
+#ifdef CANONICAL_URL_SSE2
+inline unsigned lowestBit(unsigned bits) {
+#ifdef _MSC_VER
+    unsigned long first;
+    _BitScanForward(&first, bits);
+    return first;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// Up to 16 bytes at p, zero-padded past `end` so nothing is read beyond it.
+inline __m128i loadBlock(const char* p, const char* end) {
+    if (end - p >= 16) return _mm_loadu_si128((const __m128i*)p);
+    alignas(16) char block[16] = {};
+    memcpy(block, p, end - p);
+    return _mm_load_si128((const __m128i*)block);
+}
+#endif
+
+// First of up to three delimiters in [p, end), or end; SSE2 tests 16 bytes per step.
+inline const char* findDelimiter(const char* p, const char* end, char a, char b = 0, char c = 0) {
+#ifdef CANONICAL_URL_SSE2
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b ? b : a), vc = _mm_set1_epi8(c ? c : a);
+    for (; p < end; p += 16) {
+        __m128i v = loadBlock(p, end);
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_or_si128(_mm_cmpeq_epi8(v, vb), _mm_cmpeq_epi8(v, vc)));
+        unsigned bits = (unsigned)_mm_movemask_epi8(hit);
+        if (bits) return min(p + lowestBit(bits), end);
+    }
+    return end;
+#else
+    for (; p < end; p++)
+        if (*p == a || (b && *p == b) || (c && *p == c)) return p;
+    return end;
+#endif
+}
+
+// Appends [p, end) with ASCII letters lower-cased, 16 bytes per step with SSE2.
+inline void appendLower(string& out, const char* p, const char* end) {
+    size_t at = out.size();
+    out.resize(at + (end - p));
+    char* dst = &out[at];
+#ifdef CANONICAL_URL_SSE2
+    const __m128i beforeA = _mm_set1_epi8('A' - 1), afterZ = _mm_set1_epi8('Z' + 1), toLower = _mm_set1_epi8('a' - 'A');
+    for (; end - p >= 16; p += 16, dst += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, beforeA), _mm_cmplt_epi8(v, afterZ));
+        _mm_storeu_si128((__m128i*)dst, _mm_add_epi8(v, _mm_and_si128(upper, toLower)));
+    }
+#endif
+    for (; p < end; p++, dst++) *dst = *p >= 'A' && *p <= 'Z' ? *p + ('a' - 'A') : *p;
+}
+
+// Writes the canonical form of `url` to `out` and returns its StringPool
+// hash, so interning it does not hash it again.
+inline uint64_t canonicalizeUrl(string_view url, string& out) {
+    auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    const char* p = url.data();
+    const char* end = p + url.size();
+    while (p < end && space(*p)) p++;
+    while (end > p && space(end[-1])) end--;
+    out.clear();
+    out.reserve(end - p);
+
+    // Scheme: a letter, then letters, digits, '+', '-' or '.', then ':'.
+    // Without one, an address is taken to be http. schemeAt returns the
+    // colon, or null; "host:port" is no scheme, and neither is "host:" with
+    // nothing or a path after it.
+    auto letter = [](char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; };
+    auto digit = [](char c) { return c >= '0' && c <= '9'; };
+    auto schemeAt = [&](const char* from, const char* to) -> const char* {
+        const char* s = from;
+        if (s < to && letter(*s))
+            while (s < to && (letter(*s) || digit(*s) || *s == '+' || *s == '-' || *s == '.')) s++;
+        if (s == from || s == to || *s != ':') return nullptr;
+        if (to - s >= 3 && s[1] == '/' && s[2] == '/') return s;
+        const char* digits = s + 1;
+        while (digits < to && digit(*digits)) digits++;
+        return digits != to && *digits != '/' && *digits != '?' && *digits != '#' ? s : nullptr;
+    };
+    string_view port = "80";
+    const char* dropped = nullptr;      // "http://" or "https://" when left out
+    if (const char* s = schemeAt(p, end)) {
+        appendLower(out, p, s);
+        if (end - s < 3 || s[1] != '/' || s[2] != '/') {
+            // An opaque URL.
+            out.append(s, end);
+            return StringPool::hashOf(out);
+        }
+        string_view scheme(out);
+        if (scheme == "http" || scheme == "https") {
+            port = scheme == "https" ? "443" : "80";
+            dropped = scheme == "https" ? "https://" : "http://";
+            out.clear();
+        } else {
+            port = scheme == "ws" ? "80" : scheme == "wss" ? "443" : scheme == "ftp" ? "21" : "";
+            out += "://";
+        }
+        p = s + 3;
+        while (p < end && space(*p)) p++;
+    }
+
+    // Authority: [user info@]host[:port]
+    const char* authorityEnd = findDelimiter(p, end, '/', '?', '#');
+    const char* host = p;
+    for (const char* c = authorityEnd; c > p; c--)
+        if (c[-1] == '@') {
+            host = c;
+            break;
+        }
+    out.append(p, host);
+    auto loose = [&](char c) { return c == '.' || c == ':' || space(c); };
+    const char* hostEnd = authorityEnd;
+    while (hostEnd > host && loose(hostEnd[-1])) hostEnd--;
+    // Default ports come off one after another ("a:80:80" is "a"), so the
+    // host that is left never ends in one; the first other port stays.
+    string_view number;
+    for (;;) {
+        const char* colon = nullptr;
+        for (const char* c = hostEnd; c > host && (digit(c[-1]) || c[-1] == ':'); c--)
+            if (c[-1] == ':') {
+                colon = c - 1;
+                break;
+            }
+        if (!colon) break;
+        string_view found(colon + 1, hostEnd - colon - 1);
+        hostEnd = colon;
+        while (hostEnd > host && loose(hostEnd[-1])) hostEnd--;
+        if (found != port) {
+            number = found;
+            break;
+        }
+    }
+    appendLower(out, host, hostEnd);
+    bool portKept = number.data() != nullptr;
+    if (portKept) {
+        out += ':';
+        out.append(number);
+    }
+
+    // Path, without trailing slashes.
+    const char* pathEnd = findDelimiter(authorityEnd, end, '?', '#');
+    const char* trimmed = pathEnd;
+    while (trimmed > authorityEnd && (trimmed[-1] == '/' || space(trimmed[-1]))) trimmed--;
+    out.append(authorityEnd, trimmed);
+
+    // Query, parameters sorted by name.
+    const char* queryEnd = findDelimiter(pathEnd, end, '#');
+    if (pathEnd < queryEnd) {
+        thread_local vector<string_view> params;
+        params.clear();
+        for (const char* q = pathEnd + 1; q < queryEnd;) {
+            const char* amp = findDelimiter(q, queryEnd, '&');
+            const char* last = amp;
+            while (last > q && space(last[-1])) last--;
+            if (last > q) params.emplace_back(q, last - q);
+            q = amp + 1;
+        }
+        auto name = [](string_view param) { return param.substr(0, param.find('=')); };
+        auto before = [&](string_view a, string_view b) { return name(a) < name(b); };
+        for (size_t i = 1; i < params.size(); i++)       // insertion sort: stable, and queries are short
+            for (size_t j = i; j > 0 && before(params[j], params[j - 1]); j--) swap(params[j], params[j - 1]);
+        for (size_t i = 0; i < params.size(); i++) {
+            out += i ? '&' : '?';
+            out.append(params[i]);
+        }
+    }
+    out.append(queryEnd, end);
+
+    // Without its scheme the address has to read as the same http one.
+    if (dropped && ((portKept && dropped[4] == 's') || schemeAt(out.data(), out.data() + out.size())))
+        out.insert(0, dropped);
+    return StringPool::hashOf(out);
+}
+
+// The id of `url`'s canonical form, interned on first use.
+inline UrlId internUrl(string_view url) {
+    thread_local string canonical;
+    uint64_t h = canonicalizeUrl(url, canonical);
+    return urlPool().intern(canonical, h);
+}
+
+#endif
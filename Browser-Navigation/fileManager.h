@@ -2,139 +2,873 @@
 #define FILEMANAGER_H
 
 #include "structures.h"
+#include "historyLog.h"
+#include "tabTable.h"
+#include "stateFile.h"
+#include "visitCounter.h"
+#include "frecency.h"
+#include "instrumentation.h"
+#include "workerPool.h"
+#include <algorithm>
 #include <unordered_map>
 #include <fstream>
+#include <deque>
+#include <future>
+#include <iostream>
 
+// Browser state lives in one binary file, state.bin (layout in stateFile.h).
+// openState() maps it once; each load* then reads its sections in place.
+// Without a state file the load* functions import the legacy text files
+// instead, and the next save writes state.bin.
+//
+// Only the section directory is checked before startup continues; the section
+// checksums are verified on a background thread, and a file that fails them
+// is kept as state.bin.corrupt instead of being silently replaced. So a body
+// can still be damaged when it is read: the string tables are checked in
+// openState(), and every record whose ids or ranges fall outside them is
+// dropped as it is loaded.
 class FileManager {
+private:
+    static StateFile* state;
+    static future<bool> stateVerified;
+    // Only used when a pool already held strings before openState(); maps file ids to live ids.
+    static vector<StringId> urlRemap, titleRemap;
+    static size_t storedUrls, storedTitles;     // ids the open state file's records may use
+    static bool urlsMerged, urlsMigrated;       // see canonicalizeStoredUrls
+    static const uint32_t KEYFRAME_INTERVAL = 16;
+    static vector<shared_ptr<const TabRecord>> sessionRecords;     // decoded so far, by stored index
+
+    // Every state file mapped and not closed, kept reachable since nothing unmaps them.
+    static vector<StateFile*>& opened() {
+        static vector<StateFile*>& files = *new vector<StateFile*>;
+        return files;
+    }
+
+    static bool checkPool(StateSection text, StateSection index, size_t& count);
+    static void loadPool(StringPool& pool, StateSection text, StateSection index, vector<StringId>& remap);
+    static void canonicalizeStoredUrls();
+    static bool stored(const Page& p) { return p.urlId < storedUrls && p.titleId < storedTitles; }
+    static void savePool(StateWriter& writer, StringPool& pool, StateSection text, StateSection index);
+    static Page livePage(const Page& p);
+    static void addNavRecord(vector<NavRecord>& records, vector<Page>& entries, int id,
+                             size_t cursor, const Page* pages, size_t count);
+    static void rebuildNav(Tab* tab, const NavRecord& record, const Page* entries);
+    static shared_ptr<const TabRecord> sessionRecord(uint32_t index);
+
+    static void importHistory(HistoryLog& history);
+    static void importBookmarks(unordered_map<UrlId, Page>& bookmarks);
+    static void importVisitCount(ShardedVisitCounter& visitCount);
+    static void importTabs(TabTable& tabs, int& currentIndex, int& nextId);
+    static void importSessionHistory(deque<SessionSnapshot>& sessions);
+
 public:
-    static void saveHistory(HistoryNode* head);
-    static HistoryNode* loadHistory();
-    static void saveBookmarks(unordered_map<string, Page>& bookmarks);
-    static void loadBookmarks(unordered_map<string, Page>& bookmarks);
-    static void saveVisitCount(unordered_map<string, int>& visitCount);
-    static void loadVisitCount(unordered_map<string, int>& visitCount);
-    static void saveTabs(vector<Tab*>& tabs, int currentIndex, int nextId);
-    static void loadTabs(vector<Tab*>& tabs, int& currentIndex, int& nextId);
-    static void saveSessionHistory(vector<SessionSnapshot>& sessions);
-    static void loadSessionHistory(vector<SessionSnapshot>& sessions);
+    static const char* STATE_PATH;
+    static const char* JOURNAL_PATH;
+
+    static bool openState();
+    static void closeState();
+    static bool commitState(StateWriter& writer);
+
+    static void saveHistory(StateWriter& writer, HistoryLog& history);
+    static void loadHistory(HistoryLog& history);
+    static void saveBookmarks(StateWriter& writer, unordered_map<UrlId, Page>& bookmarks, BookmarkIndex& index);
+    static void loadBookmarks(unordered_map<UrlId, Page>& bookmarks, BookmarkIndex& index);
+    static void saveVisitCount(StateWriter& writer, ShardedVisitCounter& visitCount);
+    static void loadVisitCount(ShardedVisitCounter& visitCount);
+    static void saveFrecency(StateWriter& writer, Frecency& frecency);
+    static void loadFrecency(Frecency& frecency, HistoryLog& history, size_t visits);
+    static void saveTabs(StateWriter& writer, TabTable& tabs, int currentIndex, int nextId);
+    static void loadTabs(TabTable& tabs, int& currentIndex, int& nextId);
+    static void saveSessionHistory(StateWriter& writer, deque<SessionSnapshot>& sessions);
+    static void loadSessionHistory(deque<SessionSnapshot>& sessions);
+    static void loadSnapshotTabs(SessionSnapshot& snapshot);
+    static void saveSessionMeta(StateWriter& writer, time_t lastSnapshotTime, bool lastAutomatic);
+    static void loadSessionMeta(time_t& lastSnapshotTime, bool& lastAutomatic);
+    static void saveWorkspaceMeta(StateWriter& writer, int nextWindowId, int nextGroupId);
+    static void loadWorkspaceMeta(int& nextWindowId, int& nextGroupId);
+    static void saveJournalPosition(StateWriter& writer, uint64_t sequence);
+    static uint64_t loadJournalPosition();
+    // The open state file's URLs were canonicalized again, so it is due to be rewritten.
+    static bool migratedUrls() { return urlsMigrated; }
 };
 
-void FileManager::saveHistory(HistoryNode* head) {
-    ofstream file("history.txt");
-    while (head) {
-        file << head->page.url << "," << head->page.title << "\n";
-        head = head->next;
+StateFile* FileManager::state = nullptr;
+future<bool> FileManager::stateVerified;
+vector<StringId> FileManager::urlRemap, FileManager::titleRemap;
+size_t FileManager::storedUrls = 0, FileManager::storedTitles = 0;
+bool FileManager::urlsMerged = false, FileManager::urlsMigrated = false;
+vector<shared_ptr<const TabRecord>> FileManager::sessionRecords;
+const char* FileManager::STATE_PATH = "state.bin";
+const char* FileManager::JOURNAL_PATH = "journal.bin";
+
+// ------------------ Binary state file ------------------
+bool FileManager::openState() {
+    INSTRUMENT("FileManager::openState");
+    urlRemap.clear();
+    titleRemap.clear();
+    urlsMerged = urlsMigrated = false;
+    stateVerified = future<bool>();
+    state = StateFile::open(STATE_PATH);
+    if (!state) return false;
+    if (!checkPool(URL_TEXT, URL_INDEX, storedUrls) || !checkPool(TITLE_TEXT, TITLE_INDEX, storedTitles)) {
+        string kept = string(STATE_PATH) + ".corrupt";
+        cerr << "Ignoring corrupt state file " << STATE_PATH << "; keeping it as " << kept << "\n";
+        state->release();
+        delete state;
+        state = nullptr;
+        rename(STATE_PATH, kept.c_str());
+        return false;
     }
+    opened().push_back(state);
+    const StateFile* file = state;
+    stateVerified = async(launch::async, [file] { return file->verifySections(); });
+    loadPool(urlPool(), URL_TEXT, URL_INDEX, urlRemap);
+    loadPool(titlePool(), TITLE_TEXT, TITLE_INDEX, titleRemap);
+    size_t formCount = 0;
+    const uint32_t* form = state->section<uint32_t>(URL_FORM, formCount);
+    if (!formCount || *form != CANONICAL_URL_FORM) canonicalizeStoredUrls();
+    return true;
 }
 
-HistoryNode* FileManager::loadHistory() {
-    ifstream file("history.txt");
-    if (!file) return nullptr;
-    HistoryNode *head = nullptr, *tail = nullptr;
-    string line;
-    while (getline(file, line)) {
-        size_t comma = line.find(',');
-        if (comma != string::npos) {
-            HistoryNode* node = new HistoryNode(Page(line.substr(0, comma), line.substr(comma + 1)));
-            if (!head) head = tail = node;
-            else tail = tail->next = node;
+// URLs written before canonicalization, or under older rules, are mapped to
+// the ids of their canonical form through urlRemap, which every loader
+// already applies. Only a file where some URL changes pays for it; there,
+// two stored URLs can become one, and the loaders merge what they key by
+// URL (urlsMerged).
+void FileManager::canonicalizeStoredUrls() {
+    vector<StringId> remap(storedUrls);
+    vector<bool> taken;
+    bool changed = false;
+    for (size_t id = 0; id < storedUrls; id++) {
+        StringId live = urlRemap.empty() ? id : urlRemap[id];
+        remap[id] = internUrl(urlPool().get(live));
+        changed |= remap[id] != live;
+        if (remap[id] >= taken.size()) taken.resize(max<size_t>(remap[id] + 1, taken.size() * 2));
+        urlsMerged |= taken[remap[id]];
+        taken[remap[id]] = true;
+    }
+    if (!changed) return;
+    urlRemap.swap(remap);
+    urlsMigrated = true;
+}
+
+// Joins the verification thread and unmaps every state file opened so far.
+// Interned strings, history and stub tabs loaded from a file point into its
+// mapping, so this is only for a process that starts over afterwards with
+// nothing loaded and empty pools, such as ModelCheck and the fuzzers.
+void FileManager::closeState() {
+    if (stateVerified.valid()) stateVerified.wait();
+    stateVerified = future<bool>();
+    for (StateFile* file : opened()) {
+        file->release();
+        delete file;
+    }
+    opened().clear();
+    state = nullptr;
+    urlRemap.clear();
+    titleRemap.clear();
+    sessionRecords.clear();
+    storedUrls = storedTitles = 0;
+    urlsMerged = urlsMigrated = false;
+}
+
+// Pools are written last because saving session descriptions interns them;
+// the two are serialized in parallel.
+bool FileManager::commitState(StateWriter& writer) {
+    INSTRUMENT("FileManager::commitState");
+    StateWriter urls, titles;
+    ioPool().run({[&] { savePool(urls, urlPool(), URL_TEXT, URL_INDEX); },
+                  [&] { savePool(titles, titlePool(), TITLE_TEXT, TITLE_INDEX); }});
+    writer.append(move(urls));
+    writer.append(move(titles));
+    vector<uint32_t> form = {CANONICAL_URL_FORM};
+    writer.add(URL_FORM, form);
+    if (stateVerified.valid() && !stateVerified.get()) {
+        string kept = string(STATE_PATH) + ".corrupt";
+        cerr << "State file failed verification; keeping it as " << kept << "\n";
+        rename(STATE_PATH, kept.c_str());
+    }
+    return writer.commit(STATE_PATH);
+}
+
+// Every offset and length stays inside the text, id 0 is the empty string,
+// and the index only holds valid ids and has a free slot to end each probe.
+// Stored hashes are not recomputed: a wrong one costs a duplicate, not memory.
+bool FileManager::checkPool(StateSection text, StateSection index, size_t& count) {
+    size_t textBytes, indexBytes, slotCount;
+    const char* base = state->rawSection(text, textBytes, count);
+    const char* table = state->rawSection(index, indexBytes, slotCount);
+    if (!base || !table || count == 0) {
+        count = 1;      // nothing is attached: only the empty string
+        return true;
+    }
+    if (count > indexBytes / 16 || slotCount > (indexBytes - count * 16) / sizeof(StringId)) return false;
+    const uint64_t* offsets = (const uint64_t*)table;
+    const StringId* slots = (const StringId*)(offsets + 2 * count);
+    for (size_t id = 0; id < count; id++) {
+        uint32_t length;
+        if (textBytes < sizeof(length) || offsets[id] > textBytes - sizeof(length)) return false;
+        memcpy(&length, base + offsets[id], sizeof(length));
+        if (length > textBytes - sizeof(length) - offsets[id] || (id == 0 && length)) return false;
+    }
+    bool free = false;
+    for (size_t i = 0; i < slotCount; i++) {
+        if (slots[i] == StringPool::EMPTY_SLOT) free = true;
+        else if (slots[i] >= count) return false;
+    }
+    return free && (slotCount & (slotCount - 1)) == 0;
+}
+
+void FileManager::loadPool(StringPool& pool, StateSection text, StateSection index, vector<StringId>& remap) {
+    size_t textBytes, count, indexBytes, slotCount;
+    const char* base = state->rawSection(text, textBytes, count);
+    const char* table = state->rawSection(index, indexBytes, slotCount);
+    if (!base || !table || count == 0) return;
+    const uint64_t* offsets = (const uint64_t*)table;
+    const uint64_t* hashes = offsets + count;
+    const StringId* slots = (const StringId*)(hashes + count);
+    if (pool.pristine() && indexBytes >= count * 16 + slotCount * sizeof(StringId)) {
+        pool.attach(base, offsets, hashes, slots, slotCount, count);
+        return;
+    }
+    remap.resize(count);
+    for (size_t id = 0; id < count; id++) {
+        uint32_t length;
+        memcpy(&length, base + offsets[id], sizeof(length));
+        remap[id] = pool.intern(string_view(base + offsets[id] + sizeof(length), length));
+    }
+}
+
+// Sized in a first pass so the text is copied straight into its final buffer.
+void FileManager::savePool(StateWriter& writer, StringPool& pool, StateSection text, StateSection index) {
+    size_t count = pool.size(), textBytes = 0;
+    vector<uint64_t> offsets(count), hashes(count);
+    for (StringId id = 0; id < count; id++) {
+        offsets[id] = textBytes;
+        textBytes += sizeof(uint32_t) + pool.get(id).size();
+    }
+    vector<char> bytes(textBytes);
+    for (StringId id = 0; id < count; id++) {
+        string_view s = pool.get(id);
+        uint32_t length = s.size();
+        hashes[id] = pool.hash(id);
+        memcpy(bytes.data() + offsets[id], &length, sizeof(length));
+        memcpy(bytes.data() + offsets[id] + sizeof(length), s.data(), s.size());
+    }
+    vector<StringId> slots = pool.slotTable();
+    vector<char> table(offsets.size() * 16 + slots.size() * sizeof(StringId));
+    memcpy(table.data(), offsets.data(), offsets.size() * 8);
+    memcpy(table.data() + offsets.size() * 8, hashes.data(), hashes.size() * 8);
+    memcpy(table.data() + offsets.size() * 16, slots.data(), slots.size() * sizeof(StringId));
+    writer.addRaw(text, bytes.data(), bytes.size(), count);
+    writer.addRaw(index, table.data(), table.size(), slots.size());
+}
+
+Page FileManager::livePage(const Page& p) {
+    Page live = p;
+    if (!urlRemap.empty()) live.urlId = urlRemap[p.urlId];
+    if (!titleRemap.empty()) live.titleId = titleRemap[p.titleId];
+    return live;
+}
+
+void FileManager::addNavRecord(vector<NavRecord>& records, vector<Page>& entries, int id,
+                               size_t cursor, const Page* pages, size_t count) {
+    NavRecord record = {id, (uint32_t)cursor, (uint32_t)entries.size(), (uint32_t)count};
+    records.push_back(record);
+    entries.insert(entries.end(), pages, pages + count);
+}
+
+void FileManager::rebuildNav(Tab* tab, const NavRecord& record, const Page* entries) {
+    for (uint32_t i = 0; i < record.entryCount; i++)
+        tab->nav.visit(livePage(entries[record.firstEntry + i]));
+    size_t evicted = record.entryCount - tab->nav.size();
+    tab->nav.setCursor(record.cursor >= evicted ? record.cursor - evicted : 0);
+}
+
+// ------------------ Save / load ------------------
+void FileManager::saveHistory(StateWriter& writer, HistoryLog& history) {
+    INSTRUMENT("FileManager::saveHistory");
+    vector<Page> pages;
+    pages.reserve(history.size() - history.start());
+    for (auto& p : history) pages.push_back(p);
+    writer.add(HISTORY, pages);
+    vector<uint64_t> meta = {history.start()};
+    writer.add(HISTORY_META, meta);
+}
+
+// Positions carry on from where the saved history started, so expired
+// visits stay expired and history cursors survive a restart.
+void FileManager::loadHistory(HistoryLog& history) {
+    INSTRUMENT("FileManager::loadHistory");
+    if (!state) return importHistory(history);
+    size_t count, metaCount = 0;
+    const Page* pages = state->section<Page>(HISTORY, count);
+    const uint64_t* origin = state->section<uint64_t>(HISTORY_META, metaCount);
+    size_t valid = 0;
+    while (valid < count && stored(pages[valid])) valid++;
+    if (valid == count && urlRemap.empty() && titleRemap.empty()) {
+        history.attach(pages, count, metaCount ? *origin : 0);
+        return;
+    }
+    history.attach(nullptr, 0, metaCount ? *origin : 0);
+    for (size_t i = 0; i < count; i++)
+        if (stored(pages[i])) history.append(livePage(pages[i]));
+}
+
+void FileManager::saveBookmarks(StateWriter& writer, unordered_map<UrlId, Page>& bookmarks, BookmarkIndex& index) {
+    INSTRUMENT("FileManager::saveBookmarks");
+    vector<Page> pages;
+    pages.reserve(bookmarks.size());
+    for (auto& b : bookmarks) pages.push_back(b.second);
+    writer.add(BOOKMARKS, pages);
+    writer.add(BOOKMARK_INDEX, index.all());
+}
+
+// The title index is stored already sorted, so loading it is a copy rather than a sort.
+void FileManager::loadBookmarks(unordered_map<UrlId, Page>& bookmarks, BookmarkIndex& index) {
+    INSTRUMENT("FileManager::loadBookmarks");
+    if (state) {
+        size_t count, indexCount;
+        const Page* pages = state->section<Page>(BOOKMARKS, count);
+        const BookmarkEntry* sorted = state->section<BookmarkEntry>(BOOKMARK_INDEX, indexCount);
+        bookmarks.reserve(count);
+        bool intact = indexCount == count && !urlsMerged;
+        for (size_t i = 0; i < count; i++) {
+            if (!stored(pages[i])) {
+                intact = false;
+                continue;
+            }
+            Page p = livePage(pages[i]);
+            bookmarks[p.urlId] = p;
+        }
+        for (size_t i = 0; intact && i < count; i++)
+            intact = sorted[i].urlId < storedUrls && sorted[i].titleId < storedTitles;
+        if (intact) {
+            vector<BookmarkEntry> entries(sorted, sorted + count);
+            for (auto& e : entries) {
+                if (!titleRemap.empty()) e.titleId = titleRemap[e.titleId];
+                if (!urlRemap.empty()) e.urlId = urlRemap[e.urlId];
+            }
+            index.assign(entries, true);
+            return;
         }
+    } else {
+        importBookmarks(bookmarks);
     }
-    return head;
+    vector<BookmarkEntry> entries;
+    entries.reserve(bookmarks.size());
+    for (auto& b : bookmarks) entries.push_back({b.second.titleId, b.second.urlId});
+    index.assign(entries, false);
 }
 
-void FileManager::saveBookmarks(unordered_map<string, Page>& bookmarks) {
-    ofstream file("bookmarks.txt");
-    for (auto& b : bookmarks)
-        file << b.second.url << "," << b.second.title << "\n";
+// Records are written most visited first, so loading them back needs no sort.
+void FileManager::saveVisitCount(StateWriter& writer, ShardedVisitCounter& visitCount) {
+    INSTRUMENT("FileManager::saveVisitCount");
+    vector<VisitRecord> records;
+    vector<uint32_t> errors;
+    vector<VisitEstimate> entries = visitCount.entries();
+    records.reserve(entries.size());
+    for (auto& v : entries) {
+        records.push_back({v.urlId, v.count});
+        errors.push_back(v.error);
+    }
+    writer.add(VISIT_COUNTS, records);
+    if (visitCount.bounded()) {
+        writer.add(VISIT_ERRORS, errors);
+        writer.add(VISIT_SKETCH, visitCount.sketchCells());
+    }
 }
 
-void FileManager::loadBookmarks(unordered_map<string, Page>& bookmarks) {
-    ifstream file("bookmarks.txt");
+void FileManager::loadVisitCount(ShardedVisitCounter& visitCount) {
+    INSTRUMENT("FileManager::loadVisitCount");
+    if (!state) return importVisitCount(visitCount);
+    size_t count, errorCount, cells;
+    const VisitRecord* records = state->section<VisitRecord>(VISIT_COUNTS, count);
+    const uint32_t* errors = state->section<uint32_t>(VISIT_ERRORS, errorCount);
+    vector<VisitEstimate> entries;
+    entries.reserve(count);
+    unordered_map<UrlId, size_t> merged;        // only when stored URLs became one
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].urlId >= storedUrls) continue;
+        VisitEstimate v = {urlRemap.empty() ? records[i].urlId : urlRemap[records[i].urlId], records[i].count,
+                           errorCount == count ? errors[i] : 0};
+        if (urlsMerged) {
+            auto seen = merged.insert({v.urlId, entries.size()});
+            if (!seen.second) {
+                VisitEstimate& into = entries[seen.first->second];
+                into.count = (uint32_t)min<uint64_t>(UINT32_MAX, (uint64_t)into.count + v.count);
+                into.error = (uint32_t)min<uint64_t>(into.count, (uint64_t)into.error + v.error);
+                continue;
+            }
+        }
+        entries.push_back(v);
+    }
+    visitCount.assign(entries);
+    // Sketch cells are keyed by UrlId, so they only carry over when ids are unchanged.
+    const uint32_t* sketch = state->section<uint32_t>(VISIT_SKETCH, cells);
+    if (sketch && urlRemap.empty()) visitCount.assignSketch(sketch, cells);
+}
+
+void FileManager::saveFrecency(StateWriter& writer, Frecency& frecency) {
+    INSTRUMENT("FileManager::saveFrecency");
+    vector<FrecencyRecord> records;
+    for (auto& s : frecency.stored()) records.push_back({s.first, 0, s.second});
+    writer.add(FRECENCY, records);
+}
+
+// State without frecency scores (legacy text files) is scored once from the
+// timestamps of the first `visits` history entries, the ones it was saved with.
+void FileManager::loadFrecency(Frecency& frecency, HistoryLog& history, size_t visits) {
+    INSTRUMENT("FileManager::loadFrecency");
+    size_t count;
+    const FrecencyRecord* records = state ? state->section<FrecencyRecord>(FRECENCY, count) : nullptr;
+    if (!records) {
+        for (size_t i = history.start(); i < visits; i++) frecency.visit(history[i].urlId, history[i].timestamp);
+        return;
+    }
+    vector<pair<UrlId, double>> scores;
+    scores.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        if (records[i].urlId < storedUrls)
+            scores.push_back({urlRemap.empty() ? records[i].urlId : urlRemap[records[i].urlId], records[i].score});
+    frecency.assign(scores);
+}
+
+void FileManager::saveTabs(StateWriter& writer, TabTable& tabs, int currentIndex, int nextId) {
+    INSTRUMENT("FileManager::saveTabs");
+    vector<TabMeta> meta = {{currentIndex, nextId}};
+    vector<NavRecord> records;
+    vector<Page> entries, pages;
+    vector<TabPlace> places;
+    vector<WindowRecord> windows;
+    vector<GroupRecord> groups;
+    vector<int32_t> groupOrder;
+    for (int id : tabs.windowIds()) {
+        Tab* active = tabs.get(tabs.window(id)->active);
+        windows.push_back({id, active ? active->id : 0});
+    }
+    for (auto& g : tabs.allGroups()) {
+        Tab* active = tabs.get(g.second.active);
+        groups.push_back({g.first, g.second.windowId, active ? active->id : 0, titlePool().intern(g.second.name)});
+    }
+    sort(groups.begin(), groups.end(), [](const GroupRecord& a, const GroupRecord& b) { return a.id < b.id; });
+    for (auto& g : groups)
+        for (Tab* tab : tabs.groupTabs(g.id)) groupOrder.push_back(tab->id);
+    for (auto tab : tabs) {
+        places.push_back({tab->windowId, tab->groupId});
+        if (tab->stub()) {
+            addNavRecord(records, entries, tab->id, tab->stubCursor, tab->stubPages, tab->stubCount);
+            continue;
+        }
+        pages.clear();
+        size_t cursor = tab->copyPages(pages);
+        addNavRecord(records, entries, tab->id, cursor, pages.data(), pages.size());
+    }
+    writer.add(TAB_META, meta);
+    writer.add(TABS, records);
+    writer.add(TAB_ENTRIES, entries);
+    writer.add(TAB_PLACES, places);
+    writer.add(WINDOWS, windows);
+    writer.add(TAB_GROUPS, groups);
+    writer.add(GROUP_ORDER, groupOrder);
+}
+
+// Tabs come back as stubs over the mapped entries (see Tab), unless the
+// string ids had to be remapped or a record does not fit a tab's ring.
+void FileManager::loadTabs(TabTable& tabs, int& currentIndex, int& nextId) {
+    INSTRUMENT("FileManager::loadTabs");
+    if (!state) return importTabs(tabs, currentIndex, nextId);
+    size_t metaCount, count, entryCount, placeCount = 0, windowCount = 0, groupCount = 0, orderCount = 0;
+    const TabMeta* meta = state->section<TabMeta>(TAB_META, metaCount);
+    const NavRecord* records = state->section<NavRecord>(TABS, count);
+    const Page* entries = state->section<Page>(TAB_ENTRIES, entryCount);
+    const TabPlace* places = state->section<TabPlace>(TAB_PLACES, placeCount);
+    const WindowRecord* windows = state->section<WindowRecord>(WINDOWS, windowCount);
+    const GroupRecord* groups = state->section<GroupRecord>(TAB_GROUPS, groupCount);
+    const int32_t* groupOrder = state->section<int32_t>(GROUP_ORDER, orderCount);
+    if (metaCount) {
+        currentIndex = meta->currentTabIndex;
+        nextId = meta->nextTabId;
+    }
+    for (size_t w = 0; w < windowCount; w++) tabs.openWindow(windows[w].id);
+    for (size_t g = 0; g < groupCount; g++) {
+        TitleId name = groups[g].nameId >= storedTitles ? 0 : titleRemap.empty() ? groups[g].nameId : titleRemap[groups[g].nameId];
+        tabs.createGroup(groups[g].id, groups[g].windowId, string(titlePool().get(name)));
+    }
+    int defaultWindow = windowCount ? windows[0].id : 1;
+    for (size_t i = 0; i < count; i++) {
+        // A record is dropped if its range or any of its pages is out of bounds, or its id is taken.
+        if (records[i].firstEntry + (size_t)records[i].entryCount > entryCount) continue;
+        if (records[i].tabId <= 0 || tabs.findTab(records[i].tabId)) continue;
+        const Page* first = entries + records[i].firstEntry;
+        if (!all_of(first, first + records[i].entryCount, stored)) continue;
+        nextId = max(nextId, records[i].tabId + 1);
+        TabPlace place = i < placeCount ? places[i] : TabPlace{defaultWindow, 0};
+        Tab* tab = tabs.get(tabs.open(records[i].tabId, place.windowId ? place.windowId : defaultWindow, place.groupId));
+        if (urlRemap.empty() && titleRemap.empty() && records[i].entryCount <= tab->nav.capacity() &&
+            (records[i].entryCount == 0 || records[i].cursor < records[i].entryCount)) {
+            tab->stubPages = entries + records[i].firstEntry;
+            tab->stubCount = records[i].entryCount;
+            tab->stubCursor = records[i].cursor;
+        } else {
+            rebuildNav(tab, records[i], entries);
+        }
+    }
+    // Tabs joined their groups in window order; each goes to the end of its
+    // group again in the group's own.
+    for (size_t i = 0; i < orderCount; i++) {
+        TabHandle h = tabs.find(groupOrder[i]);
+        Tab* tab = tabs.get(h);
+        if (!tab || !tab->groupId) continue;
+        int groupId = tab->groupId;
+        tabs.setGroup(h, 0);
+        tabs.setGroup(h, groupId);
+    }
+    // Groups first: activating a group's tab also makes it its window's.
+    for (size_t g = 0; g < groupCount; g++)
+        if (groups[g].activeTabId) tabs.activate(tabs.find(groups[g].activeTabId));
+    for (size_t w = 0; w < windowCount; w++)
+        if (windows[w].activeTabId) tabs.activate(tabs.find(windows[w].activeTabId));
+    if (currentIndex < 0 || currentIndex >= (int)tabs.size()) currentIndex = tabs.empty() ? -1 : 0;
+}
+
+// Snapshots share TabRecords in memory; each distinct record is written once
+// and snapshots refer to it by index, so the sharing survives a reload. A
+// record is stored as a delta against the previous record written for the
+// same tab: the run of entries it starts with, found in that record, is kept
+// by reference and only the rest is encoded (see DeltaRecord). Every
+// KEYFRAME_INTERVAL-th record of a tab, or one sharing nothing, is a keyframe.
+void FileManager::saveSessionHistory(StateWriter& writer, deque<SessionSnapshot>& sessions) {
+    INSTRUMENT("FileManager::saveSessionHistory");
+    vector<SnapshotRecord> snapshots;
+    vector<uint32_t> snapshotTabs;
+    vector<DeltaRecord> records;
+    vector<TabPlace> scopes, places;
+    vector<const TabRecord*> written;       // by record index
+    vector<uint32_t> depth;                 // records decoded before this one, keyframe included
+    vector<char> pages;
+    unordered_map<const TabRecord*, uint32_t> indexOf;
+    unordered_map<int, uint32_t> lastOfTab;
+    for (auto& s : sessions) {
+        if (!s.tabs) loadSnapshotTabs(s);
+        SnapshotRecord snapshot = {s.timestamp, titlePool().intern(s.description),
+                                   (uint32_t)snapshotTabs.size(), (uint32_t)s.tabs->size(), 0};
+        snapshots.push_back(snapshot);
+        scopes.push_back({s.windowId, s.groupId});
+        for (auto& record : *s.tabs) {
+            auto it = indexOf.find(record.get());
+            if (it == indexOf.end()) {
+                uint32_t index = records.size();
+                const vector<Page>& entries = record->entries;
+                DeltaRecord delta = {record->id, (uint32_t)record->cursor, DeltaRecord::NO_BASE, 0, 0, 0, pages.size(), 0, 0};
+                auto previous = lastOfTab.find(record->id);
+                if (previous != lastOfTab.end() && depth[previous->second] < KEYFRAME_INTERVAL && !entries.empty()) {
+                    const vector<Page>& base = written[previous->second]->entries;
+                    auto same = [](const Page& a, const Page& b) {
+                        return a.urlId == b.urlId && a.titleId == b.titleId && a.timestamp == b.timestamp;
+                    };
+                    size_t skip = 0, keep = 0;
+                    while (skip < base.size() && !same(base[skip], entries[0])) skip++;
+                    while (skip + keep < base.size() && keep < entries.size() && same(base[skip + keep], entries[keep]))
+                        keep++;
+                    if (keep) {
+                        delta.base = previous->second;
+                        delta.skip = skip;
+                        delta.keep = keep;
+                    }
+                }
+                encodePages(pages, entries.data() + delta.keep, entries.size() - delta.keep,
+                            delta.keep ? entries[delta.keep - 1].timestamp : 0);
+                delta.added = entries.size() - delta.keep;
+                if (record->urlsOnly) delta.flags |= DeltaRecord::URLS_ONLY;
+                delta.bytes = pages.size() - delta.offset;
+                records.push_back(delta);
+                places.push_back({record->windowId, record->groupId});
+                written.push_back(record.get());
+                depth.push_back(delta.keep ? depth[delta.base] + 1 : 1);
+                lastOfTab[record->id] = index;
+                it = indexOf.insert({record.get(), index}).first;
+            }
+            snapshotTabs.push_back(it->second);
+        }
+    }
+    writer.add(SESSIONS, snapshots);
+    writer.add(SESSION_TABS, snapshotTabs);
+    writer.add(SESSION_DELTAS, records);
+    writer.add(SESSION_PAGES, pages);
+    writer.add(SESSION_SCOPES, scopes);
+    writer.add(SESSION_PLACES, places);
+}
+
+// Only descriptions and timestamps are read here; each snapshot's tabs are
+// decoded by loadSnapshotTabs when first needed.
+void FileManager::loadSessionHistory(deque<SessionSnapshot>& sessions) {
+    INSTRUMENT("FileManager::loadSessionHistory");
+    if (!state) return importSessionHistory(sessions);
+    size_t count, recordCount, scopeCount = 0;
+    const SnapshotRecord* snapshots = state->section<SnapshotRecord>(SESSIONS, count);
+    const TabPlace* scopes = state->section<TabPlace>(SESSION_SCOPES, scopeCount);
+    if (!state->section<DeltaRecord>(SESSION_DELTAS, recordCount))
+        state->section<NavRecord>(SESSION_RECORDS, recordCount);
+    sessionRecords.assign(recordCount, nullptr);
+    for (size_t i = 0; i < count; i++) {
+        TitleId description = snapshots[i].descriptionId >= storedTitles ? 0
+                              : titleRemap.empty() ? snapshots[i].descriptionId : titleRemap[snapshots[i].descriptionId];
+        SessionSnapshot snapshot{string(titlePool().get(description))};
+        snapshot.timestamp = snapshots[i].timestamp;
+        snapshot.tabs = nullptr;
+        snapshot.stored = i;
+        if (i < scopeCount) {
+            snapshot.windowId = scopes[i].windowId;
+            snapshot.groupId = scopes[i].groupId;
+        }
+        sessions.push_back(snapshot);
+    }
+}
+
+void FileManager::loadSnapshotTabs(SessionSnapshot& snapshot) {
+    INSTRUMENT("FileManager::loadSnapshotTabs");
+    auto tabs = make_shared<TabList>();
+    size_t count = 0, tabCount = 0;
+    const SnapshotRecord* snapshots = state ? state->section<SnapshotRecord>(SESSIONS, count) : nullptr;
+    const uint32_t* snapshotTabs = state ? state->section<uint32_t>(SESSION_TABS, tabCount) : nullptr;
+    if (snapshot.stored < count) {
+        const SnapshotRecord& s = snapshots[snapshot.stored];
+        for (uint32_t j = 0; j < s.tabCount; j++) {
+            size_t k = s.firstTab + j;
+            if (k < tabCount && snapshotTabs[k] < sessionRecords.size()) tabs->push_back(sessionRecord(snapshotTabs[k]));
+        }
+    }
+    snapshot.tabs = tabs;
+}
+
+// Decodes one stored record, and the records its delta chain runs through,
+// caching each so records shared between snapshots stay shared.
+shared_ptr<const TabRecord> FileManager::sessionRecord(uint32_t index) {
+    if (sessionRecords[index]) return sessionRecords[index];
+    size_t recordCount, entryCount, pageBytes;
+    const DeltaRecord* deltas = state->section<DeltaRecord>(SESSION_DELTAS, recordCount);
+    if (!deltas) {
+        // Written before delta encoding: every record holds all its entries.
+        const NavRecord* records = state->section<NavRecord>(SESSION_RECORDS, recordCount);
+        const Page* entries = state->section<Page>(SESSION_ENTRIES, entryCount);
+        auto record = make_shared<TabRecord>(records[index].tabId);
+        if (records[index].firstEntry + (size_t)records[index].entryCount <= entryCount) {
+            const Page* first = entries + records[index].firstEntry;
+            if (all_of(first, first + records[index].entryCount, stored))
+                for (uint32_t j = 0; j < records[index].entryCount; j++) record->entries.push_back(livePage(first[j]));
+        }
+        record->cursor = records[index].cursor < record->entries.size() ? records[index].cursor : 0;
+        return sessionRecords[index] = record;
+    }
+    const char* pages = state->section<char>(SESSION_PAGES, pageBytes);
+    size_t placeCount = 0;
+    const TabPlace* places = state->section<TabPlace>(SESSION_PLACES, placeCount);
+
+    // Walk back to a keyframe or an already decoded record, then decode forwards.
+    vector<uint32_t> chain = {index};
+    while (!sessionRecords[chain.back()]) {
+        const DeltaRecord& d = deltas[chain.back()];
+        if (d.base >= chain.back() || d.keep == 0) break;      // keyframe; bases always come first
+        chain.push_back(d.base);
+    }
+    for (size_t c = chain.size(); c-- > 0;) {
+        uint32_t i = chain[c];
+        if (sessionRecords[i]) continue;
+        const DeltaRecord& d = deltas[i];
+        auto record = make_shared<TabRecord>(d.tabId);
+        if (d.keep && d.base < i) {
+            const vector<Page>& base = sessionRecords[d.base]->entries;
+            size_t first = min<size_t>(d.skip, base.size());
+            record->entries.assign(base.begin() + first, base.begin() + min<size_t>(first + d.keep, base.size()));
+        }
+        vector<Page> added;
+        if (d.offset <= pageBytes && d.bytes <= pageBytes - d.offset &&
+            decodePages(pages + d.offset, d.bytes, d.added,
+                        record->entries.empty() ? 0 : record->entries.back().timestamp, added) &&
+            all_of(added.begin(), added.end(), stored))
+            for (auto& p : added) record->entries.push_back(livePage(p));
+        record->cursor = d.cursor < record->entries.size() ? d.cursor : 0;
+        record->urlsOnly = d.flags & DeltaRecord::URLS_ONLY;
+        if (i < placeCount) {
+            record->windowId = places[i].windowId;
+            record->groupId = places[i].groupId;
+        }
+        sessionRecords[i] = record;
+    }
+    return sessionRecords[index];
+}
+
+void FileManager::saveSessionMeta(StateWriter& writer, time_t lastSnapshotTime, bool lastAutomatic) {
+    INSTRUMENT("FileManager::saveSessionMeta");
+    vector<SessionMeta> meta = {{lastSnapshotTime, lastAutomatic, 0}};
+    writer.add(SESSION_META, meta);
+}
+
+void FileManager::loadSessionMeta(time_t& lastSnapshotTime, bool& lastAutomatic) {
+    INSTRUMENT("FileManager::loadSessionMeta");
+    size_t count = 0;
+    const SessionMeta* meta = state ? state->section<SessionMeta>(SESSION_META, count) : nullptr;
+    lastSnapshotTime = count ? meta->lastSnapshotTime : 0;
+    lastAutomatic = count && meta->lastAutomatic;
+}
+
+void FileManager::saveWorkspaceMeta(StateWriter& writer, int nextWindowId, int nextGroupId) {
+    INSTRUMENT("FileManager::saveWorkspaceMeta");
+    vector<WorkspaceMeta> meta = {{nextWindowId, nextGroupId}};
+    writer.add(WORKSPACE_META, meta);
+}
+
+// Only ever raises the ids, which start past those in use.
+void FileManager::loadWorkspaceMeta(int& nextWindowId, int& nextGroupId) {
+    INSTRUMENT("FileManager::loadWorkspaceMeta");
+    size_t count = 0;
+    const WorkspaceMeta* meta = state ? state->section<WorkspaceMeta>(WORKSPACE_META, count) : nullptr;
+    if (!count) return;
+    nextWindowId = max(nextWindowId, (int)meta->nextWindowId);
+    nextGroupId = max(nextGroupId, (int)meta->nextGroupId);
+}
+
+void FileManager::saveJournalPosition(StateWriter& writer, uint64_t sequence) {
+    INSTRUMENT("FileManager::saveJournalPosition");
+    vector<uint64_t> meta = {sequence};
+    writer.add(JOURNAL_META, meta);
+}
+
+uint64_t FileManager::loadJournalPosition() {
+    INSTRUMENT("FileManager::loadJournalPosition");
+    size_t count = 0;
+    const uint64_t* sequence = state ? state->section<uint64_t>(JOURNAL_META, count) : nullptr;
+    return count ? *sequence : 0;
+}
+
+// ------------------ Legacy text import ------------------
+void FileManager::importHistory(HistoryLog& history) {
+    ifstream file("history.txt");
     if (!file) return;
     string line;
     while (getline(file, line)) {
         size_t comma = line.find(',');
         if (comma != string::npos)
-            bookmarks[line.substr(0, comma)] = Page(line.substr(0, comma), line.substr(comma + 1));
+            history.append(Page(line.substr(0, comma), line.substr(comma + 1)));
     }
 }
 
-void FileManager::saveVisitCount(unordered_map<string, int>& visitCount) {
-    ofstream file("visitCount.txt");
-    for (auto& v : visitCount)
-        file << v.first << "," << v.second << "\n";
-}
-
-void FileManager::loadVisitCount(unordered_map<string, int>& visitCount) {
-    ifstream file("visitCount.txt");
+void FileManager::importBookmarks(unordered_map<UrlId, Page>& bookmarks) {
+    ifstream file("bookmarks.txt");
     if (!file) return;
     string line;
     while (getline(file, line)) {
         size_t comma = line.find(',');
-        if (comma != string::npos)
-            visitCount[line.substr(0, comma)] = stoi(line.substr(comma + 1));
+        if (comma != string::npos) {
+            Page p(line.substr(0, comma), line.substr(comma + 1));
+            bookmarks[p.urlId] = p;
+        }
     }
 }
 
-void FileManager::saveTabs(vector<Tab*>& tabs, int currentIndex, int nextId) {
-    ofstream file("tabs.txt");
-    file << currentIndex << "\n" << nextId << "\n";
-    for (auto tab : tabs) {
-        file << "TAB:" << tab->id << "\n";
-        if (!tab->currentPage.url.empty())
-            file << "CURRENT:" << tab->currentPage.url << "," << tab->currentPage.title << "\n";
+void FileManager::importVisitCount(ShardedVisitCounter& visitCount) {
+    ifstream file("visitCount.txt");
+    if (!file) return;
+    string line;
+    while (getline(file, line)) {
+        size_t comma = line.find(',');
+        if (comma == string::npos) continue;
+        long long count;
+        try { count = stoll(line.substr(comma + 1)); } catch (...) { continue; }
+        if (count > 0 && count <= UINT32_MAX) visitCount.add(internUrl(line.substr(0, comma)), (uint32_t)count);
     }
 }
 
-void FileManager::loadTabs(vector<Tab*>& tabs, int& currentIndex, int& nextId) {
+void FileManager::importTabs(TabTable& tabs, int& currentIndex, int& nextId) {
     ifstream file("tabs.txt");
     if (!file) return;
     string line;
-    if (getline(file, line)) currentIndex = stoi(line);
-    if (getline(file, line)) nextId = stoi(line);
+    // Damaged lines are skipped; the caller falls back to the first tab.
+    try {
+        if (getline(file, line)) currentIndex = stoi(line);
+        if (getline(file, line)) nextId = stoi(line);
+    } catch (...) {}
     Tab* currentTab = nullptr;
     while (getline(file, line)) {
         if (line.find("TAB:") == 0) {
-            currentTab = new Tab(stoi(line.substr(4)));
-            tabs.push_back(currentTab);
+            int id;
+            try { id = stoi(line.substr(4)); } catch (...) { id = 0; }
+            currentTab = id > 0 && !tabs.findTab(id) ? tabs.get(tabs.open(id, 1)) : nullptr;
+            if (currentTab) nextId = max(nextId, id + 1);
         } else if (line.find("CURRENT:") == 0 && currentTab) {
             size_t comma = line.find(',', 8);
             if (comma != string::npos)
-                currentTab->currentPage = Page(line.substr(8, comma - 8), line.substr(comma + 1));
+                currentTab->nav.visit(Page(line.substr(8, comma - 8), line.substr(comma + 1)));
         }
     }
 }
 
-void FileManager::saveSessionHistory(vector<SessionSnapshot>& sessions) {
-    ofstream file("sessionHistory.txt");
-    for (auto& s : sessions) {
-        file << "SNAPSHOT:" << s.timestamp << "," << s.description << "\n";
-        for (auto& td : s.tabData)
-            file << "TAB:" << td.first << "," << td.second << "\n";
-        file << "END\n";
-    }
-}
-
-void FileManager::loadSessionHistory(vector<SessionSnapshot>& sessions) {
+// Each tab was written as "TAB:<id>#<cursor>,<url> -> <url> ...", oldest first.
+// Older files have no cursor, in which case the newest entry is current.
+void FileManager::importSessionHistory(deque<SessionSnapshot>& sessions) {
     ifstream file("sessionHistory.txt");
     if (!file) return;
     string line;
     SessionSnapshot* current = nullptr;
+    shared_ptr<TabList> tabs;
+    // Consecutive snapshots usually repeat most tabs verbatim; share those records.
+    unordered_map<string, shared_ptr<const TabRecord>> previous, seen;
     while (getline(file, line)) {
         if (line.find("SNAPSHOT:") == 0) {
             size_t comma = line.find(',', 9);
+            time_t timestamp = 0;
+            try {
+                if (comma != string::npos) timestamp = stoll(line.substr(9, comma - 9));
+            } catch (...) { comma = string::npos; }
             if (comma != string::npos) {
                 sessions.push_back(SessionSnapshot(line.substr(comma + 1)));
                 current = &sessions.back();
-                current->timestamp = stoll(line.substr(9, comma - 9));
+                current->timestamp = timestamp;
+                tabs = make_shared<TabList>();
+                current->tabs = tabs;
             }
         } else if (line.find("TAB:") == 0 && current) {
+            auto shared = previous.find(line);
+            if (shared != previous.end()) {
+                tabs->push_back(shared->second);
+                seen[line] = shared->second;
+                continue;
+            }
             size_t comma = line.find(',', 4);
-            if (comma != string::npos)
-                current->tabData.push_back({stoi(line.substr(4, comma - 4)), line.substr(comma + 1)});
-        } else if (line == "END") current = nullptr;
+            if (comma == string::npos) continue;
+            string head = line.substr(4, comma - 4), chain = line.substr(comma + 1);
+            size_t hash = head.find('#');
+            int id;
+            try { id = stoi(head.substr(0, hash)); } catch (...) { continue; }
+            auto record = make_shared<TabRecord>(id);
+            record->urlsOnly = true;
+            if (chain != "empty" && chain != "[empty]") {
+                for (size_t pos = 0; pos <= chain.size();) {
+                    size_t arrow = chain.find(" -> ", pos);
+                    if (arrow == string::npos) arrow = chain.size();
+                    Page p;
+                    p.urlId = internUrl(string_view(chain).substr(pos, arrow - pos));
+                    p.timestamp = current->timestamp;
+                    record->entries.push_back(p);
+                    pos = arrow + 4;
+                }
+            }
+            if (!record->entries.empty()) {
+                record->cursor = record->entries.size() - 1;
+                try {
+                    if (hash != string::npos) record->cursor = stoul(head.substr(hash + 1));
+                } catch (...) {}
+            }
+            if (record->cursor >= record->entries.size()) record->cursor = 0;
+            tabs->push_back(record);
+            seen[line] = record;
+        } else if (line == "END") {
+            current = nullptr;
+            previous.swap(seen);
+            seen.clear();
+        }
     }
 }
 
-#endif
\ No newline at end of file
+#endif
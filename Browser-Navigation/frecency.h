@@ -0,0 +1,191 @@
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include "stringPool.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+typedef StringId DomainId;
+
+struct FrecencyScore {
+    StringId id;            // UrlId or DomainId
+    double score;           // decayed visits as of the query time
+};
+
+// Visit scores that halve every HALF_LIFE, per page and per domain.
+// A visit of weight w at time t adds w * 2^((t - now) / HALF_LIFE) to the
+// score at `now`. Storing log2 of sum(w * 2^(t / HALF_LIFE)) instead makes
+// the stored value time-invariant: it only changes when a visit adds to it,
+// the order between pages never changes by itself, and the current score is
+// recovered on read as 2^(stored - now / HALF_LIFE). So nothing is ever
+// rescanned to apply decay.
+//
+// Because stored scores only ever grow, the best TOP_KEPT pages and domains
+// can be kept exactly in small sorted arrays: an entry outside the array can
+// only overtake one inside it by being visited, which is when it is checked.
+class Frecency {
+public:
+    static constexpr double HALF_LIFE = 30 * 24 * 3600.0;   // 30 days
+    static const size_t TOP_KEPT = 128;                     // deepest top-K query answered
+
+private:
+    static constexpr double NONE = -HUGE_VAL;
+
+    // The TOP_KEPT highest stored scores seen, highest first.
+    class Leaders {
+    private:
+        vector<pair<double, StringId>> best;
+    public:
+        void raise(StringId id, double stored) {
+            if (best.size() == TOP_KEPT && stored <= best.back().first) return;
+            size_t i = 0;
+            while (i < best.size() && best[i].second != id) i++;
+            if (i == best.size()) {
+                if (best.size() == TOP_KEPT) i--;
+                else best.emplace_back();
+            }
+            best[i] = {stored, id};
+            for (; i > 0 && best[i - 1].first < best[i].first; i--) swap(best[i - 1], best[i]);
+        }
+        const vector<pair<double, StringId>>& entries() const { return best; }
+    };
+
+    StringPool domains;
+    vector<double> pageScore;                   // UrlId -> stored log score
+    vector<DomainId> domainOfPage;              // UrlId -> domain, parsed on the first visit
+    vector<double> domainScore;                 // DomainId -> stored log score
+    vector<vector<UrlId>> domainPages;          // DomainId -> pages visited in it
+    Leaders pages, ranked;
+    size_t visitedPages = 0;
+
+    // log2(2^a + 2^b) without leaving log space.
+    static double logAdd(double a, double b) {
+        if (a == NONE) return b;
+        double high = max(a, b), low = min(a, b);
+        return high + log2(1 + exp2(low - high));
+    }
+
+    static double decayed(double stored, time_t now) { return stored == NONE ? 0 : exp2(stored - now / HALF_LIFE); }
+
+    DomainId domainFor(UrlId url) {
+        if (url >= domainOfPage.size()) {
+            domainOfPage.resize(max<size_t>(url + 1, domainOfPage.size() * 2), StringPool::NOT_FOUND);
+            pageScore.resize(domainOfPage.size(), NONE);
+        }
+        if (domainOfPage[url] == StringPool::NOT_FOUND) {
+            DomainId d = domains.intern(domainOf(urlPool().get(url)));
+            if (d >= domainScore.size()) {
+                domainScore.resize(d + 1, NONE);
+                domainPages.resize(d + 1);
+            }
+            domainPages[d].push_back(url);
+            domainOfPage[url] = d;
+        }
+        return domainOfPage[url];
+    }
+
+    static void raise(Leaders& leaders, double& stored, StringId id, double amount) {
+        stored = logAdd(stored, amount);
+        leaders.raise(id, stored);
+    }
+
+public:
+    // The registrable part of a URL's host: "https://user@news.bbc.co.uk:443/x"
+    // gives "bbc.co.uk". Without a public suffix list, a two-letter TLD under a
+    // label of up to three letters (co.uk, com.au) is treated as one suffix.
+    static string_view domainOf(string_view url) {
+        size_t scheme = url.find("://");
+        if (scheme != string_view::npos) url.remove_prefix(scheme + 3);
+        url = url.substr(0, url.find_first_of("/?#"));
+        size_t at = url.rfind('@');
+        if (at != string_view::npos) url.remove_prefix(at + 1);
+        if (!url.empty() && url[0] == '[') return url.substr(0, url.find(']') + 1);   // IPv6 literal
+        url = url.substr(0, url.find(':'));
+        if (!url.empty() && url.back() == '.') url.remove_suffix(1);
+        if (url.find_first_not_of("0123456789.") == string_view::npos) return url;    // IPv4
+        size_t last = url.rfind('.');
+        if (last == string_view::npos || last == 0) return url;
+        size_t second = url.rfind('.', last - 1);
+        if (second == string_view::npos) return url;
+        if (url.size() - last - 1 == 2 && last - second - 1 <= 3) {
+            size_t third = second ? url.rfind('.', second - 1) : string_view::npos;
+            return third == string_view::npos ? url : url.substr(third + 1);
+        }
+        return url.substr(second + 1);
+    }
+
+    void visit(UrlId url, time_t when, double weight = 1) {
+        DomainId d = domainFor(url);
+        double amount = log2(weight) + when / HALF_LIFE;
+        if (pageScore[url] == NONE) visitedPages++;
+        raise(pages, pageScore[url], url, amount);
+        raise(ranked, domainScore[d], d, amount);
+    }
+
+    double score(UrlId url, time_t now = time(nullptr)) const {
+        return url < pageScore.size() ? decayed(pageScore[url], now) : 0;
+    }
+
+    // At most TOP_KEPT entries.
+    vector<FrecencyScore> topPages(size_t k, time_t now = time(nullptr)) const {
+        vector<FrecencyScore> out;
+        for (auto& e : pages.entries()) {
+            if (out.size() == k) break;
+            out.push_back({e.second, decayed(e.first, now)});
+        }
+        return out;
+    }
+
+    vector<FrecencyScore> topDomains(size_t k, time_t now = time(nullptr)) const {
+        vector<FrecencyScore> out;
+        for (auto& e : ranked.entries()) {
+            if (out.size() == k) break;
+            out.push_back({e.second, decayed(e.first, now)});
+        }
+        return out;
+    }
+
+    // Best pages of one domain (as returned by domainOf); linear in the domain's page count.
+    vector<FrecencyScore> topPagesIn(string_view domain, size_t k, time_t now = time(nullptr)) const {
+        vector<FrecencyScore> out;
+        DomainId d = domains.find(domain);
+        if (d == StringPool::NOT_FOUND || d >= domainPages.size()) return out;
+        const vector<UrlId>& members = domainPages[d];
+        vector<UrlId> best(members.begin(), members.end());
+        auto higher = [&](UrlId a, UrlId b) { return pageScore[a] > pageScore[b]; };
+        size_t n = min(k, best.size());
+        partial_sort(best.begin(), best.begin() + n, best.end(), higher);
+        for (size_t i = 0; i < n; i++) out.push_back({best[i], decayed(pageScore[best[i]], now)});
+        return out;
+    }
+
+    string_view domainName(DomainId d) const { return domains.get(d); }
+
+    // Stored (time-invariant) page scores, for persistence.
+    vector<pair<UrlId, double>> stored() const {
+        vector<pair<UrlId, double>> out;
+        out.reserve(visitedPages);
+        for (UrlId url = 0; url < pageScore.size(); url++)
+            if (pageScore[url] != NONE) out.push_back({url, pageScore[url]});
+        return out;
+    }
+
+    // Adds saved page scores; domain scores are rebuilt from them.
+    void assign(const vector<pair<UrlId, double>>& scores) {
+        for (auto& s : scores) {
+            DomainId d = domainFor(s.first);
+            if (pageScore[s.first] == NONE) visitedPages++;
+            raise(pages, pageScore[s.first], s.first, s.second);
+            raise(ranked, domainScore[d], d, s.second);
+        }
+    }
+
+    size_t size() const { return visitedPages; }
+    bool empty() const { return visitedPages == 0; }
+};
+
+#endif
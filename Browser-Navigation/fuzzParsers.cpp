@@ -0,0 +1,94 @@
+#include "modelCheck.h"
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+// libFuzzer entry points for the startup parsers, one binary per target;
+// FUZZ_TARGET names it (see CMakeLists.txt):
+//   startup  The first byte of the input picks the file the rest becomes:
+//            0-4 a legacy text file read by the FileManager::import*
+//            fallbacks, 5 journal.bin, 6 a whole state.bin. A Browser is
+//            started on it and has to come up with a usable current tab.
+//   pools, history, bookmarks, visits, frecency, tabs, sessions, journal
+//            One binary loader (ModelCheck::loaders). The input is a
+//            section selector byte, a little-endian uint64 record count and
+//            the section body. The body replaces that one of the loader's
+//            sections in a sample state file, with every checksum
+//            recomputed, and the loader reads it through a
+//            ModelCheck::ScopedState, unmapped again before the input returns.
+// Seeded mutations of the same inputs run on any compiler with --check.
+#ifndef FUZZ_TARGET
+#define FUZZ_TARGET "startup"
+#endif
+
+static const char* FILES[] = {"history.txt", "bookmarks.txt", "visitCount.txt", "tabs.txt",
+                              "sessionHistory.txt", "journal.bin", "state.bin"};
+static const ModelCheck::Loader* loader = nullptr;
+
+static void clearProfile() {
+    for (const char* name : FILES) remove(name);
+    remove("state.bin.corrupt");
+}
+
+// A profile that fills every section the loaders read, saved as sample.bin.
+static void writeSample() {
+    clearProfile();
+    {
+        Browser browser(true);
+        for (int i = 0; i < 40; i++) {
+            vector<int> ids = browser.tabIds();
+            int id = ids[i % ids.size()];
+            browser.visitPage(id, "site" + to_string(i % 7) + ".example.com/page" + to_string(i), "Page, " + to_string(i));
+            if (i % 3 == 0) browser.goBack(id);
+            if (i % 5 == 0) browser.addBookmark(id);
+            if (i % 8 == 0) browser.openTab();
+            if (i % 13 == 0) browser.createGroup(id, "Group " + to_string(i));
+            if (i % 17 == 0) browser.openWindow();
+            if (i % 10 == 0) browser.saveSession("Snapshot " + to_string(i));
+        }
+        browser.compact();
+    }
+    ModelCheck::startOver();
+    rename("state.bin", "sample.bin");
+    clearProfile();
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+    filesystem::path dir = filesystem::temp_directory_path() / ("browser-fuzz-" FUZZ_TARGET);
+    filesystem::create_directories(dir);
+    filesystem::current_path(dir);
+    cerr.rdbuf(nullptr);        // rejected files are reported there
+    for (auto& l : ModelCheck::loaders())
+        if (string(l.name) == FUZZ_TARGET) loader = &l;
+    if (loader) writeSample();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (loader) {
+        if (size < 9) return 0;
+        uint64_t count;
+        memcpy(&count, data + 1, sizeof(count));
+        StateSection type = loader->sections[data[0] % loader->sections.size()];
+        if (!ModelCheck::replaceSection("sample.bin", "state.bin", type, string((const char*)data + 9, size - 9), count))
+            abort();
+        loader->run();
+        return 0;
+    }
+
+    if (size == 0) return 0;
+    clearProfile();
+    {
+        ofstream out(FILES[data[0] % 7], ios::binary);
+        out.write((const char*)data + 1, size - 1);
+    }
+    {
+        Browser browser(true);
+        vector<int> ids = browser.tabIds();
+        if (ids.empty() || find(ids.begin(), ids.end(), browser.selectedTab()) == ids.end()) abort();
+        browser.visitPage(ids[0], "example.com", "Example");
+    }
+    ModelCheck::startOver();        // unmaps state.bin, so mappings do not pile up over a run
+    return 0;
+}
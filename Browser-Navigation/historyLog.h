@@ -0,0 +1,127 @@
+#ifndef HISTORYLOG_H
+#define HISTORYLOG_H
+
+#include "structures.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+using namespace std;
+
+// Append-only browsing history.
+// Pages are carved out of chunks that never move, so an append is O(1) and
+// costs one heap allocation per chunk instead of one per visit. Chunk c holds
+// CHUNK_SIZE << c pages, so a few dozen chunk pointers cover any history.
+// The oldest entries may instead be a read-only array mapped from the state
+// file; appends always go to the chunks after it.
+//
+// Entries are addressed by position, the number of visits recorded before
+// them since the profile was created. Positions never shift: expire() drops
+// entries from the front by raising start(), so [start(), size()) are the
+// live ones and a position held by a reader stays valid until it expires.
+//
+// Appends may come from many threads without a lock: each one reserves a
+// slot with an atomic counter, fills it, then publishes it once every
+// earlier slot is published, so readers always see a gap-free prefix.
+// attach(), clear() and expire() need a quiet log.
+class HistoryLog {
+private:
+    static const size_t CHUNK_SIZE = 4096, MAX_CHUNKS = 24;
+    atomic<Page*> chunks[MAX_CHUNKS];
+    atomic<size_t> reserved, published;     // slots after the mapped prefix
+    const Page* base;
+    size_t baseCount;
+    size_t origin, first;                   // positions of the first stored and the first live entry
+
+    static size_t chunkOf(size_t index, size_t& offset) {
+        size_t k = index / CHUNK_SIZE + 1, c;
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanReverse64(&bit, k);
+        c = bit;
+#else
+        c = 63 - __builtin_clzll(k);
+#endif
+        offset = index - CHUNK_SIZE * ((size_t(1) << c) - 1);
+        return c;
+    }
+
+public:
+    class iterator {
+    private:
+        const HistoryLog* log;
+        size_t pos;
+    public:
+        iterator(const HistoryLog* l, size_t p) : log(l), pos(p) {}
+        const Page& operator*() const { return (*log)[pos]; }
+        const Page* operator->() const { return &(*log)[pos]; }
+        iterator& operator++() { ++pos; return *this; }
+        bool operator!=(const iterator& other) const { return pos != other.pos; }
+    };
+
+    HistoryLog() : reserved(0), published(0), base(nullptr), baseCount(0), origin(0), first(0) {
+        for (auto& c : chunks) c = nullptr;
+    }
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+    ~HistoryLog() { clear(); }
+
+    // Adopts `n` pages that stay owned by the caller (a mapped file) as the log
+    // prefix, the first of them at `position`.
+    void attach(const Page* pages, size_t n, size_t position = 0) {
+        clear();
+        base = pages;
+        baseCount = n;
+        origin = first = position;
+    }
+
+    // Drops every entry before `position`. Chunks left holding only expired
+    // entries are freed, so the cost follows the expired range; the mapped
+    // prefix stays until the file is rewritten.
+    void expire(size_t position) {
+        first = max(first, min(position, size()));
+        if (first <= origin + baseCount) return;
+        size_t offset, c = chunkOf(first - origin - baseCount, offset);
+        for (size_t k = 0; k < c; k++) delete[] chunks[k].exchange(nullptr);
+    }
+
+    void append(const Page& p) {
+        size_t i = reserved.fetch_add(1, memory_order_relaxed), offset;
+        size_t c = chunkOf(i, offset);
+        Page* chunk = chunks[c].load(memory_order_acquire);
+        if (!chunk) {
+            Page* fresh = new Page[CHUNK_SIZE << c];
+            if (chunks[c].compare_exchange_strong(chunk, fresh, memory_order_acq_rel)) chunk = fresh;
+            else delete[] fresh;
+        }
+        chunk[offset] = p;
+        while (published.load(memory_order_acquire) != i) this_thread::yield();
+        published.store(i + 1, memory_order_release);
+    }
+
+    const Page& operator[](size_t i) const {
+        i -= origin;
+        if (i < baseCount) return base[i];
+        size_t offset, c = chunkOf(i - baseCount, offset);
+        return chunks[c].load(memory_order_acquire)[offset];
+    }
+    // One past the newest position; the live entries are [start(), size()).
+    size_t size() const { return origin + baseCount + published.load(memory_order_acquire); }
+    size_t start() const { return first; }
+    bool empty() const { return size() == first; }
+
+    // Iterates the live entries published when begin() was called.
+    iterator begin() const { return iterator(this, first); }
+    iterator end() const { return iterator(this, size()); }
+
+    void clear() {
+        for (auto& c : chunks) delete[] c.exchange(nullptr);
+        reserved = published = 0;
+        baseCount = origin = first = 0;
+        base = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+using namespace std;
+
+// Per-operation call counts, latency histograms and allocated bytes.
+// INSTRUMENT("name") at the top of a function times it until the scope ends.
+// The hooks only exist when BROWSER_INSTRUMENTATION is defined (the CMake
+// option of the same name); otherwise the macro expands to nothing, no
+// allocator is replaced and stats() is always empty.
+//
+// Latencies go into HDR-style histograms: SUB_BUCKETS linear buckets per
+// power of two of nanoseconds, so any recorded value is known to within
+// 1 / SUB_BUCKETS (about 6%) from a few KB per operation. Bytes are those
+// allocated by the calling thread inside the scope, nested scopes included.
+class Instrumentation {
+public:
+#ifdef BROWSER_INSTRUMENTATION
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    struct Stats {
+        string name;
+        uint64_t calls, bytes;
+        double meanUs, p50Us, p90Us, p99Us, maxUs;
+    };
+
+    class Histogram {
+    private:
+        static const unsigned SUB_BITS = 4, SUB_BUCKETS = 1 << SUB_BITS;
+        static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+        atomic<uint64_t> counts[BUCKETS];
+
+        static size_t bucketOf(uint64_t v) {
+            if (v < SUB_BUCKETS) return v;
+#ifdef _MSC_VER
+            unsigned long top;
+            _BitScanReverse64(&top, v);
+#else
+            unsigned top = 63 - __builtin_clzll(v);
+#endif
+            unsigned shift = top - SUB_BITS;
+            return (shift + 1) * SUB_BUCKETS + ((v >> shift) & (SUB_BUCKETS - 1));
+        }
+
+        // Midpoint of a bucket's range.
+        static double valueOf(size_t bucket) {
+            if (bucket < SUB_BUCKETS) return bucket;
+            unsigned shift = bucket / SUB_BUCKETS - 1;
+            return ((SUB_BUCKETS + bucket % SUB_BUCKETS) << shift) + ((1ULL << shift) - 1) / 2.0;
+        }
+
+    public:
+        Histogram() {
+            for (auto& c : counts) c.store(0, memory_order_relaxed);
+        }
+
+        void record(uint64_t v) { counts[bucketOf(v)].fetch_add(1, memory_order_relaxed); }
+
+        // The value at quantile q (0..1); 0 when empty.
+        double quantile(double q) const {
+            uint64_t total = 0;
+            for (auto& c : counts) total += c.load(memory_order_relaxed);
+            if (total == 0) return 0;
+            uint64_t rank = (uint64_t)(q * (total - 1)), seen = 0;
+            for (size_t b = 0; b < BUCKETS; b++) {
+                seen += counts[b].load(memory_order_relaxed);
+                if (seen > rank) return valueOf(b);
+            }
+            return valueOf(BUCKETS - 1);
+        }
+
+        void clear() {
+            for (auto& c : counts) c.store(0, memory_order_relaxed);
+        }
+    };
+
+    // One instrumented operation; created once per call site and never destroyed before exit.
+    class Probe {
+    public:
+        const char* name;
+        atomic<uint64_t> calls{0}, nanos{0}, maxNanos{0}, bytes{0};
+        Histogram latency;
+
+        explicit Probe(const char* probeName) : name(probeName) {
+            lock_guard<mutex> guard(registryLock());
+            registry().push_back(this);
+        }
+
+        void record(uint64_t ns, uint64_t allocated) {
+            calls.fetch_add(1, memory_order_relaxed);
+            nanos.fetch_add(ns, memory_order_relaxed);
+            bytes.fetch_add(allocated, memory_order_relaxed);
+            latency.record(ns);
+            uint64_t seen = maxNanos.load(memory_order_relaxed);
+            while (ns > seen && !maxNanos.compare_exchange_weak(seen, ns, memory_order_relaxed)) {}
+        }
+    };
+
+    class Timer {
+    private:
+        Probe& probe;
+        chrono::steady_clock::time_point start;
+        uint64_t allocatedBefore;
+    public:
+        explicit Timer(Probe& p) : probe(p), start(chrono::steady_clock::now()), allocatedBefore(threadAllocated()) {}
+        ~Timer() {
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            probe.record(ns, threadAllocated() - allocatedBefore);
+        }
+    };
+
+    // Bytes allocated by this thread so far (0 when disabled).
+    static uint64_t& threadAllocated() {
+        static thread_local uint64_t bytes = 0;
+        return bytes;
+    }
+
+    static atomic<uint64_t>& totalAllocated() {
+        static atomic<uint64_t> bytes{0};
+        return bytes;
+    }
+
+    // Every operation called at least once, in first-call order.
+    static vector<Stats> stats() {
+        vector<Stats> out;
+        lock_guard<mutex> guard(registryLock());
+        for (Probe* p : registry()) {
+            uint64_t calls = p->calls.load(memory_order_relaxed);
+            if (calls == 0) continue;
+            out.push_back({p->name, calls, p->bytes.load(memory_order_relaxed),
+                           p->nanos.load(memory_order_relaxed) / 1000.0 / calls, p->latency.quantile(0.50) / 1000,
+                           p->latency.quantile(0.90) / 1000, p->latency.quantile(0.99) / 1000,
+                           p->maxNanos.load(memory_order_relaxed) / 1000.0});
+        }
+        return out;
+    }
+
+    static void reset() {
+        lock_guard<mutex> guard(registryLock());
+        for (Probe* p : registry()) {
+            p->calls = p->nanos = p->maxNanos = p->bytes = 0;
+            p->latency.clear();
+        }
+    }
+
+    // Operation table followed by the given structure sizes.
+    static void report(ostream& out, const vector<pair<string, size_t>>& sizes) {
+        char line[256];
+        out << "\n========= Instrumentation =========\n";
+        snprintf(line, sizeof(line), "%-32s %10s %10s %10s %10s %10s %10s %12s\n", "operation", "calls",
+                 "mean us", "p50 us", "p90 us", "p99 us", "max us", "bytes/call");
+        out << line;
+        for (auto& s : stats()) {
+            snprintf(line, sizeof(line), "%-32s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %12.0f\n", s.name.c_str(),
+                     (unsigned long long)s.calls, s.meanUs, s.p50Us, s.p90Us, s.p99Us, s.maxUs,
+                     (double)s.bytes / s.calls);
+            out << line;
+        }
+        snprintf(line, sizeof(line), "%-32s %10llu\n", "bytes allocated (process)",
+                 (unsigned long long)totalAllocated().load(memory_order_relaxed));
+        out << line;
+        for (auto& s : sizes) {
+            snprintf(line, sizeof(line), "%-32s %10zu\n", s.first.c_str(), s.second);
+            out << line;
+        }
+        out << "===================================\n";
+    }
+
+private:
+    static vector<Probe*>& registry() {
+        static vector<Probe*> probes;
+        return probes;
+    }
+
+    static mutex& registryLock() {
+        static mutex lock;
+        return lock;
+    }
+};
+
+#ifdef BROWSER_INSTRUMENTATION
+#define INSTRUMENT_JOIN2(a, b) a##b
+#define INSTRUMENT_JOIN(a, b) INSTRUMENT_JOIN2(a, b)
+#define INSTRUMENT(name)                                                                   \
+    static Instrumentation::Probe INSTRUMENT_JOIN(instrumentProbe, __LINE__)(name);        \
+    Instrumentation::Timer INSTRUMENT_JOIN(instrumentTimer, __LINE__)(INSTRUMENT_JOIN(instrumentProbe, __LINE__))
+
+// Counting allocator. Like FileManager's definitions, these live in the
+// header, which each program includes from a single source file.
+void* operator new(size_t size) {
+    Instrumentation::threadAllocated() += size;
+    Instrumentation::totalAllocated().fetch_add(size, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#else
+#define INSTRUMENT(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "stateFile.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+enum JournalOp : uint8_t {
+    J_VISIT = 1,
+    J_BACK,
+    J_FORWARD,
+    J_BOOKMARK,
+    J_TAB_OPEN,             // in window `value`, 0 for the current tab's
+    J_TAB_CLOSE,
+    J_TAB_SWITCH,
+    J_SNAPSHOT,
+    J_RESTORE,
+    J_EXPIRE,               // history before `timestamp` dropped
+    // Windows and groups; a window opens with its first J_TAB_OPEN. The ids
+    // go in tabId (a tab or window) and value (a window or group); a group's
+    // name or snapshot description in text.
+    J_WINDOW_CLOSE,         // window `value` and its tabs
+    J_GROUP_CREATE,         // group `value` in window `tabId`, named `text`
+    J_GROUP_SET,            // tab `tabId` into group `value`, 0 for none
+    J_GROUP_CLOSE,          // group `value` and its tabs
+    J_GROUP_MOVE,           // group `value` to window `tabId`
+    J_SCOPED_SNAPSHOT       // snapshot of window `tabId`, or of group `value` when set
+};
+
+// One state change. Fields an op does not need are left at their defaults.
+struct JournalEntry {
+    JournalOp op;
+    uint64_t sequence;
+    int32_t tabId;
+    int64_t timestamp;
+    int32_t value;          // restore index, 1 for an automatic snapshot, or a window/group id
+    string text, extra;     // url/title, or snapshot description
+
+    JournalEntry(JournalOp o, int32_t tab = 0, int64_t ts = 0, int32_t v = 0,
+                 string_view t = "", string_view e = "")
+        : op(o), sequence(0), tabId(tab), timestamp(ts), value(v), text(t), extra(e) {}
+};
+
+// Append-only write-ahead log of JournalEntry records.
+// Each record is [uint32 length][payload][uint64 checksum]; replay stops at
+// the first short or damaged record and cuts the file back to it. Records
+// are buffered and written with one fsync per SYNC_BATCH records or every
+// SYNC_INTERVAL_MS, whichever comes first, and on sync(). A flusher thread
+// writes whatever is still buffered once the interval has passed, so records
+// do not sit in memory while the browser is idle.
+//
+// append() may be called from several threads. Records are numbered and
+// buffered under `lock`; a batch is written under `io`, which is taken before
+// `lock` is released so batches reach the file in sequence order while the
+// next records keep buffering. open(), reset() and close() need a quiet journal.
+class Journal {
+private:
+    FILE* file;
+    string path;
+    mutex lock, io;
+    vector<char> pending;
+    size_t pendingRecords, bytesOnDisk;
+    uint64_t lastSequence;
+    chrono::steady_clock::time_point lastSync;
+    condition_variable buffered;        // pending has records, or stopping
+    bool stopping;
+    thread flusher;
+
+    template <class T>
+    static void put(vector<char>& out, T value) {
+        out.insert(out.end(), (const char*)&value, (const char*)&value + sizeof(value));
+    }
+
+    static void putString(vector<char>& out, const string& s) {
+        put<uint32_t>(out, s.size());
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    template <class T>
+    static bool get(const char*& p, const char* end, T& value) {
+        if (end - p < (ptrdiff_t)sizeof(T)) return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    static bool getString(const char*& p, const char* end, string& s) {
+        uint32_t length;
+        if (!get(p, end, length) || end - p < (ptrdiff_t)length) return false;
+        s.assign(p, length);
+        p += length;
+        return true;
+    }
+
+    static bool decode(const char* p, const char* end, JournalEntry& e) {
+        uint8_t op;
+        if (!get(p, end, op) || !get(p, end, e.sequence) || !get(p, end, e.tabId) ||
+            !get(p, end, e.timestamp) || !get(p, end, e.value) ||
+            !getString(p, end, e.text) || !getString(p, end, e.extra))
+            return false;
+        e.op = (JournalOp)op;
+        return p == end;
+    }
+
+    // Called with `lock` held; returns with it released.
+    void writePending(unique_lock<mutex>& held, bool durable) {
+        if (!file || pending.empty()) {
+            held.unlock();
+            return;
+        }
+        vector<char> batch;
+        batch.swap(pending);
+        pendingRecords = 0;
+        bytesOnDisk += batch.size();
+        lastSync = chrono::steady_clock::now();
+        lock_guard<mutex> writing(io);
+        held.unlock();
+        fwrite(batch.data(), 1, batch.size(), file);
+        fflush(file);
+        if (durable) {
+#ifdef _WIN32
+            _commit(_fileno(file));
+#else
+            fsync(fileno(file));
+#endif
+        }
+    }
+
+    // Writes the pending records SYNC_INTERVAL_MS after the last write.
+    void flushIdle() {
+        unique_lock<mutex> held(lock);
+        while (!stopping) {
+            auto due = lastSync + chrono::milliseconds(SYNC_INTERVAL_MS);
+            if (pending.empty())
+                buffered.wait(held);
+            else if (chrono::steady_clock::now() < due)
+                buffered.wait_until(held, due);
+            else {
+                writePending(held, true);
+                held.lock();
+            }
+        }
+    }
+
+public:
+    static constexpr size_t SYNC_BATCH = 32;
+    static constexpr int SYNC_INTERVAL_MS = 1000;
+
+    Journal() : file(nullptr), pendingRecords(0), bytesOnDisk(0), lastSequence(0), stopping(false) {}
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal() { close(); }
+
+    // Replays every intact record newer than `applied` through `apply`, then
+    // reopens the file for appending after the last intact record.
+    void open(const string& journalPath, uint64_t applied, const function<void(const JournalEntry&)>& apply) {
+        close();
+        path = journalPath;
+        lastSequence = applied;
+        vector<char> data;
+        if (FILE* in = fopen(path.c_str(), "rb")) {
+            char buffer[64 * 1024];
+            size_t n;
+            while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) data.insert(data.end(), buffer, buffer + n);
+            fclose(in);
+        }
+
+        size_t good = 0;
+        while (good + sizeof(uint32_t) <= data.size()) {
+            uint32_t length;
+            memcpy(&length, data.data() + good, sizeof(length));
+            size_t payload = good + sizeof(length);
+            if (data.size() - payload < (size_t)length + sizeof(uint64_t)) break;
+            uint64_t checksum;
+            memcpy(&checksum, data.data() + payload + length, sizeof(checksum));
+            if (stateChecksum(data.data() + payload, length) != checksum) break;
+            JournalEntry e(J_VISIT);
+            if (!decode(data.data() + payload, data.data() + payload + length, e)) break;
+            if (e.sequence > lastSequence) {
+                apply(e);
+                lastSequence = e.sequence;
+            }
+            good = payload + length + sizeof(checksum);
+        }
+
+        // Rewrite only the intact prefix so a torn tail is never appended after.
+        if (good != data.size()) {
+            FILE* out = fopen(path.c_str(), "wb");
+            if (out) {
+                fwrite(data.data(), 1, good, out);
+                fclose(out);
+            }
+        }
+        file = fopen(path.c_str(), "ab");
+        bytesOnDisk = good;
+        lastSync = chrono::steady_clock::now();
+        stopping = false;
+        flusher = thread([this] { flushIdle(); });
+    }
+
+    uint64_t append(JournalEntry e) {
+        unique_lock<mutex> held(lock);
+        e.sequence = ++lastSequence;
+        vector<char> payload;
+        put<uint8_t>(payload, e.op);
+        put(payload, e.sequence);
+        put(payload, e.tabId);
+        put(payload, e.timestamp);
+        put(payload, e.value);
+        putString(payload, e.text);
+        putString(payload, e.extra);
+        put<uint32_t>(pending, payload.size());
+        pending.insert(pending.end(), payload.begin(), payload.end());
+        put(pending, stateChecksum(payload.data(), payload.size()));
+        if (++pendingRecords == 1) buffered.notify_one();
+        if (pendingRecords >= SYNC_BATCH ||
+            chrono::steady_clock::now() - lastSync >= chrono::milliseconds(SYNC_INTERVAL_MS))
+            writePending(held, true);
+        return e.sequence;
+    }
+
+    void sync() {
+        unique_lock<mutex> held(lock);
+        writePending(held, true);
+    }
+
+    // Empties the journal once its records are part of the state file.
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        lock_guard<mutex> writing(io);
+        pending.clear();
+        pendingRecords = 0;
+        if (file) fclose(file);
+        file = fopen(path.c_str(), "wb");
+        bytesOnDisk = 0;
+    }
+
+    void close() {
+        if (flusher.joinable()) {
+            {
+                lock_guard<mutex> guard(lock);
+                stopping = true;
+            }
+            buffered.notify_one();
+            flusher.join();
+        }
+        sync();
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+    uint64_t sequence() {
+        lock_guard<mutex> guard(lock);
+        return lastSequence;
+    }
+
+    size_t size() {
+        lock_guard<mutex> guard(lock);
+        return bytesOnDisk + pending.size();
+    }
+};
+
+#endif
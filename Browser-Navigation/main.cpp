@@ -1,7 +1,56 @@
 #include "browser.h"
+#include "modelCheck.h"
+#include "replayDriver.h"
 
-int main() {
-    Browser browser;
+// Usage: browser [--profile DIR] [--depth PAGES] [--quiet] [--replay TRACE] [--check SEED [--ops N]]
+// Without --replay or --check the interactive menu runs; see replayDriver.h for
+// the trace format and modelCheck.h for what --check verifies. --depth is the
+// number of pages each tab keeps for back and forward.
+int main(int argc, char** argv) {
+    string tracePath, statePath, journalPath, checkSeed;
+    size_t checkOps = 1000000, depth = NavigationRing::DEFAULT_DEPTH;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--quiet") quiet = true;
+        else if (arg == "--replay" && i + 1 < argc) tracePath = argv[++i];
+        else if (arg == "--check" && i + 1 < argc) checkSeed = argv[++i];
+        else if (arg == "--ops" && i + 1 < argc) checkOps = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--depth" && i + 1 < argc) depth = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--profile" && i + 1 < argc) {
+            string dir = argv[++i];
+            statePath = dir + "/state.bin";
+            journalPath = dir + "/journal.bin";
+            FileManager::STATE_PATH = statePath.c_str();
+            FileManager::JOURNAL_PATH = journalPath.c_str();
+        } else {
+            cerr << "Usage: " << argv[0] << " [--profile DIR] [--depth PAGES] [--quiet] [--replay TRACE] [--check SEED [--ops N]]\n";
+            return 2;
+        }
+    }
+
+    if (!checkSeed.empty()) {
+        uint32_t seed = (uint32_t)strtoul(checkSeed.c_str(), nullptr, 10);
+        string dir = (filesystem::temp_directory_path() / ("browser-check-" + checkSeed)).string();
+        bool ok = ModelCheck::run(seed, checkOps, checkOps / 1000 + 1, dir);
+        filesystem::remove_all(dir);
+        return ok ? 0 : 1;
+    }
+
+    if (!tracePath.empty()) {
+        vector<TraceEntry> trace;
+        size_t badLine;
+        if (!ReplayDriver::load(tracePath, trace, badLine)) {
+            if (badLine) cerr << tracePath << ":" << badLine << ": malformed trace line\n";
+            else cerr << "Cannot read " << tracePath << "\n";
+            return 1;
+        }
+        Browser browser(quiet, depth);
+        ReplayDriver::run(browser, trace);
+        return 0;
+    }
+
+    Browser browser(quiet, depth);
     int choice;
     string url, title;
 
@@ -11,7 +60,12 @@ int main() {
         cout << "5.  View Bookmarks  \n6.  History  \n7.  Most Visited  \n8.  Current\n";
         cout << "9.  New Tab  \n10. View Tabs  \n11. Switch Tab  \n12. Close Tab\n";
         cout << "13. Save Session  \n14. Session History  \n15. Restore Session\n";
-        cout<< "16. Search Bookmark \n";
+        cout<< "16. Search Bookmark \n17. Search History & Bookmarks\n";
+        cout << "18. Top Sites  \n19. Top Pages on Site\n";
+        cout << "20. Recent History  \n21. History Since  \n22. Clear Old History\n";
+        cout << "23. New Window  \n24. Switch Window  \n25. Group Tab  \n26. Close Group\n";
+        cout << "27. Move Group  \n28. Save Group Snapshot  \n29. Save Window Snapshot\n";
+        cout << "30. Tab Memory  \n31. Hibernate Tabs\n";
         cout << "0. Exit \nChoice: ";
         cin >> choice;
         cin.ignore();
@@ -55,6 +109,80 @@ int main() {
                 getline(cin, title);
                 browser.searchBookmarks(title);  // Binary Search applied
                 break;
+            case 17: cout << "Search: ";
+                getline(cin, title);
+                browser.search(title);
+                break;
+            case 18: browser.showTopDomains(); break;
+            case 19: cout << "Site: ";
+                getline(cin, url);
+                browser.showTopPagesIn(url);
+                break;
+            case 20: {
+                int count;
+                cout << "Number of visits: ";
+                cin >> count;
+                browser.viewRecentHistory(count > 0 ? count : 0);
+                break;
+            }
+            case 21: {
+                int hours;
+                cout << "Hours back: ";
+                cin >> hours;
+                browser.viewHistorySince(time(nullptr) - (time_t)hours * 3600);
+                break;
+            }
+            case 22: {
+                int days;
+                cout << "Remove visits older than (days): ";
+                cin >> days;
+                browser.clearHistoryBefore(time(nullptr) - (time_t)days * 86400);
+                break;
+            }
+            case 23: browser.newWindow(); break;
+            case 24: {
+                int id;
+                cout << "Window: ";
+                cin >> id;
+                browser.switchWindow(id);
+                break;
+            }
+            case 25: cout << "Group name: ";
+                getline(cin, title);
+                browser.groupCurrentTab(title);
+                break;
+            case 26: {
+                int id;
+                cout << "Group: ";
+                cin >> id;
+                browser.closeTabGroup(id);
+                break;
+            }
+            case 27: {
+                int id, windowId;
+                cout << "Group: ";
+                cin >> id;
+                cout << "To window (0 for a new one): ";
+                cin >> windowId;
+                browser.moveTabGroup(id, windowId);
+                break;
+            }
+            case 28: {
+                int id;
+                cout << "Group: ";
+                cin >> id;
+                cin.ignore();
+                cout << "Enter session description: ";
+                getline(cin, title);
+                browser.saveGroupSession(id, title);
+                break;
+            }
+            case 29: cout << "Enter session description: ";
+                getline(cin, title);
+                browser.saveWindowSession(title);
+                break;
+            case 30: browser.viewTabMemory(); break;
+            case 31: browser.hibernateAllTabs(); break;
 
             case 0:
                 cout << "\n Saving data... Exiting safely!\n";
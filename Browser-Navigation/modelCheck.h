@@ -0,0 +1,1166 @@
+#ifndef MODELCHECK_H
+#define MODELCHECK_H
+
+#include "browser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Headless self-check of navigation and persistence, for CI and for reworking
+// the hot paths:
+//  - A seeded random sequence of tab-id operations runs against a Browser and
+//    against a plain reference model. Every return value and the observable
+//    state are compared: tabs in order, the selected tab, each tab's current
+//    page, windows and groups with their tab order, recent history, history
+//    pages and time ranges, bookmarks and the saved sessions. The operations
+//    include windows and groups, snapshots of the session, a window or a
+//    group (automatic ones replacing each other) with whole and scoped
+//    restores, and history expiry. Along the way the Browser is hibernated,
+//    compacted and reloaded from disk, in turn from the journal alone, after
+//    random compactions and straight after a compaction. Each reload starts
+//    over with empty string pools, as a new process would, and after a
+//    compaction every tab with pages has to come back as a stub.
+//  - URLs are written in random forms, with ports of either scheme, and the
+//    model keeps them in canonical form, so canonicalization is checked as
+//    well; canonicalizing a canonical URL, or address-like junk twice, must
+//    not change it again.
+//  - Titles carry commas, arrows, quotes and non-ASCII text.
+//  - The startup parsers are fed mutated input. Mutated legacy text files
+//    must import and then survive a save/load round trip unchanged. A
+//    mutated journal and a state file with a damaged or truncated header
+//    must load without crashing.
+//  - Each binary loader is fed a damaged section body inside an otherwise
+//    valid file, with every checksum recomputed, since the section
+//    checksums are only verified off the startup path. The loader must read
+//    it without touching memory it should not, and a browser started on it
+//    must come up and compact into a file that loads again.
+//  - The spill file for hibernated tabs gets random writes, reads and drops,
+//    checked against a plain map, while one write stays live throughout. It
+//    must give back every live write intact and never grow past twice the
+//    bytes still spilled.
+// Everything runs in a scratch directory. A failing seed fails again the
+// same way; timestamps are never compared.
+class ModelCheck {
+private:
+    struct ModelPage {
+        string url, title;
+        time_t timestamp = 0;       // the browser's, for expiry and time ranges
+        bool operator==(const ModelPage& other) const { return url == other.url && title == other.title; }
+    };
+
+    struct ModelTab {
+        int id;
+        vector<ModelPage> pages;    // oldest to newest
+        size_t cursor = 0;
+        int window = 1, group = 0;
+        const ModelPage* current() const { return pages.empty() ? nullptr : &pages[cursor]; }
+    };
+
+    struct ModelGroup {
+        int window;
+        vector<int> tabs;           // in group order
+        int active = 0;
+    };
+
+    struct ModelSnapshot {
+        string description;
+        vector<ModelTab> tabs;
+        int window = 0, group = 0;  // both 0 for the whole session
+    };
+
+    // Tab count is bounded so snapshots and compaction stay cheap in long runs.
+    static constexpr size_t SITES = 60, MAX_TABS = 24, RELOAD_EVERY = 5000, HISTORY_CHECKED = 64, MAX_SNAPSHOTS = 20;
+
+    mt19937 rng;
+    unique_ptr<Browser> browser;
+    vector<ModelTab> tabs;          // window by window, each in its tab order
+    vector<int> windows;            // in order
+    map<int, int> windowActive;     // each window's active tab, 0 for none
+    map<int, ModelGroup> groups;
+    int current = 1, nextId = 2, nextWindow = 2, nextGroup = 1;
+    size_t depth = NavigationRing::DEFAULT_DEPTH;   // pages per tab, for the whole run
+    vector<ModelPage> history;      // expired visits included
+    size_t historyStart = 0;        // the first visit not expired
+    map<string, string> bookmarks;  // canonical url -> title
+    deque<ModelSnapshot> snapshots;
+    bool lastAutomatic = false;     // whether the latest snapshot was automatic
+    size_t step = 0;
+    string failure;
+
+    explicit ModelCheck(uint32_t seed) : rng(seed) {}
+
+    size_t pick(size_t n) { return rng() % n; }
+
+    bool expect(bool ok, const string& what) {
+        if (!ok && failure.empty()) failure = "step " + to_string(step) + ": " + what;
+        return ok;
+    }
+
+    // ------------------ Generated input ------------------
+    // Site i in canonical form: host, optional path, optional query with
+    // distinct parameter names in order.
+    static string canonicalSite(size_t i, vector<string>& params) {
+        params.clear();
+        if (i % 3 == 0) params = {"a=1", "b=" + to_string(i)};
+        if (i % 7 == 0) params = {"id=" + to_string(i), "q=x%2Cy", "z="};
+        string url = (i % 5 == 0 ? "x.org" : "s" + to_string(i % 23) + ".example.com") +
+                     (i % 4 ? "/p" + to_string(i) : "");
+        for (size_t k = 0; k < params.size(); k++) url += (k ? "&" : "?") + params[k];
+        return url;
+    }
+
+    // The same site as a user or a link might write it. A port that is not
+    // the default for the scheme makes it another address: `canonical` then
+    // keeps the port, and https keeps its scheme.
+    string variant(size_t i, string& canonical) {
+        static const char* schemes[] = {"", "http://", "https://", "HTTPS://"};
+        static const char* ports[] = {":80", ":443", ":8080"};
+        vector<string> params;
+        canonical = canonicalSite(i, params);
+        string address = canonical.substr(0, canonical.find('?'));
+        size_t slash = address.find('/');
+        string host = address.substr(0, slash), path = slash == string::npos ? "" : address.substr(slash);
+        size_t hostLength = host.size();
+        for (char& c : host)
+            if (pick(4) == 0 && c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        size_t scheme = pick(4);
+        string url = schemes[scheme] + host;
+        if (pick(5) == 0) {
+            string port = ports[pick(3)];
+            url += port;
+            if (port != (scheme < 2 ? ":80" : ":443")) canonical = (scheme < 2 ? "" : "https://") + canonical.insert(hostLength, port);
+        }
+        url += path;
+        if (pick(3) == 0) url += "/";
+        shuffle(params.begin(), params.end(), rng);
+        for (size_t k = 0; k < params.size(); k++) url += (k ? (pick(6) ? "&" : "&&") : "?") + params[k];
+        if (pick(8) == 0) url = " " + url + "  ";
+        return url;
+    }
+
+    string variant(size_t i) {
+        string canonical;
+        return variant(i, canonical);
+    }
+
+    // Canonical URLs map to themselves.
+    bool fixedPoint(const string& url) {
+        string once, twice;
+        canonicalizeUrl(url, once);
+        canonicalizeUrl(once, twice);
+        return expect(twice == once, "\"" + url + "\" canonicalizes to \"" + once + "\", then to \"" + twice + "\"");
+    }
+
+    // Address-like junk for fixedPoint: schemes, ports, user info and
+    // separators in any order.
+    string junkUrl() {
+        static const char* PIECES[] = {"http://", "HTTPS://", "ws://", "mailto:", "a", "B.", "com", ":", ":80", ":443",
+                                       "8080", "/", "?", "&", "=", "#", "@", " ", "//", "%2C"};
+        string url;
+        for (size_t n = 1 + pick(8); n > 0; n--) url += PIECES[pick(20)];
+        return url;
+    }
+
+    string title() {
+        static const char* titles[] = {"Home", "News, weather & sport", "Caf\xC3\xA9 \xC3\xB1" "and\xC3\xBA",
+                                       "a -> b", "", "\"Quoted\", with commas,", "TAB:1", "100% done"};
+        return titles[pick(8)] + (pick(2) ? " " + to_string(pick(50)) : "");
+    }
+
+    // An open tab most of the time, otherwise an id that is not.
+    int someTab() {
+        if (pick(12) == 0) return pick(2) ? nextId + 7 : -1;
+        return tabs[pick(tabs.size())].id;
+    }
+
+    // Likewise for windows and groups; 0 is never one.
+    int someWindow() {
+        if (pick(10) == 0) return pick(2) ? nextWindow + 3 : 0;
+        return windows[pick(windows.size())];
+    }
+
+    int someGroup() {
+        if (groups.empty() || pick(10) == 0) return pick(2) ? nextGroup + 3 : 0;
+        auto it = groups.begin();
+        advance(it, pick(groups.size()));
+        return it->first;
+    }
+
+    static bool same(const Page& p, const ModelPage* m) {
+        if (!m) return p.empty();
+        return p.url() == m->url && p.title() == m->title;
+    }
+
+    // ------------------ Tabs, windows and groups ------------------
+    // As TabTable keeps them: a tab that leaves a window or group hands its
+    // active role to the next tab there, or the previous one at the end.
+    ModelTab* modelTab(int id) {
+        for (auto& t : tabs)
+            if (t.id == id) return &t;
+        return nullptr;
+    }
+
+    vector<int> windowTabs(int window) const {
+        vector<int> ids;
+        for (auto& t : tabs)
+            if (t.window == window) ids.push_back(t.id);
+        return ids;
+    }
+
+    static void handOff(int& active, const vector<int>& chain, int id) {
+        if (active != id) return;
+        size_t at = find(chain.begin(), chain.end(), id) - chain.begin();
+        active = at + 1 < chain.size() ? chain[at + 1] : at > 0 ? chain[at - 1] : 0;
+    }
+
+    void leaveGroup(ModelTab& t) {
+        if (!t.group) return;
+        ModelGroup& g = groups.at(t.group);
+        handOff(g.active, g.tabs, t.id);
+        g.tabs.erase(find(g.tabs.begin(), g.tabs.end(), t.id));
+        t.group = 0;
+    }
+
+    void joinGroup(ModelTab& t, int groupId) {
+        ModelGroup& g = groups.at(groupId);
+        g.tabs.push_back(t.id);
+        if (!g.active) g.active = t.id;
+        t.group = groupId;
+    }
+
+    // Out of its window's tab order; the group is left to the caller.
+    ModelTab unlinkTab(int id) {
+        auto it = find_if(tabs.begin(), tabs.end(), [&](const ModelTab& t) { return t.id == id; });
+        handOff(windowActive[it->window], windowTabs(it->window), id);
+        ModelTab t = std::move(*it);
+        tabs.erase(it);
+        return t;
+    }
+
+    // At the end of a window, opened if new.
+    void linkTab(ModelTab t, int window) {
+        if (!windowActive.count(window)) {
+            windows.push_back(window);
+            windowActive[window] = 0;
+        }
+        t.window = window;
+        if (!windowActive[window]) windowActive[window] = t.id;
+        size_t at = 0;
+        for (int w : windows) {
+            at += windowTabs(w).size();
+            if (w == window) break;
+        }
+        tabs.insert(tabs.begin() + at, std::move(t));
+    }
+
+    // TabTable::open and close: the group only if it is in that window.
+    void openTab(int id, int window, int groupId) {
+        linkTab({id, {}, 0}, window);
+        auto g = groups.find(groupId);
+        if (g != groups.end() && g->second.window == window) joinGroup(*modelTab(id), groupId);
+    }
+
+    void closeTab(int id) {
+        leaveGroup(*modelTab(id));
+        unlinkTab(id);
+    }
+
+    void setCurrent(int id) {
+        current = id;
+        ModelTab* t = modelTab(id);
+        windowActive[t->window] = id;
+        if (t->group) groups.at(t->group).active = id;
+    }
+
+    int currentWindow() {
+        ModelTab* t = modelTab(current);
+        return t ? t->window : windows.empty() ? 1 : windows[0];
+    }
+
+    void dropIfEmpty(int window) {
+        if (!windowActive.count(window) || !windowTabs(window).empty() || windows.size() == 1) return;
+        windows.erase(find(windows.begin(), windows.end(), window));
+        windowActive.erase(window);
+    }
+
+    void removeIfEmpty(int groupId) {
+        auto g = groups.find(groupId);
+        if (g != groups.end() && g->second.tabs.empty()) groups.erase(g);
+    }
+
+    int fallbackTab(int window) {
+        if (!windowActive.count(window) || windowTabs(window).empty()) window = windows[0];
+        return windowActive[window];
+    }
+
+    // What Browser::applyTabOpen, applyTabClose, applyGroupSet and
+    // applyRestore do to the model.
+    void applyTabOpen(int id, int window) {
+        openTab(id, window, 0);
+        setCurrent(id);
+        nextId = max(nextId, id + 1);
+        nextWindow = max(nextWindow, window + 1);
+    }
+
+    void applyTabClose(int id) {
+        ModelTab* t = modelTab(id);
+        int window = t->window, groupId = t->group;
+        closeTab(id);
+        if (groupId) removeIfEmpty(groupId);
+        dropIfEmpty(window);
+        if (id == current) setCurrent(fallbackTab(window));
+    }
+
+    void applyGroupSet(int id, int groupId) {
+        ModelTab* t = modelTab(id);
+        int oldGroup = t->group, oldWindow = t->window;
+        if (oldGroup != groupId) {
+            leaveGroup(*t);
+            if (groupId) {
+                int window = groups.at(groupId).window;
+                if (t->window != window) linkTab(unlinkTab(id), window);
+                joinGroup(*modelTab(id), groupId);
+            }
+        }
+        if (oldGroup) removeIfEmpty(oldGroup);
+        dropIfEmpty(oldWindow);
+        if (id == current) setCurrent(id);
+    }
+
+    void applyRestore(const ModelSnapshot& snapshot) {
+        int window = snapshot.window, groupId = snapshot.group;
+        bool scoped = window || groupId;
+        vector<int> left;
+        int replaced = current;     // the browser holds on to a handle, which a reopened id does not revive
+        if (groupId) {
+            auto g = groups.find(groupId);
+            if (g != groups.end())
+                window = g->second.window;
+            else {
+                if (!windowActive.count(window)) window = currentWindow();
+                groups[groupId] = {window, {}, 0};
+                nextGroup = max(nextGroup, groupId + 1);
+            }
+            left.push_back(groupId);
+            for (int id : vector<int>(groups.at(groupId).tabs)) {
+                if (id == current) replaced = 0;
+                closeTab(id);
+            }
+        } else if (window) {
+            for (int id : windowTabs(window)) {
+                if (id == current) replaced = 0;
+                left.push_back(modelTab(id)->group);
+                closeTab(id);
+            }
+        } else {
+            window = currentWindow();
+            for (auto& g : groups) left.push_back(g.first);
+            while (!tabs.empty()) closeTab(tabs.front().id);
+        }
+        for (auto& record : snapshot.tabs) {
+            int id = scoped && modelTab(record.id) ? nextId : record.id;
+            int w = scoped || !record.window ? window : record.window;
+            openTab(id, w, groupId ? groupId : record.group);
+            ModelTab* t = modelTab(id);
+            t->pages = record.pages;
+            t->cursor = record.cursor;
+            nextId = max(nextId, id + 1);
+            nextWindow = max(nextWindow, w + 1);
+        }
+        for (int id : left)
+            if (id) removeIfEmpty(id);
+        if (scoped) {
+            dropIfEmpty(window);
+            if (!replaced && !tabs.empty()) setCurrent(fallbackTab(window));
+        } else {
+            for (int id : vector<int>(windows)) dropIfEmpty(id);
+            setCurrent(tabs[0].id);
+        }
+        if (tabs.empty()) applyTabOpen(nextId, currentWindow());
+    }
+
+    // Automatic snapshots replace an automatic one before them; a run never
+    // spends Browser::SNAPSHOT_INTERVAL between two.
+    void addSnapshot(ModelSnapshot snapshot, bool automatic) {
+        if (automatic && lastAutomatic && !snapshots.empty())
+            snapshots.back() = std::move(snapshot);
+        else
+            snapshots.push_back(std::move(snapshot));
+        while (snapshots.size() > MAX_SNAPSHOTS) snapshots.pop_front();
+        lastAutomatic = automatic;
+    }
+
+    // ------------------ Operations ------------------
+    void visit() {
+        int id = someTab();
+        size_t site = pick(SITES);
+        ModelPage page;
+        string url = variant(site, page.url);
+        page.title = title();
+        if (!fixedPoint(url) || !fixedPoint(junkUrl())) return;
+        bool done = browser->visitPage(id, url, page.title);
+        ModelTab* t = modelTab(id);
+        if (!expect(done == (t != nullptr), "visitPage(" + to_string(id) + ") returned " + to_string(done)) || !t)
+            return;
+        page.timestamp = browser->currentPage(id).timestamp;
+        if (!t->pages.empty()) t->pages.resize(t->cursor + 1);
+        if (t->pages.size() == depth) t->pages.erase(t->pages.begin());
+        t->pages.push_back(page);
+        t->cursor = t->pages.size() - 1;
+        history.push_back(page);
+        expect(same(browser->currentPage(id), t->current()), "visited page in tab " + to_string(id));
+    }
+
+    void move(bool back) {
+        int id = someTab();
+        bool done = back ? browser->goBack(id) : browser->goForward(id);
+        ModelTab* t = modelTab(id);
+        bool possible = t && !t->pages.empty() && (back ? t->cursor > 0 : t->cursor + 1 < t->pages.size());
+        if (!expect(done == possible, string(back ? "goBack(" : "goForward(") + to_string(id) + ") returned " + to_string(done)) ||
+            !possible)
+            return;
+        t->cursor += back ? -1 : 1;
+        expect(same(browser->currentPage(id), t->current()), "page after moving in tab " + to_string(id));
+    }
+
+    void openTab() {
+        int id = browser->openTab();
+        expect(id == nextId, "openTab() gave " + to_string(id) + ", expected " + to_string(nextId));
+        applyTabOpen(nextId, currentWindow());
+    }
+
+    // Closing the selected tab selects the window's next tab, or the one
+    // before it at the end.
+    void closeTab() {
+        int id = someTab();
+        bool done = browser->closeTab(id);
+        bool possible = modelTab(id) && tabs.size() > 1;
+        if (expect(done == possible, "closeTab(" + to_string(id) + ") returned " + to_string(done)) && possible)
+            applyTabClose(id);
+    }
+
+    void selectTab() {
+        int id = someTab();
+        bool done = browser->selectTab(id);
+        bool possible = modelTab(id) != nullptr;
+        if (expect(done == possible, "selectTab(" + to_string(id) + ") returned " + to_string(done)) && possible)
+            setCurrent(id);
+    }
+
+    void addBookmark() {
+        int id = someTab();
+        bool done = browser->addBookmark(id);
+        ModelTab* t = modelTab(id);
+        const ModelPage* page = t ? t->current() : nullptr;
+        if (expect(done == (page != nullptr), "addBookmark(" + to_string(id) + ") returned " + to_string(done)) && page)
+            bookmarks[page->url] = page->title;
+    }
+
+    void openWindow() {
+        int window = browser->openWindow();
+        expect(window == nextWindow, "openWindow() gave " + to_string(window) + ", expected " + to_string(nextWindow));
+        applyTabOpen(nextId, nextWindow);
+    }
+
+    void selectWindow() {
+        int window = someWindow();
+        bool done = browser->selectWindow(window);
+        bool possible = windowActive.count(window) && windowActive[window];
+        if (expect(done == possible, "selectWindow(" + to_string(window) + ") returned " + to_string(done)) && possible)
+            setCurrent(windowActive[window]);
+    }
+
+    void closeWindow() {
+        int window = someWindow();
+        bool done = browser->closeWindow(window);
+        bool possible = windowActive.count(window) && windows.size() > 1;
+        if (!expect(done == possible, "closeWindow(" + to_string(window) + ") returned " + to_string(done)) || !possible)
+            return;
+        for (int id : windowTabs(window)) applyTabClose(id);
+    }
+
+    void createGroup() {
+        int id = someTab();
+        int groupId = browser->createGroup(id, "Group " + to_string(step));
+        ModelTab* t = modelTab(id);
+        int expected = t ? nextGroup : 0;
+        if (!expect(groupId == expected, "createGroup(" + to_string(id) + ") gave " + to_string(groupId) + ", expected " +
+                                             to_string(expected)) || !t)
+            return;
+        groups[groupId] = {t->window, {}, 0};
+        nextGroup = groupId + 1;
+        applyGroupSet(id, groupId);
+    }
+
+    void setTabGroup() {
+        int id = someTab(), groupId = pick(4) ? someGroup() : 0;
+        bool done = browser->setTabGroup(id, groupId);
+        bool possible = modelTab(id) && (!groupId || groups.count(groupId));
+        if (expect(done == possible, "setTabGroup(" + to_string(id) + ", " + to_string(groupId) + ") returned " +
+                                         to_string(done)) && possible)
+            applyGroupSet(id, groupId);
+    }
+
+    void closeGroup() {
+        int groupId = someGroup();
+        bool done = browser->closeGroup(groupId);
+        auto g = groups.find(groupId);
+        bool possible = g != groups.end() && g->second.tabs.size() != tabs.size();
+        if (!expect(done == possible, "closeGroup(" + to_string(groupId) + ") returned " + to_string(done)) || !possible)
+            return;
+        for (int id : vector<int>(g->second.tabs)) applyTabClose(id);
+        removeIfEmpty(groupId);
+    }
+
+    void moveGroup() {
+        int groupId = someGroup(), window = pick(3) ? someWindow() : 0;     // 0 for a new window
+        int moved = browser->moveGroup(groupId, window);
+        int to = window ? window : nextWindow;
+        auto g = groups.find(groupId);
+        bool possible = g != groups.end() && g->second.window != to;
+        if (!expect(moved == (possible ? to : 0), "moveGroup(" + to_string(groupId) + ", " + to_string(window) + ") gave " +
+                                                      to_string(moved)) || !possible)
+            return;
+        int from = g->second.window;
+        if (!windowActive.count(to)) {
+            windows.push_back(to);
+            windowActive[to] = 0;
+        }
+        nextWindow = max(nextWindow, to + 1);
+        for (int id : g->second.tabs) linkTab(unlinkTab(id), to);
+        g->second.window = to;
+        dropIfEmpty(from);
+        setCurrent(current);
+    }
+
+    // Of the whole session, the current window or a group.
+    void saveSnapshot() {
+        ModelSnapshot snapshot = {"Snapshot " + to_string(step), {}, 0, 0};
+        size_t kind = pick(3);
+        if (kind == 0) {
+            browser->saveSession(snapshot.description);
+            snapshot.tabs = tabs;
+        } else if (kind == 1) {
+            browser->saveWindowSession(snapshot.description);
+            snapshot.window = currentWindow();
+            for (int id : windowTabs(snapshot.window)) snapshot.tabs.push_back(*modelTab(id));
+        } else {
+            int groupId = someGroup();
+            bool done = browser->saveGroupSession(groupId, snapshot.description);
+            auto g = groups.find(groupId);
+            if (!expect(done == (g != groups.end()), "saveGroupSession(" + to_string(groupId) + ") returned " +
+                                                         to_string(done)) || g == groups.end())
+                return;
+            snapshot.window = g->second.window;
+            snapshot.group = groupId;
+            for (int id : g->second.tabs) snapshot.tabs.push_back(*modelTab(id));
+        }
+        addSnapshot(std::move(snapshot), false);
+    }
+
+    void restoreSnapshot() {
+        int index = (int)pick(snapshots.size() + 2) - 1;
+        bool done = browser->restoreSession(index);
+        bool possible = index >= 0 && (size_t)index < snapshots.size();
+        if (expect(done == possible, "restoreSession(" + to_string(index) + ") returned " + to_string(done)) && possible)
+            applyRestore(ModelSnapshot(snapshots[index]));
+    }
+
+    // Up to a random visit, or none at all.
+    void expireHistory() {
+        size_t at = historyStart + pick(history.size() - historyStart + 1);
+        time_t before = at < history.size() ? history[at].timestamp : 0;
+        size_t dropped = browser->expireHistory(before);
+        size_t end = historyStart;
+        while (end < history.size() && history[end].timestamp < before) end++;
+        expect(dropped == end - historyStart, "expireHistory dropped " + to_string(dropped) + " visits, expected " +
+                                                  to_string(end - historyStart));
+        historyStart = end;
+    }
+
+    // One page of history at a random cursor, expired positions and
+    // positions past the end included.
+    void historyPage() {
+        size_t cursor = pick(4) == 0 ? Browser::NEWEST : pick(history.size() + 3), limit = 1 + pick(40);
+        HistoryPage page = browser->historyPage(cursor, limit);
+        size_t i = min(cursor, history.size()), n = 0;
+        for (; i > historyStart && n < limit; n++)
+            if (!expect(n < page.visits.size() && same(page.visits[n], &history[--i]),
+                        "history page at " + to_string(cursor) + ", visit " + to_string(n)))
+                return;
+        size_t next = i > historyStart ? i : 0;
+        expect(page.visits.size() == n && page.next == next, "history page at " + to_string(cursor) + ": " +
+                                                                 to_string(page.visits.size()) + " visits, next " +
+                                                                 to_string(page.next) + ", expected " + to_string(n) +
+                                                                 " and " + to_string(next));
+    }
+
+    // A time range between two visits, paged through: no visit in it may be
+    // missed or listed twice, wherever the pages break.
+    void historyRange(const string& when) {
+        static const size_t PAGES = 20;
+        size_t visible = history.size() - historyStart;
+        if (!visible) return;
+        time_t from = history[historyStart + pick(visible)].timestamp, to = history[historyStart + pick(visible)].timestamp;
+        if (from > to) swap(from, to);
+        if (pick(4) == 0) from = Browser::EARLIEST;
+        if (pick(4) == 0) to = Browser::LATEST;
+        size_t limit = 1 + pick(200), cursor = Browser::NEWEST;
+        vector<Page> listed;
+        bool ended = false;
+        for (size_t p = 0; p < PAGES && !ended; p++) {
+            HistoryPage page = browser->historyPage(cursor, limit, from, to);
+            listed.insert(listed.end(), page.visits.begin(), page.visits.end());
+            ended = page.next == 0;
+            cursor = page.next;
+        }
+        size_t n = 0;
+        for (size_t i = history.size(); i > historyStart && n <= listed.size(); i--) {
+            if (history[i - 1].timestamp < from || history[i - 1].timestamp > to) continue;
+            if (!expect(n < listed.size() ? same(listed[n], &history[i - 1]) : !ended,
+                        "visit " + to_string(n) + " of a time range " + when))
+                return;
+            n++;
+        }
+        expect(n >= listed.size(), "time range " + when + " listed " + to_string(listed.size()) + " visits of " + to_string(n));
+    }
+
+    // As a new process would: the pools start empty, so state.bin is
+    // attached in place and its tabs come back as stubs. The browser takes an
+    // automatic snapshot on the way out.
+    void reload() {
+        browser.reset();
+        addSnapshot({"Auto-saved on exit", tabs, 0, 0}, true);
+        startOver();
+        browser.reset(new Browser(true, depth));
+    }
+
+    size_t stubTabs() {
+        for (auto& s : browser->sizes())
+            if (s.first == "stub tabs") return s.second;
+        return 0;
+    }
+
+    // ------------------ Observable state ------------------
+    void compare(const string& when) {
+        vector<int> ids;
+        for (auto& t : tabs) ids.push_back(t.id);
+        if (!expect(browser->tabIds() == ids, "tab ids " + when)) return;
+        expect(browser->selectedTab() == current, "selected tab " + when + ": " + to_string(browser->selectedTab()) +
+                                                      ", expected " + to_string(current));
+        for (auto& t : tabs)
+            if (!expect(same(browser->currentPage(t.id), t.current()), "current page of tab " + to_string(t.id) + " " + when))
+                return;
+        if (!expect(browser->windowIds() == windows, "windows " + when)) return;
+        for (int w : windows)
+            if (!expect(browser->windowTabIds(w) == windowTabs(w), "tabs of window " + to_string(w) + " " + when)) return;
+        for (int g = 1; g <= nextGroup; g++) {
+            auto it = groups.find(g);
+            if (!expect(browser->groupTabIds(g) == (it == groups.end() ? vector<int>() : it->second.tabs),
+                        "tabs of group " + to_string(g) + " " + when))
+                return;
+        }
+
+        size_t n = min(history.size() - historyStart, HISTORY_CHECKED);
+        vector<Page> recent = browser->recentVisits(n);
+        if (!expect(recent.size() == n, "history length " + when)) return;
+        for (size_t i = 0; i < n; i++)
+            if (!expect(same(recent[i], &history[history.size() - 1 - i]), "history entry -" + to_string(i + 1) + " " + when))
+                return;
+        historyPage();
+        historyRange(when);
+
+        vector<pair<string, string>> expected;
+        for (auto& b : bookmarks) expected.push_back({b.second, b.first});
+        sort(expected.begin(), expected.end());
+        vector<pair<string, string>> actual;
+        for (auto& p : browser->bookmarkList()) actual.push_back({string(p.title()), string(p.url())});
+        expect(actual == expected, "bookmarks " + when);
+
+        // Not every time, so snapshots are also taken and restored before the stored ones are loaded.
+        if (pick(2)) {
+            vector<string> descriptions;
+            for (auto& s : snapshots) descriptions.push_back(s.description);
+            expect(browser->sessionDescriptions() == descriptions, "snapshots " + when);
+        }
+    }
+
+    // Half the seeds run with short navigation rings, so tabs evict pages.
+    // Reloads cycle through three kinds: after a whole interval that was
+    // never compacted, so everything replays from the journal; after the
+    // odd compaction along the way; and right after a compaction, when every
+    // tab with pages has to come back as a stub.
+    bool runModel(size_t ops) {
+        depth = pick(2) ? NavigationRing::DEFAULT_DEPTH : 1 + pick(12);
+        startOver();
+        browser.reset(new Browser(true, depth));
+        tabs = {{1, {}, 0}};
+        windows = {1};
+        windowActive = {{1, 1}};
+        snapshots = {{"New tab created", tabs, 0, 0}};
+        lastAutomatic = true;
+        compare("at start");
+        for (step = 1; step <= ops && failure.empty(); step++) {
+            size_t kind = (step - 1) / RELOAD_EVERY % 3;
+            size_t r = pick(100);
+            if (r < 36) visit();
+            else if (r < 46) move(true);
+            else if (r < 53) move(false);
+            else if (r < 58 && tabs.size() < MAX_TABS) openTab();
+            else if (r < 63) closeTab();
+            else if (r < 68) selectTab();
+            else if (r < 72) addBookmark();
+            else if (r < 74 && tabs.size() < MAX_TABS) openWindow();
+            else if (r < 76) selectWindow();
+            else if (r < 77) closeWindow();
+            else if (r < 80) createGroup();
+            else if (r < 83) setTabGroup();
+            else if (r < 84) closeGroup();
+            else if (r < 86) moveGroup();
+            else if (r < 89) saveSnapshot();
+            else if (r < 91) restoreSnapshot();
+            else if (r < 93) historyPage();
+            else if (r < 94 && pick(20) == 0) expireHistory();
+            else if (r < 95) browser->hibernateTabs(0);
+            else if (r < 96 && kind == 1 && pick(20) == 0) browser->compact();
+            if (step % RELOAD_EVERY == 0) {
+                if (kind == 2) browser->compact();
+                compare("before reload");
+                reload();
+                size_t paged = count_if(tabs.begin(), tabs.end(), [](const ModelTab& t) { return !t.pages.empty(); });
+                if (kind == 2)
+                    expect(stubTabs() >= paged, to_string(stubTabs()) + " stub tabs after reload, expected " + to_string(paged));
+                compare("after reload");
+            }
+        }
+        if (failure.empty()) {
+            reload();
+            compare("after the final reload");
+        }
+        browser.reset();
+        return failure.empty();
+    }
+
+    // ------------------ Mutated input ------------------
+    static void writeFile(const string& path, const string& bytes) {
+        ofstream out(path, ios::binary | ios::trunc);
+        out << bytes;
+    }
+
+    static string readFile(const string& path) {
+        ifstream in(path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    // A few random byte-level edits, biased towards the separators the parsers split on.
+    string mutate(string bytes) {
+        static const string ALPHABET = ",:#\n-> 0123456789TABCURENSPHOTxyz\xFF";
+        size_t edits = 1 + pick(4);
+        for (size_t e = 0; e < edits; e++) {
+            size_t at = bytes.empty() ? 0 : pick(bytes.size() + 1);
+            switch (pick(5)) {
+                case 0: if (at < bytes.size()) bytes[at] = ALPHABET[pick(ALPHABET.size())]; break;
+                case 1: bytes.insert(at, 1, ALPHABET[pick(ALPHABET.size())]); break;
+                case 2: bytes.erase(at, 1 + pick(8)); break;
+                case 3: bytes.resize(at); break;
+                default: if (at < bytes.size()) bytes.insert(at, bytes.substr(at, 1 + pick(40))); break;
+            }
+        }
+        return bytes;
+    }
+
+    // Legacy text files in the format the importers read.
+    void writeLegacyProfile() {
+        string history, bookmarks, counts, tabs = to_string(pick(3)) + "\n" + to_string(4 + pick(3)) + "\n", sessions;
+        for (size_t i = 0; i < 20; i++) {
+            history += variant(pick(SITES)) + "," + title() + "\n";
+            if (i % 4 == 0) bookmarks += variant(pick(SITES)) + "," + title() + "\n";
+            if (i % 3 == 0) counts += variant(pick(SITES)) + "," + to_string(1 + pick(9)) + "\n";
+        }
+        for (int t = 1; t <= 3; t++) tabs += "TAB:" + to_string(t) + "\nCURRENT:" + variant(pick(SITES)) + "," + title() + "\n";
+        for (int s = 0; s < 3; s++) {
+            sessions += "SNAPSHOT:" + to_string(1700000000 + s * 60) + "," + title() + "\n";
+            for (int t = 1; t <= 2; t++)
+                sessions += "TAB:" + to_string(t) + "#" + to_string(pick(2)) + "," + variant(pick(SITES)) + " -> " +
+                            variant(pick(SITES)) + "\n";
+            sessions += "END\n";
+        }
+        writeFile("history.txt", history);
+        writeFile("bookmarks.txt", bookmarks);
+        writeFile("visitCount.txt", counts);
+        writeFile("tabs.txt", tabs);
+        writeFile("sessionHistory.txt", sessions);
+    }
+
+    static void clearProfile() {
+        for (const char* name : {"state.bin", "state.bin.tmp", "state.bin.corrupt", "sample.bin", "journal.bin", "history.txt",
+                                 "bookmarks.txt", "visitCount.txt", "tabs.txt", "sessionHistory.txt"})
+            remove(name);
+    }
+
+    struct Observed {
+        vector<int> ids;
+        int selected;
+        vector<string> pages, history, bookmarks;
+        bool operator==(const Observed& o) const {
+            return ids == o.ids && selected == o.selected && pages == o.pages && history == o.history &&
+                   bookmarks == o.bookmarks;
+        }
+    };
+
+    static Observed observe(Browser& b) {
+        Observed o;
+        o.ids = b.tabIds();
+        o.selected = b.selectedTab();
+        for (int id : o.ids) {
+            Page p = b.currentPage(id);
+            o.pages.push_back(string(p.url()) + "," + string(p.title()));
+        }
+        for (auto& p : b.recentVisits(HISTORY_CHECKED)) o.history.push_back(string(p.url()) + "," + string(p.title()));
+        for (auto& p : b.bookmarkList()) o.bookmarks.push_back(string(p.url()) + "," + string(p.title()));
+        return o;
+    }
+
+    // Closes the browser and unmaps its state file, verification thread
+    // joined, so the file can be rewritten in place underneath.
+    void stop() {
+        browser.reset();
+        startOver();
+    }
+
+    // Starts a browser on whatever is in the profile; it has to come up with a usable tab.
+    bool start(const string& what) {
+        stop();
+        browser.reset(new Browser(true));
+        vector<int> ids = browser->tabIds();
+        return expect(!ids.empty() && find(ids.begin(), ids.end(), browser->selectedTab()) != ids.end(),
+                      what + " left no usable tab");
+    }
+
+    // A body derived from a valid one: bytes and 32-bit words overwritten
+    // with values that make likely ids, counts and offsets go out of range.
+    string mutateBinary(string bytes) {
+        static const uint32_t WORDS[] = {0, 1, 0x7F, 0xFFFF, 0x7FFFFFFF, 0xFFFFFFFF, 0x80000000};
+        if (bytes.empty() || pick(8) == 0) bytes.resize(pick(64) * 4);
+        size_t edits = 1 + pick(4);
+        for (size_t e = 0; e < edits && !bytes.empty(); e++) {
+            size_t at = pick(bytes.size());
+            if (pick(2) || at + 4 > bytes.size()) bytes[at] = (char)rng();
+            else memcpy(&bytes[at], &WORDS[pick(7)], 4);
+        }
+        return bytes;
+    }
+
+    bool runParsers(size_t rounds) {
+        static const char* LEGACY[] = {"history.txt", "bookmarks.txt", "visitCount.txt", "tabs.txt", "sessionHistory.txt"};
+        streambuf* errors = cerr.rdbuf(nullptr);        // rejected files are reported there
+        for (step = 1; step <= rounds && failure.empty(); step++) {
+            clearProfile();
+            writeLegacyProfile();
+            const char* target = LEGACY[pick(5)];
+            writeFile(target, mutate(readFile(target)));
+            if (!start(string("mutated ") + target)) break;
+            // The import was compacted into state.bin; loading that must give the same state.
+            Observed imported = observe(*browser);
+            reload();
+            Observed reloaded = observe(*browser);
+            expect(reloaded == imported, string("state after importing mutated ") + target + " and reloading");
+
+            for (int i = 0; i < 20; i++) {
+                int id = browser->tabIds()[pick(browser->tabIds().size())];
+                browser->visitPage(id, variant(pick(SITES)), title());
+                if (i % 5 == 0) browser->openTab();
+            }
+            stop();
+            string journal = readFile("journal.bin");
+            writeFile("journal.bin", mutate(journal));
+            if (!start("mutated journal.bin")) break;
+            browser->compact();
+            stop();
+
+            // Every loader in turn, on one of its sections.
+            string state = readFile("state.bin");
+            writeFile("sample.bin", state);
+            const Loader& loader = loaders()[step % loaders().size()];
+            StateSection type = loader.sections[pick(loader.sections.size())];
+            string body;
+            size_t count = readSection("sample.bin", type, body);
+            switch (pick(8)) {
+                case 0: count += 1 + pick(1000); break;
+                case 1: count = rng(); break;
+                case 2: count = ((size_t)1 << 63) + 1; break;       // count * sizeof(record) wraps around
+            }
+            string what = string("damaged ") + loader.name + " section " + to_string(type);
+            if (!expect(replaceSection("sample.bin", "state.bin", type, mutateBinary(body), count), "writing " + what))
+                break;
+            loader.run();
+            if (!start(what)) break;
+            observe(*browser);
+            browser->compact();
+            stop();
+            if (!start("compacted " + what)) break;
+            stop();
+
+            size_t header = min(state.size(), sizeof(StateHeader) + 4 * sizeof(SectionEntry));
+            if (pick(2)) state.resize(pick(state.size() + 1));
+            else if (header) state[pick(header)] ^= (char)(1 + pick(255));
+            writeFile("state.bin", state);
+            if (!start("damaged state.bin header")) break;
+            stop();
+        }
+        browser.reset();
+        cerr.rdbuf(errors);
+        return failure.empty();
+    }
+
+    bool runSpill(size_t ops) {
+        SpillFile spill;
+        map<uint32_t, vector<char>> live;
+        uint64_t liveBytes = 0;
+        auto add = [&]() {
+            vector<char> bytes(1 + pick(4096));
+            for (char& c : bytes) c = (char)rng();
+            uint32_t slot = 0;
+            if (!expect(spill.write(bytes, slot), "spill write")) return false;
+            if (!expect(!live.count(slot), "spill slot reused while live")) return false;
+            liveBytes += bytes.size();
+            live[slot] = std::move(bytes);
+            return true;
+        };
+        if (!add()) return false;
+        uint32_t kept = live.begin()->first;
+        for (step = 1; step <= ops && failure.empty(); step++) {
+            size_t r = pick(10);
+            auto it = live.begin();
+            advance(it, pick(live.size()));
+            if (r < 4 || live.size() == 1) {
+                if (!add()) break;
+            } else if (r < 8) {
+                if (it->first == kept) continue;
+                liveBytes -= it->second.size();
+                spill.drop(it->first);
+                live.erase(it);
+            } else {
+                vector<char> bytes;
+                expect(spill.read(it->first, bytes) && bytes == it->second, "spill slot " + to_string(it->first) + " read back");
+            }
+            expect(spill.spilledBytes() == liveBytes, "spilled bytes");
+            expect(spill.fileBytes() <= 2 * liveBytes, "spill file of " + to_string(spill.fileBytes()) + " bytes for " +
+                                                           to_string(liveBytes) + " spilled");
+        }
+        for (auto& l : live) {
+            vector<char> bytes;
+            if (!expect(spill.read(l.first, bytes) && bytes == l.second, "spill slot " + to_string(l.first) + " at the end")) break;
+        }
+        return failure.empty();
+    }
+
+public:
+    // Drops what earlier browsers left in this process, the state file
+    // mappings and the interned strings, so the next one loads state.bin
+    // from scratch the way a new process does.
+    static void startOver() {
+        FileManager::closeState();
+        urlPool().clear();
+        titlePool().clear();
+    }
+
+    // The state file for one loader run, opened from scratch and closed
+    // again, verification thread joined, before the run returns.
+    struct ScopedState {
+        bool opened;
+        ScopedState() {
+            startOver();
+            opened = FileManager::openState();
+        }
+        ~ScopedState() { startOver(); }
+    };
+
+    // ------------------ Damaged state sections ------------------
+    // A binary loader with the sections it reads. run() opens the current
+    // state.bin and loads from it, then reads every string the loaded pages
+    // and records refer to.
+    struct Loader {
+        const char* name;
+        vector<StateSection> sections;
+        void (*run)();
+    };
+
+    // Reads a URL and a title by id, so a bad id shows up under AddressSanitizer.
+    static void touch(UrlId url, TitleId title = 0) {
+        static volatile size_t sink;
+        sink = sink + urlPool().get(url).size() + titlePool().get(title).size();
+    }
+    static void touch(const Page& p) { touch(p.urlId, p.titleId); }
+
+    static const vector<Loader>& loaders() {
+        static const vector<Loader> all = {
+            {"pools", {URL_TEXT, URL_INDEX, TITLE_TEXT, TITLE_INDEX, URL_FORM}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 for (StringId id = 0; id < urlPool().size(); id++) urlPool().find(urlPool().get(id));
+                 for (StringId id = 0; id < titlePool().size(); id++) titlePool().find(titlePool().get(id));
+             }},
+            {"history", {HISTORY, HISTORY_META}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 HistoryLog history;
+                 FileManager::loadHistory(history);
+                 for (auto& p : history) touch(p);
+             }},
+            {"bookmarks", {BOOKMARKS, BOOKMARK_INDEX}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 unordered_map<UrlId, Page> bookmarks;
+                 BookmarkIndex index;
+                 FileManager::loadBookmarks(bookmarks, index);
+                 for (auto& b : bookmarks) touch(b.second);
+                 for (auto& e : index.all()) touch(e.urlId, e.titleId);
+             }},
+            {"visits", {VISIT_COUNTS, VISIT_ERRORS, VISIT_SKETCH}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 ShardedVisitCounter counts;
+                 FileManager::loadVisitCount(counts);
+                 for (auto& v : counts.entries()) touch(v.urlId);
+             }},
+            {"frecency", {FRECENCY, HISTORY}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 HistoryLog history;
+                 Frecency frecency;
+                 FileManager::loadHistory(history);
+                 FileManager::loadFrecency(frecency, history, history.size());
+                 for (auto& s : frecency.stored()) touch(s.first);
+             }},
+            {"tabs", {TAB_META, TABS, TAB_ENTRIES, TAB_PLACES, WINDOWS, TAB_GROUPS, WORKSPACE_META, GROUP_ORDER}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 TabTable tabs;
+                 int currentIndex = -1, nextId = 1, nextWindowId = 1, nextGroupId = 1;
+                 FileManager::loadTabs(tabs, currentIndex, nextId);
+                 FileManager::loadWorkspaceMeta(nextWindowId, nextGroupId);
+                 vector<Page> pages;
+                 for (auto tab : tabs) {
+                     pages.clear();
+                     tab->copyPages(pages);
+                     for (auto& p : pages) touch(p);
+                 }
+             }},
+            {"sessions", {SESSIONS, SESSION_TABS, SESSION_DELTAS, SESSION_PAGES, SESSION_SCOPES, SESSION_PLACES,
+                          SESSION_RECORDS, SESSION_ENTRIES, SESSION_META}, [] {
+                 ScopedState state;
+                 if (!state.opened) return;
+                 time_t lastSnapshotTime;
+                 bool lastAutomatic;
+                 FileManager::loadSessionMeta(lastSnapshotTime, lastAutomatic);
+                 deque<SessionSnapshot> sessions;
+                 FileManager::loadSessionHistory(sessions);
+                 for (auto& s : sessions) {
+                     FileManager::loadSnapshotTabs(s);
+                     for (auto& record : *s.tabs)
+                         for (auto& p : record->entries) touch(p);
+                 }
+             }},
+            {"journal", {JOURNAL_META}, [] {
+                 ScopedState state;
+                 if (state.opened) FileManager::loadJournalPosition();
+             }},
+        };
+        return all;
+    }
+
+    // The body of section `type` of a state file and its record count; empty and 0 if absent.
+    static size_t readSection(const string& path, StateSection type, string& body) {
+        string file = readFile(path);
+        StateHeader header;
+        body.clear();
+        if (file.size() < sizeof(header)) return 0;
+        memcpy(&header, file.data(), sizeof(header));
+        for (uint32_t i = 0; i < header.sectionCount && sizeof(header) + (i + 1) * sizeof(SectionEntry) <= file.size(); i++) {
+            SectionEntry entry;
+            memcpy(&entry, file.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+            if (entry.type != type || entry.offset > file.size() || entry.size > file.size() - entry.offset) continue;
+            body = file.substr(entry.offset, entry.size);
+            return entry.count;
+        }
+        return 0;
+    }
+
+    // Writes the state file `from` to `to` with section `type` replaced by
+    // (or, if absent, extended with) `body` holding `count` records, and
+    // every checksum recomputed.
+    static bool replaceSection(const string& from, const string& to, StateSection type, const string& body, size_t count) {
+        string file = readFile(from);
+        StateHeader header;
+        if (file.size() < sizeof(header)) return false;
+        memcpy(&header, file.data(), sizeof(header));
+        StateWriter writer;
+        bool replaced = false;
+        for (uint32_t i = 0; i < header.sectionCount && sizeof(header) + (i + 1) * sizeof(SectionEntry) <= file.size(); i++) {
+            SectionEntry entry;
+            memcpy(&entry, file.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+            if (entry.type == type) {
+                writer.addRaw(type, body.data(), body.size(), count);
+                replaced = true;
+            } else if (entry.offset <= file.size() && entry.size <= file.size() - entry.offset) {
+                writer.addRaw((StateSection)entry.type, file.data() + entry.offset, entry.size, entry.count);
+            }
+        }
+        if (!replaced) writer.addRaw(type, body.data(), body.size(), count);
+        return writer.commit(to);
+    }
+
+    // Runs `ops` model operations and `rounds` rounds of mutated input in
+    // `dir`, which it creates and empties; prints the outcome and returns
+    // false on the first mismatch or rejected startup.
+    static bool run(uint32_t seed, size_t ops, size_t rounds, const string& dir) {
+        filesystem::path home = filesystem::current_path();
+        filesystem::create_directories(dir);
+        filesystem::current_path(dir);
+        const char* statePath = FileManager::STATE_PATH;
+        const char* journalPath = FileManager::JOURNAL_PATH;
+        FileManager::STATE_PATH = "state.bin";
+        FileManager::JOURNAL_PATH = "journal.bin";
+        clearProfile();
+
+        ModelCheck check(seed);
+        auto start = chrono::steady_clock::now();
+        bool ok = check.runModel(ops);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (ok) printf("model: %zu ops in %.3f s: %.0f ops/s\n", ops, seconds, ops / seconds);
+        if (ok) {
+            clearProfile();
+            start = chrono::steady_clock::now();
+            ok = check.runParsers(rounds);
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (ok) printf("parsers: %zu mutated profiles in %.3f s\n", rounds, seconds);
+        }
+        if (ok) {
+            start = chrono::steady_clock::now();
+            ok = check.runSpill(rounds * 100);
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (ok) printf("spill: %zu operations in %.3f s\n", rounds * 100, seconds);
+        }
+        if (!ok) printf("seed %u FAILED at %s\n", seed, check.failure.c_str());
+
+        clearProfile();
+        FileManager::STATE_PATH = statePath;
+        FileManager::JOURNAL_PATH = journalPath;
+        filesystem::current_path(home);
+        return ok;
+    }
+};
+
+#endif
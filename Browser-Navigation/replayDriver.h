@@ -0,0 +1,129 @@
+#ifndef REPLAYDRIVER_H
+#define REPLAYDRIVER_H
+
+#include "browser.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Headless replay of a recorded navigation trace, for load testing.
+// A trace is a text file with one operation per line, applied to the current
+// tab as the menu would:
+//   v <url> <title>     visit (the title is the rest of the line)
+//   b / f               back / forward
+//   o / c               open a tab / close the current tab
+//   s <index>           switch to the tab at <index>
+//   m                   bookmark the current page
+//   n <description>     save a session snapshot
+//   r <index>           restore a session snapshot
+// Blank lines and lines starting with '#' are skipped.
+enum TraceOp { T_VISIT, T_BACK, T_FORWARD, T_TAB_OPEN, T_TAB_CLOSE, T_TAB_SWITCH, T_BOOKMARK, T_SNAPSHOT, T_RESTORE, T_OPS };
+
+struct TraceEntry {
+    TraceOp op;
+    int value;              // tab or snapshot index
+    string text, extra;     // url and title, or snapshot description
+};
+
+class ReplayDriver {
+private:
+    static constexpr const char* OP_NAMES[T_OPS] = {"visit", "back", "forward", "tab open", "tab close",
+                                                    "tab switch", "bookmark", "snapshot", "restore"};
+
+    static bool parse(const string& line, TraceEntry& e) {
+        static const string CODES = "vbfocsmnr";
+        size_t op = CODES.find(line[0]);
+        if (op == string::npos || (line.size() > 1 && line[1] != ' ')) return false;
+        e.op = (TraceOp)op;
+        e.value = 0;
+        string rest = line.size() > 2 ? line.substr(2) : "";
+        switch (e.op) {
+            case T_VISIT: {
+                size_t space = rest.find(' ');
+                e.text = rest.substr(0, space);
+                e.extra = space == string::npos ? "" : rest.substr(space + 1);
+                return !e.text.empty();
+            }
+            case T_TAB_SWITCH:
+            case T_RESTORE:
+                try {
+                    e.value = stoi(rest);
+                } catch (...) {
+                    return false;
+                }
+                return true;
+            case T_SNAPSHOT: e.text = rest; return true;
+            default: return true;
+        }
+    }
+
+    static void apply(Browser& browser, const TraceEntry& e) {
+        switch (e.op) {
+            case T_VISIT: browser.visitPage(e.text, e.extra); break;
+            case T_BACK: browser.goBack(); break;
+            case T_FORWARD: browser.goForward(); break;
+            case T_TAB_OPEN: browser.createNewTab(); break;
+            case T_TAB_CLOSE: browser.closeCurrentTab(); break;
+            case T_TAB_SWITCH: browser.switchTab(e.value); break;
+            case T_BOOKMARK: browser.addBookmark(); break;
+            case T_SNAPSHOT: browser.saveSession(e.text); break;
+            case T_RESTORE: browser.restoreSession(e.value); break;
+            default: break;
+        }
+    }
+
+    static double percentile(const vector<double>& sorted, double p) {
+        return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+    }
+
+public:
+    // Reads a whole trace; on a malformed line, returns false with its number in `badLine`.
+    static bool load(const string& path, vector<TraceEntry>& trace, size_t& badLine) {
+        ifstream file(path);
+        badLine = 0;
+        if (!file) return false;
+        string line;
+        for (size_t number = 1; getline(file, line); number++) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            TraceEntry e;
+            if (!parse(line, e)) {
+                badLine = number;
+                return false;
+            }
+            trace.push_back(move(e));
+        }
+        return true;
+    }
+
+    // Applies the trace as fast as possible, then prints the browser's startup
+    // time, throughput and per-operation latency percentiles. Queued visits are drained before the
+    // clock stops, so the total covers all of their work.
+    static void run(Browser& browser, const vector<TraceEntry>& trace) {
+        vector<vector<double>> latency(T_OPS);    // microseconds
+        auto start = chrono::steady_clock::now();
+        for (auto& e : trace) {
+            auto before = chrono::steady_clock::now();
+            apply(browser, e);
+            latency[e.op].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - before).count());
+        }
+        browser.flush();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        printf("startup %.3f ms\n", browser.startupTime() * 1000);
+        printf("%zu ops in %.3f s: %.0f ops/s\n", trace.size(), seconds, trace.size() / seconds);
+        printf("%-12s %10s %10s %10s %10s %10s   (us)\n", "op", "count", "p50", "p90", "p99", "max");
+        for (int op = 0; op < T_OPS; op++) {
+            vector<double>& samples = latency[op];
+            if (samples.empty()) continue;
+            sort(samples.begin(), samples.end());
+            printf("%-12s %10zu %10.1f %10.1f %10.1f %10.1f\n", OP_NAMES[op], samples.size(),
+                   percentile(samples, 0.50), percentile(samples, 0.90), percentile(samples, 0.99), samples.back());
+        }
+    }
+};
+
+#endif
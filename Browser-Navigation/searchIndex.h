@@ -0,0 +1,274 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include "structures.h"
+#include "historyLog.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+typedef uint32_t DocId;
+typedef uint32_t TokenId;
+
+// One searchable page: every distinct URL seen in history or bookmarks.
+struct SearchDoc {
+    UrlId urlId;
+    TitleId titleId;        // most recent title
+    time_t lastVisit;
+    uint32_t visits;
+    bool bookmarked;
+};
+
+struct SearchResult {
+    UrlId urlId;
+    TitleId titleId;
+    double score;
+};
+
+// Inverted index over the words of page titles and URL components.
+// Each query word matches index tokens exactly, as a prefix, as a substring
+// (via a trigram index over the token dictionary) or, failing those, within
+// a small edit distance, each with a lower weight. A page must match every query word;
+// its score is the match quality scaled by visit frequency, recency and
+// whether it is bookmarked, and only the top k are fully sorted.
+class SearchIndex {
+private:
+    static constexpr double EXACT = 1.0, PREFIX = 0.8, SUBSTRING = 0.6, TYPO = 0.5;
+    static constexpr double RECENCY_HALF_LIFE = 7 * 24 * 3600.0;   // one week
+    static constexpr DocId NO_DOC = UINT32_MAX;
+
+    vector<SearchDoc> docs;
+    vector<vector<TokenId>> docTokens;          // DocId -> its tokens, kept apart so docs stay small
+    vector<DocId> docByUrl;                     // indexed by UrlId
+    map<string, TokenId, less<>> tokens;        // ordered for prefix scans
+    unordered_map<string_view, TokenId> tokenIds;   // same keys, hashed for lookups
+    vector<const string*> tokenText;            // TokenId -> key in `tokens`
+    vector<vector<DocId>> postings;             // TokenId -> docs, ascending
+    unordered_map<uint32_t, vector<TokenId>> trigrams;
+    mutable vector<float> bestMatch;            // per-query scratch, all zero between queries
+
+    // Trigrams of a word. Padded with two marker bytes at each end, so words
+    // differing in their first or last letters still share most of them.
+    static vector<uint32_t> trigramsOf(const string& word, bool padded) {
+        string s = padded ? "\1\1" + word + "\1\1" : word;
+        vector<uint32_t> grams;
+        for (size_t i = 0; i + 3 <= s.size(); i++)
+            grams.push_back((uint32_t)(unsigned char)s[i] << 16 | (uint32_t)(unsigned char)s[i + 1] << 8 |
+                            (unsigned char)s[i + 2]);
+        return grams;
+    }
+
+    const vector<TokenId>* tokensWith(uint32_t gram) const {
+        auto it = trigrams.find(gram);
+        return it == trigrams.end() ? nullptr : &it->second;
+    }
+
+    // Lower-cased runs of letters and digits (bytes >= 0x80 count as letters,
+    // so UTF-8 words stay whole). Scheme and "www" carry no meaning and are skipped.
+    static vector<string> tokenize(string_view text) {
+        vector<string> words;
+        string word;
+        for (size_t i = 0; i <= text.size(); i++) {
+            unsigned char c = i < text.size() ? text[i] : ' ';
+            if (isalnum(c) || c >= 0x80) {
+                word += (char)tolower(c);
+                continue;
+            }
+            if (word.size() >= 2 && word != "http" && word != "https" && word != "www") words.push_back(word);
+            word.clear();
+        }
+        return words;
+    }
+
+    TokenId tokenFor(const string& word) {
+        auto known = tokenIds.find(word);
+        if (known != tokenIds.end()) return known->second;
+        TokenId id = tokenText.size();
+        auto it = tokens.emplace(word, id).first;
+        tokenIds.emplace(it->first, id);
+        tokenText.push_back(&it->first);
+        postings.emplace_back();
+        for (uint32_t gram : trigramsOf(word, true)) {
+            vector<TokenId>& list = trigrams[gram];
+            if (list.empty() || list.back() != id) list.push_back(id);
+        }
+        return id;
+    }
+
+    void addTokens(DocId d, string_view text) {
+        for (auto& word : tokenize(text)) {
+            TokenId t = tokenFor(word);
+            if (!postings[t].empty() && postings[t].back() == d) continue;
+            postings[t].push_back(d);
+            docTokens[d].push_back(t);
+        }
+    }
+
+    DocId docFor(const Page& p) {
+        if (p.urlId >= docByUrl.size()) docByUrl.resize(max<size_t>(p.urlId + 1, docByUrl.size() * 2), NO_DOC);
+        DocId d = docByUrl[p.urlId];
+        if (d != NO_DOC) {
+            if (docs[d].titleId != p.titleId) {
+                docs[d].titleId = p.titleId;
+                addTokens(d, p.title());        // the old title's words stay searchable
+            }
+            return d;
+        }
+        d = docByUrl[p.urlId] = docs.size();
+        docs.push_back({p.urlId, p.titleId, p.timestamp, 0, false});
+        docTokens.emplace_back();
+        addTokens(d, p.url());
+        addTokens(d, p.title());
+        return d;
+    }
+
+    static size_t editDistance(const string& a, const string& b, size_t limit, vector<size_t>& row) {
+        row.resize(b.size() + 1);
+        for (size_t j = 0; j <= b.size(); j++) row[j] = j;
+        for (size_t i = 1; i <= a.size(); i++) {
+            size_t diagonal = row[0], best = row[0] = i;
+            for (size_t j = 1; j <= b.size(); j++) {
+                size_t next = min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1])});
+                diagonal = row[j];
+                row[j] = next;
+                best = min(best, next);
+            }
+            if (best > limit) return limit + 1;
+        }
+        return row[b.size()];
+    }
+
+    // Every token the query word can match, with the quality of the best way it matches.
+    unordered_map<TokenId, double> candidates(const string& word) const {
+        unordered_map<TokenId, double> found;
+        auto offer = [&](TokenId t, double quality) {
+            double& q = found[t];
+            q = max(q, quality);
+        };
+        for (auto it = tokens.lower_bound(word); it != tokens.end() && it->first.compare(0, word.size(), word) == 0; ++it)
+            offer(it->second, it->first.size() == word.size() ? EXACT : PREFIX);
+        if (word.size() < 3) return found;
+
+        // Substring: check the tokens listed under the word's rarest trigram.
+        const vector<TokenId>* rarest = nullptr;
+        for (uint32_t gram : trigramsOf(word, false)) {
+            const vector<TokenId>* list = tokensWith(gram);
+            if (!list) { rarest = nullptr; break; }
+            if (!rarest || list->size() < rarest->size()) rarest = list;
+        }
+        if (rarest)
+            for (TokenId t : *rarest)
+                if (tokenText[t]->find(word) != string::npos) offer(t, SUBSTRING);
+
+        // Typos, only when nothing matched so far. A token within
+        // `limit` edits shares at least grams - 3 * limit padded trigrams with the
+        // word, so it must appear in one of the (3 * limit + 1) shortest lists;
+        // only those are scanned, and survivors are checked by edit distance.
+        size_t limit = word.size() >= 8 ? 2 : word.size() >= 4 ? 1 : 0;
+        if (limit == 0 || !found.empty()) return found;
+        vector<const vector<TokenId>*> lists;
+        for (uint32_t gram : trigramsOf(word, true)) lists.push_back(tokensWith(gram));
+        sort(lists.begin(), lists.end(), [](const vector<TokenId>* a, const vector<TokenId>* b) {
+            return (a ? a->size() : 0) < (b ? b->size() : 0);
+        });
+        vector<TokenId> near;
+        for (size_t i = 0; i < min(lists.size(), 3 * limit + 1); i++)
+            if (lists[i]) near.insert(near.end(), lists[i]->begin(), lists[i]->end());
+        sort(near.begin(), near.end());
+        near.erase(unique(near.begin(), near.end()), near.end());
+        vector<size_t> row;
+        for (TokenId t : near) {
+            const string& text = *tokenText[t];
+            if (found.count(t) || text.size() + limit < word.size() || text.size() > word.size() + limit) continue;
+            if (editDistance(word, text, limit, row) <= limit) offer(t, TYPO);
+        }
+        return found;
+    }
+
+public:
+    void addVisit(const Page& p) {
+        SearchDoc& doc = docs[docFor(p)];
+        doc.visits++;
+        doc.lastVisit = max(doc.lastVisit, p.timestamp);
+    }
+
+    void addBookmark(const Page& p) {
+        docs[docFor(p)].bookmarked = true;
+    }
+
+    // Indexes a whole history log, newest first so each page keeps its latest title.
+    void build(const HistoryLog& history) {
+        for (size_t i = history.size(); i-- > history.start();) {
+            const Page& p = history[i];
+            DocId d = p.urlId < docByUrl.size() ? docByUrl[p.urlId] : NO_DOC;
+            SearchDoc& doc = docs[d != NO_DOC ? d : docFor(p)];
+            doc.visits++;
+            doc.lastVisit = max(doc.lastVisit, p.timestamp);
+        }
+    }
+
+    vector<SearchResult> search(string_view query, size_t k, time_t now = time(nullptr)) const {
+        vector<SearchResult> results;
+        vector<string> words = tokenize(query);
+        if (words.empty()) return results;
+
+        vector<unordered_map<TokenId, double>> matches;
+        size_t driver = 0, driverCost = SIZE_MAX;
+        for (auto& word : words) {
+            matches.push_back(candidates(word));
+            size_t cost = 0;
+            for (auto& m : matches.back()) cost += postings[m.first].size();
+            if (cost < driverCost) {
+                driverCost = cost;
+                driver = matches.size() - 1;
+            }
+        }
+
+        // Walk the postings of the most selective word, keeping each doc's best
+        // quality in a scratch array; check the other words against its tokens.
+        vector<DocId> hits;
+        bestMatch.resize(docs.size());
+        for (auto& m : matches[driver]) {
+            for (DocId d : postings[m.first]) {
+                if (bestMatch[d] == 0) hits.push_back(d);
+                bestMatch[d] = max<float>(bestMatch[d], m.second);
+            }
+        }
+        for (DocId d : hits) {
+            const SearchDoc& doc = docs[d];
+            double match = bestMatch[d];
+            bestMatch[d] = 0;
+            for (size_t w = 0; w < matches.size() && match > 0; w++) {
+                if (w == driver) continue;
+                double best = 0;
+                for (TokenId t : docTokens[d]) {
+                    auto it = matches[w].find(t);
+                    if (it != matches[w].end()) best = max(best, it->second);
+                }
+                match = best > 0 ? match + best : 0;
+            }
+            if (match <= 0) continue;
+            double frequency = log2(2.0 + doc.visits);
+            double recency = exp2(-max<double>(0, now - doc.lastVisit) / RECENCY_HALF_LIFE);
+            double score = match * (frequency + 2 * recency) * (doc.bookmarked ? 1.5 : 1.0);
+            results.push_back({doc.urlId, doc.titleId, score});
+        }
+
+        auto better = [](const SearchResult& a, const SearchResult& b) { return a.score > b.score; };
+        if (results.size() > k) {
+            nth_element(results.begin(), results.begin() + k, results.end(), better);
+            results.resize(k);
+        }
+        sort(results.begin(), results.end(), better);
+        return results;
+    }
+
+    size_t documents() const { return docs.size(); }
+    size_t vocabulary() const { return tokenText.size(); }
+};
+
+#endif
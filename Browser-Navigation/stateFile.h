@@ -0,0 +1,374 @@
+#ifndef STATEFILE_H
+#define STATEFILE_H
+
+#include "structures.h"
+#include "bookmarkIndex.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fstream>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// ------------------ state.bin layout ------------------
+// StateHeader, then sectionCount SectionEntry records, then the sections,
+// each starting on an 8-byte boundary. All integers are little-endian and
+// fixed-width so records can be read in place from the mapping. The header
+// checksum covers the section directory, and each directory entry carries
+// the checksum of its section, so opening a file only has to hash the
+// directory while the bulk of the data is verified separately.
+//
+// Strings are stored once per pool: *_TEXT holds a uint32 length followed by
+// the bytes for every id in order, *_INDEX holds per-id offsets and hashes
+// followed by the open-addressing slot table, so StringPool can attach to
+// both without copying. Every other section refers to strings by id.
+
+static const char STATE_MAGIC[8] = {'B', 'R', 'W', 'S', 'T', 'A', 'T', 'E'};
+static const uint32_t STATE_VERSION = 1;
+
+enum StateSection : uint32_t {
+    URL_TEXT = 1,
+    URL_INDEX,
+    TITLE_TEXT,
+    TITLE_INDEX,
+    HISTORY,            // Page[]
+    BOOKMARKS,          // Page[]
+    VISIT_COUNTS,       // VisitRecord[], most visited first
+    TAB_META,           // TabMeta
+    TABS,               // NavRecord[]
+    TAB_ENTRIES,        // Page[], ranges referenced by TABS
+    SESSIONS,           // SnapshotRecord[]
+    SESSION_TABS,       // uint32 index into SESSION_RECORDS, ranges referenced by SESSIONS
+    SESSION_RECORDS,    // NavRecord[], shared by every snapshot that lists them (read only, see SESSION_DELTAS)
+    SESSION_ENTRIES,    // Page[], ranges referenced by SESSION_RECORDS (read only)
+    JOURNAL_META,       // uint64 sequence of the last journal record folded into this file
+    BOOKMARK_INDEX,     // BookmarkEntry[] in title order
+    VISIT_ERRORS,       // uint32 per VISIT_COUNTS record, bounded visit counting only
+    VISIT_SKETCH,       // uint32 Count-Min Sketch cells, bounded visit counting only
+    FRECENCY,           // FrecencyRecord[]
+    SESSION_DELTAS,     // DeltaRecord[], shared by every snapshot that lists them; SESSION_TABS indexes these
+    SESSION_PAGES,      // pages encoded with encodePages, ranges referenced by SESSION_DELTAS
+    HISTORY_META,       // uint64 position of the first HISTORY entry (0 when absent)
+    WINDOWS,            // WindowRecord[] in window order
+    TAB_GROUPS,         // GroupRecord[]
+    TAB_PLACES,         // TabPlace per TABS record
+    SESSION_SCOPES,     // TabPlace per SESSIONS record: the window or group snapshotted, 0 for all
+    SESSION_PLACES,     // TabPlace per SESSION_DELTAS record
+    SESSION_META,       // SessionMeta
+    URL_FORM,           // uint32 CANONICAL_URL_FORM the URL table was written in (absent: not canonicalized)
+    WORKSPACE_META,     // WorkspaceMeta
+    GROUP_ORDER         // int32 id per grouped TABS record, group by group in its own tab order (absent: window order)
+};
+
+struct StateHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct SectionEntry {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset, size, count;
+    uint64_t checksum;
+};
+
+struct NavRecord {
+    int32_t tabId;
+    uint32_t cursor;
+    uint32_t firstEntry, entryCount;
+};
+
+// One snapshot tab record, stored as a delta: entries [skip, skip + keep)
+// of record `base` followed by `added` encoded pages. Skipping covers a full
+// navigation ring dropping its oldest page. A keyframe (base == NO_BASE)
+// stores every entry, and chains are cut at a fixed length, so decoding any
+// record reads a bounded number of others.
+struct DeltaRecord {
+    static const uint32_t NO_BASE = 0xFFFFFFFF;
+    static const uint32_t URLS_ONLY = 1;        // flag: imported from the legacy text format, no titles
+    int32_t tabId;
+    uint32_t cursor;
+    uint32_t base, skip, keep, added;
+    uint64_t offset;    // into SESSION_PAGES
+    uint32_t bytes;
+    uint32_t flags;
+};
+
+struct SnapshotRecord {
+    int64_t timestamp;
+    TitleId descriptionId;
+    uint32_t firstTab, tabCount;
+    uint32_t reserved;
+};
+
+struct VisitRecord {
+    UrlId urlId;
+    uint32_t count;
+};
+
+struct FrecencyRecord {
+    UrlId urlId;
+    uint32_t reserved;
+    double score;       // time-invariant log score, see frecency.h
+};
+
+// Whether the next automatic snapshot replaces the last one (see
+// Browser::captureSessionSnapshot). Files without it start afresh.
+struct SessionMeta {
+    int64_t lastSnapshotTime;
+    uint32_t lastAutomatic;
+    uint32_t reserved;
+};
+
+struct TabMeta {
+    int32_t currentTabIndex, nextTabId;
+};
+
+// Ids the next new window and group get, so those of closed ones are not
+// handed out again while snapshots may still name them. Files without it
+// start past the largest id in use.
+struct WorkspaceMeta {
+    int32_t nextWindowId, nextGroupId;
+};
+
+// Files without these sections hold a single window and no groups.
+struct TabPlace {
+    int32_t windowId, groupId;      // group 0: none
+};
+
+struct WindowRecord {
+    int32_t id, activeTabId;
+};
+
+struct GroupRecord {
+    int32_t id, windowId, activeTabId;
+    TitleId nameId;
+};
+
+static_assert(sizeof(Page) == 16 && sizeof(time_t) == 8, "Page is stored on disk as-is");
+
+// 64-bit checksum consuming eight bytes per step.
+inline uint64_t stateChecksum(const char* data, size_t size) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    for (; i < size; i++) h = (h ^ (unsigned char)data[i]) * 0x100000001B3ULL;
+    return h;
+}
+
+// Read side: maps the whole file and validates it once.
+// Mappings are never unmapped because interned strings and history pages
+// keep pointing into them for the rest of the process.
+class StateFile {
+private:
+    const char* data;
+    size_t size;
+    const SectionEntry* sections;
+    uint32_t sectionCount;
+
+    StateFile() : data(nullptr), size(0), sections(nullptr), sectionCount(0) {}
+
+public:
+    // Returns nullptr when the file is missing, truncated or fails its checksum.
+    static StateFile* open(const string& path) {
+        StateFile* file = new StateFile();
+#ifdef _WIN32
+        // Windows cannot rename over a mapped file, so the contents are read into memory.
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in) { delete file; return nullptr; }
+        file->size = in.tellg();
+        char* buffer = new char[file->size ? file->size : 1];
+        in.seekg(0);
+        in.read(buffer, file->size);
+        file->data = buffer;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { delete file; return nullptr; }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(StateHeader)) {
+            close(fd);
+            delete file;
+            return nullptr;
+        }
+        file->size = st.st_size;
+        void* mapped = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) { delete file; return nullptr; }
+        file->data = (const char*)mapped;
+#endif
+        if (!file->validate()) {
+            cerr << "Ignoring corrupt state file " << path << "\n";
+            file->release();
+            delete file;
+            return nullptr;
+        }
+        return file;
+    }
+
+    void release() {
+#ifdef _WIN32
+        delete[] data;
+#else
+        munmap((void*)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    bool validate() {
+        if (size < sizeof(StateHeader)) return false;
+        const StateHeader* header = (const StateHeader*)data;
+        if (memcmp(header->magic, STATE_MAGIC, 8) != 0 || header->version != STATE_VERSION) return false;
+        if (header->fileSize != size) return false;
+        size_t directoryBytes = (uint64_t)header->sectionCount * sizeof(SectionEntry);
+        if (sizeof(StateHeader) + directoryBytes > size) return false;
+        if (stateChecksum(data + sizeof(StateHeader), directoryBytes) != header->checksum) return false;
+        sections = (const SectionEntry*)(data + sizeof(StateHeader));
+        sectionCount = header->sectionCount;
+        for (uint32_t i = 0; i < sectionCount; i++)
+            if (sections[i].offset > size || sections[i].size > size - sections[i].offset || sections[i].offset % 8)
+                return false;
+        return true;
+    }
+
+    // Hashes every section; linear in the file size, so callers run it off the startup path.
+    bool verifySections() const {
+        for (uint32_t i = 0; i < sectionCount; i++)
+            if (stateChecksum(data + sections[i].offset, sections[i].size) != sections[i].checksum) return false;
+        return true;
+    }
+
+    // Pointer to a section's records, or nullptr (with count 0) if the section is absent.
+    template <class T>
+    const T* section(StateSection type, size_t& count) const {
+        for (uint32_t i = 0; i < sectionCount; i++) {
+            if (sections[i].type != type) continue;
+            count = sections[i].count;
+            if (count > sections[i].size / sizeof(T)) break;        // no overflow for a huge count
+            return (const T*)(data + sections[i].offset);
+        }
+        count = 0;
+        return nullptr;
+    }
+
+    const char* rawSection(StateSection type, size_t& bytes, size_t& count) const {
+        for (uint32_t i = 0; i < sectionCount; i++) {
+            if (sections[i].type != type) continue;
+            bytes = sections[i].size;
+            count = sections[i].count;
+            return data + sections[i].offset;
+        }
+        bytes = count = 0;
+        return nullptr;
+    }
+};
+
+// Write side: each section is kept in its own buffer until commit() lays the
+// file out in one buffer of its final size and writes it in a single pass to
+// a temporary name, which is fsynced before it is renamed over the old one
+// and the directory after, so a crash or power loss mid-save leaves the
+// previous state intact and live mappings valid. Sections can be
+// serialized into separate writers on separate threads and then appended.
+class StateWriter {
+private:
+    struct Part {
+        SectionEntry entry;
+        vector<char> bytes;
+    };
+    vector<Part> parts;
+
+    static size_t aligned(size_t offset) { return (offset + 7) & ~(size_t)7; }
+
+#ifndef _WIN32
+    // Makes a rename into the file's directory durable.
+    static bool syncDirectory(const string& path) {
+        size_t slash = path.find_last_of('/');
+        string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+#endif
+
+public:
+    void addRaw(StateSection type, const void* bytes, size_t size, size_t count) {
+        Part part;
+        part.entry = {type, 0, 0, size, count, stateChecksum((const char*)bytes, size)};
+        part.bytes.assign((const char*)bytes, (const char*)bytes + size);
+        parts.push_back(move(part));
+    }
+
+    template <class T>
+    void add(StateSection type, const vector<T>& records) {
+        addRaw(type, records.data(), records.size() * sizeof(T), records.size());
+    }
+
+    // Moves another writer's sections in after this one's.
+    void append(StateWriter&& other) {
+        for (auto& part : other.parts) parts.push_back(move(part));
+        other.parts.clear();
+    }
+
+    bool commit(const string& path) {
+        vector<SectionEntry> sections;
+        sections.reserve(parts.size());
+        size_t fileSize = aligned(sizeof(StateHeader) + parts.size() * sizeof(SectionEntry));
+        for (auto& part : parts) {
+            part.entry.offset = aligned(fileSize);
+            fileSize = part.entry.offset + part.bytes.size();
+            sections.push_back(part.entry);
+        }
+
+        vector<char> file(fileSize, 0);
+        memcpy(file.data() + sizeof(StateHeader), sections.data(), sections.size() * sizeof(SectionEntry));
+        for (auto& part : parts)
+            if (!part.bytes.empty()) memcpy(file.data() + part.entry.offset, part.bytes.data(), part.bytes.size());
+
+        StateHeader header;
+        memcpy(header.magic, STATE_MAGIC, 8);
+        header.version = STATE_VERSION;
+        header.sectionCount = sections.size();
+        header.fileSize = file.size();
+        header.checksum = stateChecksum(file.data() + sizeof(StateHeader), sections.size() * sizeof(SectionEntry));
+        memcpy(file.data(), &header, sizeof(header));
+
+        string temp = path + ".tmp";
+        FILE* out = fopen(temp.c_str(), "wb");
+        if (!out) return false;
+        bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+        ok = fflush(out) == 0 && ok;
+#ifdef _WIN32
+        ok = _commit(_fileno(out)) == 0 && ok;
+        ok = fclose(out) == 0 && ok;
+        remove(path.c_str());
+        return ok && rename(temp.c_str(), path.c_str()) == 0;
+#else
+        ok = fsync(fileno(out)) == 0 && ok;
+        ok = fclose(out) == 0 && ok;
+        if (!ok || rename(temp.c_str(), path.c_str()) != 0) return false;
+        return syncDirectory(path);
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+using namespace std;
+
+typedef uint32_t StringId;
+typedef StringId UrlId;
+typedef StringId TitleId;
+
+// Interns strings so every distinct value is stored exactly once.
+// Text lives in large byte blocks, and the hash index is an open-addressing
+// table of ids, so interning a new string costs no per-string allocation and
+// comparing or hashing interned values is an integer operation.
+// Id 0 is always the empty string.
+//
+// A pool can also be attached to a string table mapped from the state file:
+// ids [0, baseCount) then resolve straight into the mapping (each entry is a
+// uint32 length followed by the bytes) and only strings interned afterwards
+// live in memory.
+//
+// The pool is safe to use from many threads. The index is split into SHARDS
+// by hash; each shard's table is read without locking, and only a miss takes
+// the shard's mutex to insert. Interned strings are kept in chunks that never
+// move (chunk c holds FIRST_CHUNK << c entries), so get() is lock-free too.
+// A shard's table that outgrows itself is replaced, not freed, so readers
+// still probing the old one stay safe; a string missing from an old table is
+// found again under the lock. attach() and slotTable() need a quiet pool.
+class StringPool {
+public:
+    static constexpr StringId NOT_FOUND = UINT32_MAX;
+    static constexpr StringId EMPTY_SLOT = UINT32_MAX;
+
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+    static const size_t SHARDS = 64;
+    static const size_t FIRST_CHUNK = 256, MAX_CHUNKS = 24;
+
+    struct Entry {
+        string_view text;
+        uint64_t hash;
+    };
+
+    struct Table {
+        size_t mask;
+        unique_ptr<atomic<StringId>[]> slots;
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new atomic<StringId>[capacity]) {
+            for (size_t i = 0; i < capacity; i++) slots[i].store(EMPTY_SLOT, memory_order_relaxed);
+        }
+    };
+
+    struct Shard {
+        mutex lock;
+        atomic<Table*> table{nullptr};
+        vector<unique_ptr<Table>> tables;       // every generation, the newest last
+        size_t used = 0;
+        vector<unique_ptr<char[]>> blocks, largeStrings;
+        size_t blockUsed = 0;
+    };
+
+    unique_ptr<Shard[]> shards;
+    atomic<Entry*> chunks[MAX_CHUNKS];          // id - baseCount -> entry
+    atomic<StringId> count;                     // strings interned in memory
+
+    const char* baseText;
+    const uint64_t* baseOffsets;    // id -> offset of its length prefix in baseText
+    const uint64_t* baseHashes;
+    const StringId* baseSlots;
+    size_t baseSlotCount;
+    StringId baseCount;
+
+    string_view baseString(StringId id) const {
+        uint32_t length;
+        memcpy(&length, baseText + baseOffsets[id], sizeof(length));
+        return string_view(baseText + baseOffsets[id] + sizeof(length), length);
+    }
+
+    static size_t chunkOf(size_t index, size_t& offset) {
+        size_t k = index / FIRST_CHUNK + 1, c;
+#ifdef _MSC_VER
+        unsigned long bit;
+        _BitScanReverse64(&bit, k);
+        c = bit;
+#else
+        c = 63 - __builtin_clzll(k);
+#endif
+        offset = index - FIRST_CHUNK * ((size_t(1) << c) - 1);
+        return c;
+    }
+
+    const Entry& entry(StringId id) const {
+        size_t offset, c = chunkOf(id - baseCount, offset);
+        return chunks[c].load(memory_order_acquire)[offset];
+    }
+
+    Entry& newEntry(StringId id) {
+        size_t offset, c = chunkOf(id - baseCount, offset);
+        Entry* chunk = chunks[c].load(memory_order_acquire);
+        if (!chunk) {
+            Entry* fresh = new Entry[FIRST_CHUNK << c];
+            if (chunks[c].compare_exchange_strong(chunk, fresh, memory_order_acq_rel)) chunk = fresh;
+            else delete[] fresh;        // another shard allocated it first
+        }
+        return chunk[offset];
+    }
+
+    Shard& shardFor(uint64_t h) const { return shards[(h >> 58) & (SHARDS - 1)]; }
+
+    static void insertSlot(vector<StringId>& table, uint64_t h, StringId id) {
+        size_t mask = table.size() - 1;
+        size_t i = h & mask;
+        while (table[i] != EMPTY_SLOT) i = (i + 1) & mask;
+        table[i] = id;
+    }
+
+    static void insertSlot(Table& table, uint64_t h, StringId id) {
+        size_t i = h & table.mask;
+        while (table.slots[i].load(memory_order_relaxed) != EMPTY_SLOT) i = (i + 1) & table.mask;
+        table.slots[i].store(id, memory_order_release);
+    }
+
+    StringId findIn(const Table* table, string_view s, uint64_t h) const {
+        if (!table) return NOT_FOUND;
+        for (size_t i = h & table->mask;; i = (i + 1) & table->mask) {
+            StringId id = table->slots[i].load(memory_order_acquire);
+            if (id == EMPTY_SLOT) return NOT_FOUND;
+            const Entry& e = entry(id);
+            if (e.hash == h && e.text == s) return id;
+        }
+    }
+
+    StringId findBase(string_view s, uint64_t h) const {
+        if (!baseSlotCount) return NOT_FOUND;
+        size_t mask = baseSlotCount - 1;
+        for (size_t i = h & mask; baseSlots[i] != EMPTY_SLOT; i = (i + 1) & mask) {
+            StringId id = baseSlots[i];
+            if (baseHashes[id] == h && baseString(id) == s) return id;
+        }
+        return NOT_FOUND;
+    }
+
+    static const char* store(Shard& shard, string_view s) {
+        if (s.empty()) return "";
+        if (s.size() > BLOCK_SIZE / 4) {
+            // Oversized strings get a buffer of their own so the current block stays open.
+            shard.largeStrings.emplace_back(new char[s.size()]);
+            memcpy(shard.largeStrings.back().get(), s.data(), s.size());
+            return shard.largeStrings.back().get();
+        }
+        if (shard.blocks.empty() || shard.blockUsed + s.size() > BLOCK_SIZE) {
+            shard.blocks.emplace_back(new char[BLOCK_SIZE]);
+            shard.blockUsed = 0;
+        }
+        char* dst = shard.blocks.back().get() + shard.blockUsed;
+        memcpy(dst, s.data(), s.size());
+        shard.blockUsed += s.size();
+        return dst;
+    }
+
+    // Publishes a table twice the size; the old one stays readable.
+    void grow(Shard& shard) {
+        Table* old = shard.table.load(memory_order_relaxed);
+        auto bigger = make_unique<Table>(old ? (old->mask + 1) * 2 : 64);
+        if (old)
+            for (size_t i = 0; i <= old->mask; i++) {
+                StringId id = old->slots[i].load(memory_order_relaxed);
+                if (id != EMPTY_SLOT) insertSlot(*bigger, entry(id).hash, id);
+            }
+        shard.table.store(bigger.get(), memory_order_release);
+        shard.tables.push_back(move(bigger));
+    }
+
+    void reset() {
+        shards.reset(new Shard[SHARDS]);
+        for (auto& c : chunks) delete[] c.exchange(nullptr);
+        count = 0;
+    }
+
+public:
+    StringPool()
+        : count(0), baseText(nullptr), baseOffsets(nullptr), baseHashes(nullptr),
+          baseSlots(nullptr), baseSlotCount(0), baseCount(0) {
+        for (auto& c : chunks) c = nullptr;
+        reset();
+        intern("");
+    }
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    ~StringPool() {
+        for (auto& c : chunks) delete[] c.load();
+    }
+
+    // The hash every id is indexed by; callers that already have it can pass
+    // it to find() and intern().
+    static uint64_t hashOf(string_view s) {
+        uint64_t h = 14695981039346656037ULL;   // FNV-1a
+        for (unsigned char c : s) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // Only a pool that holds nothing but the empty string can be attached,
+    // because attaching fixes the meaning of every id below `count`.
+    bool pristine() const { return baseCount == 0 && size() == 1; }
+
+    void attach(const char* text, const uint64_t* offsets, const uint64_t* hashTable,
+                const StringId* slotTable, size_t slotCount, StringId count) {
+        baseText = text;
+        baseOffsets = offsets;
+        baseHashes = hashTable;
+        baseSlots = slotTable;
+        baseSlotCount = slotCount;
+        baseCount = count;
+        reset();
+    }
+
+    // Back to a new pool holding only the empty string, detached from any
+    // mapping, so a process can start over (see ModelCheck). Needs a quiet
+    // pool, and every id handed out before is meaningless afterwards.
+    void clear() {
+        baseText = nullptr;
+        baseOffsets = baseHashes = nullptr;
+        baseSlots = nullptr;
+        baseSlotCount = 0;
+        baseCount = 0;
+        reset();
+        intern("");
+    }
+
+    StringId find(string_view s) const { return find(s, hashOf(s)); }
+
+    StringId find(string_view s, uint64_t h) const {
+        StringId id = findBase(s, h);
+        if (id != NOT_FOUND) return id;
+        return findIn(shardFor(h).table.load(memory_order_acquire), s, h);
+    }
+
+    StringId intern(string_view s) { return intern(s, hashOf(s)); }
+
+    // `h` must be hashOf(s).
+    StringId intern(string_view s, uint64_t h) {
+        StringId id = findBase(s, h);
+        if (id != NOT_FOUND) return id;
+        Shard& shard = shardFor(h);
+        id = findIn(shard.table.load(memory_order_acquire), s, h);
+        if (id != NOT_FOUND) return id;
+
+        lock_guard<mutex> guard(shard.lock);
+        Table* table = shard.table.load(memory_order_relaxed);
+        id = findIn(table, s, h);
+        if (id != NOT_FOUND) return id;
+        if (!table || (shard.used + 1) * 4 > (table->mask + 1) * 3) {   // load factor <= 0.75
+            grow(shard);
+            table = shard.table.load(memory_order_relaxed);
+        }
+        id = baseCount + count.fetch_add(1, memory_order_relaxed);
+        Entry& e = newEntry(id);
+        e.text = string_view(store(shard, s), s.size());
+        e.hash = h;
+        insertSlot(*table, h, id);      // release: the entry is visible to whoever finds the id
+        shard.used++;
+        return id;
+    }
+
+    string_view get(StringId id) const { return id < baseCount ? baseString(id) : entry(id).text; }
+    uint64_t hash(StringId id) const { return id < baseCount ? baseHashes[id] : entry(id).hash; }
+    size_t size() const { return baseCount + count.load(memory_order_acquire); }
+
+    // A single index over every id, in the layout attach() expects.
+    vector<StringId> slotTable() const {
+        size_t capacity = 1024;
+        while (size() * 4 > capacity * 3) capacity *= 2;
+        vector<StringId> table(capacity, EMPTY_SLOT);
+        for (StringId id = 0; id < size(); id++) insertSlot(table, hash(id), id);
+        return table;
+    }
+};
+
+inline StringPool& urlPool() {
+    static StringPool pool;
+    return pool;
+}
+
+inline StringPool& titlePool() {
+    static StringPool pool;
+    return pool;
+}
+
+#endif
@@ -1,40 +1,443 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include "canonicalUrl.h"
+#include <algorithm>
 #include <string>
+#include <cstdint>
+#include <cstdio>
 #include <ctime>
-#include <stack>
+#include <memory>
+#include <mutex>
 #include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 using namespace std;
 
+// A page made from text holds its URL in canonical form (see canonicalUrl.h).
 struct Page {
-    string url, title;
+    UrlId urlId;
+    TitleId titleId;
     time_t timestamp;
-    Page() {}
-    Page(string u, string t) : url(u), title(t), timestamp(time(nullptr)) {}
+    Page() : urlId(0), titleId(0), timestamp(0) {}
+    Page(string_view u, string_view t)
+        : urlId(internUrl(u)), titleId(titlePool().intern(t)), timestamp(time(nullptr)) {}
 
+    string_view url() const { return urlPool().get(urlId); }
+    string_view title() const { return titlePool().get(titleId); }
+    bool empty() const { return urlId == 0; }
 };
 
-struct HistoryNode {
-    Page page;
-    HistoryNode* next;
-    HistoryNode(Page p) : page(p), next(nullptr) {}
+// Page codec shared by state.bin and hibernated tabs. Each page is three
+// LEB128 varints: url id, title id, and the timestamp as a zigzag delta from
+// the previous page's, so a page in a navigation chain usually takes 4-6
+// bytes instead of 16.
+inline void putVarint(vector<char>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+inline bool getVarint(const char*& in, const char* end, uint64_t& v) {
+    v = 0;
+    for (unsigned shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline void encodePages(vector<char>& out, const Page* pages, size_t n, time_t previous) {
+    for (size_t i = 0; i < n; i++) {
+        int64_t delta = (int64_t)pages[i].timestamp - (int64_t)previous;
+        putVarint(out, pages[i].urlId);
+        putVarint(out, pages[i].titleId);
+        putVarint(out, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        previous = pages[i].timestamp;
+    }
+}
+
+// Appends n pages to `out`; false if the bytes run out first.
+inline bool decodePages(const char* in, size_t bytes, size_t n, time_t previous, vector<Page>& out) {
+    const char* end = in + bytes;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t url, title, zigzag;
+        if (!getVarint(in, end, url) || !getVarint(in, end, title) || !getVarint(in, end, zigzag)) return false;
+        Page p;
+        p.urlId = (UrlId)url;
+        p.titleId = (TitleId)title;
+        p.timestamp = previous + (time_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        previous = p.timestamp;
+        out.push_back(p);
+    }
+    return true;
+}
+
+// A tab's back/forward history as one fixed-capacity circular array.
+// Entries are ordered oldest to newest and `cursor` marks the current page:
+// everything before it is the back stack, everything after it the forward
+// stack. Visiting a page when the ring is full evicts the oldest entry, so
+// navigation never allocates after construction (or after restore(), for a
+// ring whose slots were released while its tab hibernated).
+class NavigationRing {
+private:
+    vector<Page> slots;
+    size_t depth;                   // capacity, kept while the slots are released
+    size_t start, count, cursor;    // cursor is relative to start; only meaningful when count > 0
+
+    Page& slot(size_t i) { return slots[(start + i) % slots.size()]; }
+    const Page& slot(size_t i) const { return slots[(start + i) % slots.size()]; }
+
+public:
+    static const size_t DEFAULT_DEPTH = 100;
+
+    class iterator {
+    private:
+        const NavigationRing* ring;
+        size_t pos;
+    public:
+        iterator(const NavigationRing* r, size_t p) : ring(r), pos(p) {}
+        const Page& operator*() const { return (*ring)[pos]; }
+        const Page* operator->() const { return &(*ring)[pos]; }
+        iterator& operator++() { ++pos; return *this; }
+        bool operator!=(const iterator& other) const { return pos != other.pos; }
+    };
+
+    explicit NavigationRing(size_t pages = DEFAULT_DEPTH)
+        : slots(pages < 1 ? 1 : pages), depth(slots.size()), start(0), count(0), cursor(0) {}
+
+    void visit(const Page& p) {
+        if (count > 0) count = cursor + 1;   // drop the forward entries
+        if (count == slots.size()) {
+            start = (start + 1) % slots.size();
+            count--;
+        }
+        slot(count) = p;
+        cursor = count++;
+    }
+
+    bool back() {
+        if (backSize() == 0) return false;
+        cursor--;
+        return true;
+    }
+
+    bool forward() {
+        if (forwardSize() == 0) return false;
+        cursor++;
+        return true;
+    }
+
+    const Page& current() const {
+        static const Page none;
+        return count ? slot(cursor) : none;
+    }
+
+    // Moves the current page to position i (oldest = 0); used when rebuilding a tab.
+    void setCursor(size_t i) {
+        if (i < count) cursor = i;
+    }
+
+    void clear() { start = count = cursor = 0; }
+
+    // Empties the ring and frees its slots until restore().
+    void release() {
+        clear();
+        vector<Page>().swap(slots);
+    }
+    void restore() {
+        if (slots.empty()) slots.resize(depth);
+    }
+    bool resident() const { return !slots.empty(); }
+
+    const Page& operator[](size_t i) const { return slot(i); }
+    size_t size() const { return count; }
+    size_t capacity() const { return depth; }
+    size_t position() const { return cursor; }
+    size_t backSize() const { return count ? cursor : 0; }
+    size_t forwardSize() const { return count ? count - cursor - 1 : 0; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, count); }
 };
 
-struct Tab {
+// Immutable copy of one tab's navigation. Every snapshot taken while the tab
+// stays unchanged shares the same record.
+struct TabRecord {
     int id;
-    Page currentPage;
-    stack<Page> backStack, forwardStack;
-    Tab(int tabId) : id(tabId) {}
+    vector<Page> entries;   // oldest to newest
+    size_t cursor;
+    int windowId = 0, groupId = 0;      // 0: unknown window / no group
+    bool urlsOnly = false;              // imported from the legacy text format: every title is missing
+    TabRecord(int tabId) : id(tabId), cursor(0) {}
+};
+
+typedef vector<shared_ptr<const TabRecord>> TabList;
+
+// Packed pages of hibernated tabs moved out of memory, in an anonymous
+// temporary file that goes away with the process. Each write gets a slot
+// that keeps naming it while it moves: once less than half of the file is
+// live, the live writes are moved to the front and the file is cut back, so
+// it never holds more than twice the bytes still spilled. Reads and writes
+// are serialized.
+class SpillFile {
+private:
+    struct Extent {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        bool live = false;
+    };
+    FILE* file = nullptr;
+    uint64_t end = 0, liveBytes = 0;
+    vector<Extent> slots;
+    vector<uint32_t> freeSlots;
+    mutable mutex lock;
+
+    bool readAt(uint64_t offset, size_t size, vector<char>& out) {
+        out.resize(size);
+        return fseek(file, (long)offset, SEEK_SET) == 0 && fread(out.data(), 1, size, file) == size;
+    }
+
+    bool writeAt(uint64_t offset, const vector<char>& bytes) {
+        return fseek(file, (long)offset, SEEK_SET) == 0 && fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+
+    // Called with `lock` held. Moves live writes down in file order, so each
+    // lands below where it was and above every write still to move; one that
+    // fails to move stays where it is.
+    void compact() {
+        vector<uint32_t> order;
+        for (uint32_t i = 0; i < slots.size(); i++)
+            if (slots[i].live) order.push_back(i);
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return slots[a].offset < slots[b].offset; });
+        uint64_t to = 0;
+        vector<char> bytes;
+        for (uint32_t i : order) {
+            Extent& e = slots[i];
+            if (e.offset != to && readAt(e.offset, e.size, bytes) && writeAt(to, bytes)) e.offset = to;
+            to = max(to, e.offset + e.size);
+        }
+        end = to;
+        // A file that cannot be cut back is only longer than it needs to be.
+        fflush(file);
+#ifdef _WIN32
+        _chsize_s(_fileno(file), (long long)end);
+#else
+        if (ftruncate(fileno(file), (off_t)end) != 0) return;
+#endif
+    }
+
+public:
+    SpillFile() = default;
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+    ~SpillFile() {
+        if (file) fclose(file);
+    }
+
+    // False if no temporary file can be made or the write fails.
+    bool write(const vector<char>& bytes, uint32_t& slot) {
+        lock_guard<mutex> guard(lock);
+        if (!file && !(file = tmpfile())) return false;
+        if (!writeAt(end, bytes)) return false;
+        if (freeSlots.empty()) {
+            freeSlots.push_back(slots.size());
+            slots.emplace_back();
+        }
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        slots[slot] = {end, (uint32_t)bytes.size(), true};
+        end += bytes.size();
+        liveBytes += bytes.size();
+        return true;
+    }
+
+    bool read(uint32_t slot, vector<char>& out) {
+        lock_guard<mutex> guard(lock);
+        return file && slot < slots.size() && slots[slot].live && readAt(slots[slot].offset, slots[slot].size, out);
+    }
+
+    // Called once per write whose bytes are no longer needed.
+    void drop(uint32_t slot) {
+        lock_guard<mutex> guard(lock);
+        if (slot >= slots.size() || !slots[slot].live) return;
+        slots[slot].live = false;
+        liveBytes -= slots[slot].size;
+        freeSlots.push_back(slot);
+        if (liveBytes * 2 < end) compact();
+    }
+
+    // The file's length, and the bytes in it still spilled.
+    uint64_t fileBytes() const {
+        lock_guard<mutex> guard(lock);
+        return end;
+    }
+    uint64_t spilledBytes() const {
+        lock_guard<mutex> guard(lock);
+        return liveBytes;
+    }
 };
 
+// A hibernated tab's pages, packed with encodePages into `bytes` or, once
+// spilled, `size` bytes in `slot` of `spill`. The current page and the
+// cursor stay at hand so listing the tab does not thaw it.
+struct PackedNav {
+    vector<char> bytes;
+    uint32_t count = 0, cursor = 0;
+    Page current;
+    SpillFile* spill = nullptr;
+    uint32_t slot = 0;
+    uint32_t size = 0;
+};
+
+// A tab loaded from state.bin starts as a stub: its pages stay in the mapped
+// file and nav stays empty until thawed() copies them in, which happens the
+// first time the tab is navigated or switched to. Until then the current
+// page, stack depths and freeze() are answered from the file.
+// A hibernated tab has released nav's slots and keeps its pages packed (a
+// stub's are already out of memory); thawed() unpacks them the same way.
+struct Tab {
+    int id;
+    int windowId = 0, groupId = 0;          // kept by TabTable; 0 is no group
+    NavigationRing nav;
+    shared_ptr<const TabRecord> frozen;     // cleared whenever nav changes
+    mutex lock;                             // guards nav and frozen while other tabs run in parallel
+    const Page* stubPages = nullptr;        // oldest to newest, while a stub
+    uint32_t stubCount = 0, stubCursor = 0;
+    unique_ptr<PackedNav> packed;           // while hibernated, unless a stub
+    Tab(int tabId, size_t depth = NavigationRing::DEFAULT_DEPTH) : id(tabId), nav(depth) {}
+
+    bool stub() const { return stubPages != nullptr; }
+    bool hibernated() const { return !nav.resident(); }
+
+    // Back to an empty tab, for reuse (see TabPool).
+    void reset() {
+        windowId = groupId = 0;
+        if (packed && packed->spill) packed->spill->drop(packed->slot);
+        packed.reset();
+        nav.restore();
+        nav.clear();
+        frozen.reset();
+        stubPages = nullptr;
+        stubCount = stubCursor = 0;
+    }
+
+    // Packs nav's pages and frees its slots; returns the bytes packed.
+    size_t hibernate() {
+        if (hibernated()) return 0;
+        if (!stubPages && nav.size()) {
+            packed.reset(new PackedNav);
+            time_t previous = 0;
+            for (auto& p : nav) {
+                encodePages(packed->bytes, &p, 1, previous);
+                previous = p.timestamp;
+            }
+            packed->bytes.shrink_to_fit();
+            packed->count = nav.size();
+            packed->cursor = nav.position();
+            packed->current = nav.current();
+        }
+        nav.release();
+        return packed ? packed->bytes.size() : 0;
+    }
+
+    // Moves the packed pages to the spill file; false if it cannot take them.
+    bool spill(SpillFile& file) {
+        if (!packed || packed->spill || !file.write(packed->bytes, packed->slot)) return false;
+        packed->spill = &file;
+        packed->size = packed->bytes.size();
+        vector<char>().swap(packed->bytes);
+        return true;
+    }
+
+    // Every page, oldest to newest, appended to `out`; returns the cursor.
+    // A page the spill file fails to give back is lost.
+    size_t copyPages(vector<Page>& out) const {
+        if (stubPages) {
+            out.insert(out.end(), stubPages, stubPages + stubCount);
+            return stubCursor;
+        }
+        if (packed) {
+            vector<char> spilled;
+            const vector<char>* bytes = &packed->bytes;
+            if (packed->spill && packed->spill->read(packed->slot, spilled)) bytes = &spilled;
+            decodePages(bytes->data(), bytes->size(), packed->count, 0, out);
+            return packed->cursor;
+        }
+        out.reserve(out.size() + nav.size());
+        for (auto& p : nav) out.push_back(p);
+        return nav.position();
+    }
+
+    // nav, with a hibernated tab's or a stub's pages copied in first.
+    NavigationRing& thawed() {
+        if (hibernated()) {
+            nav.restore();
+            if (packed) {
+                vector<Page> pages;
+                size_t cursor = copyPages(pages);
+                for (auto& p : pages) nav.visit(p);
+                nav.setCursor(cursor);
+                if (packed->spill) packed->spill->drop(packed->slot);
+                packed.reset();
+            }
+        }
+        if (stubPages) {
+            for (uint32_t i = 0; i < stubCount; i++) nav.visit(stubPages[i]);
+            size_t evicted = stubCount - nav.size();
+            nav.setCursor(stubCursor >= evicted ? stubCursor - evicted : 0);
+            stubPages = nullptr;
+        }
+        return nav;
+    }
+
+    const Page& current() const {
+        static const Page none;
+        if (stubPages) return stubCount ? stubPages[stubCursor] : none;
+        if (packed) return packed->current;
+        return nav.current();
+    }
+    size_t backSize() const {
+        if (stubPages) return stubCount ? stubCursor : 0;
+        if (packed) return packed->cursor;
+        return nav.backSize();
+    }
+    size_t forwardSize() const {
+        if (stubPages) return stubCount ? stubCount - stubCursor - 1 : 0;
+        if (packed) return packed->count - packed->cursor - 1;
+        return nav.forwardSize();
+    }
+
+    shared_ptr<const TabRecord> freeze() {
+        if (!frozen) {
+            auto record = make_shared<TabRecord>(id);
+            record->windowId = windowId;
+            record->groupId = groupId;
+            record->cursor = copyPages(record->entries);
+            frozen = record;
+        }
+        return frozen;
+    }
+};
 
+// A snapshot loaded from state.bin has no tabs until they are decoded
+// (FileManager::loadSnapshotTabs); `stored` is its index there.
+// A snapshot of one window or group names it; restoring it only replaces
+// that window's or group's tabs.
 struct SessionSnapshot {
     time_t timestamp;
     string description;
-    vector<pair<int, string>> tabData;
-    SessionSnapshot() : timestamp(time(nullptr)) {}
-    SessionSnapshot(string desc) : timestamp(time(nullptr)), description(desc) {}
+    shared_ptr<const TabList> tabs;
+    uint32_t stored = 0;
+    int windowId = 0, groupId = 0;      // both 0 for the whole session
+    SessionSnapshot() : timestamp(time(nullptr)), tabs(make_shared<TabList>()) {}
+    SessionSnapshot(string desc) : timestamp(time(nullptr)), description(desc), tabs(make_shared<TabList>()) {}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,397 @@
+#ifndef TABTABLE_H
+#define TABTABLE_H
+
+#include "structures.h"
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Refers to one open tab. A handle outlives its tab safely: once the tab is
+// closed its slot's generation moves on and the handle stops resolving.
+struct TabHandle {
+    static const uint32_t NONE = UINT32_MAX;
+    uint32_t slot = NONE, generation = 0;
+    bool operator==(const TabHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const TabHandle& other) const { return !(*this == other); }
+};
+
+// Tab objects carved out of fixed chunks. A released tab is reset but kept,
+// ring buffer included, and handed out again by the next acquire() (with a
+// new ring if it asks for another depth), so
+// opening and closing tabs or restoring a session reuses memory instead of
+// going to the heap once the pool has grown to the largest tab count seen.
+class TabPool {
+private:
+    static const size_t CHUNK = 64;
+    vector<Tab*> chunks;        // raw storage for CHUNK tabs each
+    size_t constructed = 0;
+    vector<Tab*> spare;         // released, ready for reuse
+
+public:
+    TabPool() = default;
+    TabPool(const TabPool&) = delete;
+    TabPool& operator=(const TabPool&) = delete;
+
+    ~TabPool() {
+        for (size_t i = 0; i < constructed; i++) chunks[i / CHUNK][i % CHUNK].~Tab();
+        for (Tab* chunk : chunks) ::operator delete(chunk);
+    }
+
+    Tab* acquire(int id, size_t depth = NavigationRing::DEFAULT_DEPTH) {
+        if (!spare.empty()) {
+            Tab* tab = spare.back();
+            spare.pop_back();
+            tab->id = id;
+            if (tab->nav.capacity() != depth) tab->nav = NavigationRing(depth);
+            return tab;
+        }
+        if (constructed == chunks.size() * CHUNK) chunks.push_back(static_cast<Tab*>(::operator new(sizeof(Tab) * CHUNK)));
+        return new (chunks.back() + constructed++ % CHUNK) Tab(id, depth);
+    }
+
+    void release(Tab* tab) {
+        tab->reset();
+        spare.push_back(tab);
+    }
+};
+
+// Tabs of one window or group, in order, linked through the table's slots.
+struct TabChain {
+    uint32_t head = TabHandle::NONE, tail = TabHandle::NONE;
+    size_t size = 0;
+};
+
+struct Window {
+    int id;
+    TabChain tabs;
+    TabHandle active;           // the tab shown when the window is switched to
+};
+
+// A named set of tabs within one window.
+struct TabGroup {
+    int id, windowId;
+    string name;
+    TabChain tabs;
+    TabHandle active;
+};
+
+// The open tabs and the windows and groups holding them.
+// Tabs sit in a slot map with generation-checked handles and a hash index by
+// Tab::id. Each slot carries two pairs of links, one for its window's tab
+// order and one for its group's, so a window or group reaches its own tabs
+// without touching the rest and opening, closing, regrouping or looking up a
+// tab is O(1); moving a group between windows is O(group). Closed slots are
+// reused through a free list.
+// A third pair of links keeps every tab in order of last use, for
+// hibernation; touch() is the one call that changes it outside open() and
+// close(), and the table leaves synchronizing it to the caller.
+// Whole-table order is window by window, each in its own tab order; only
+// positions in it (the menu's tab numbers) take a walk.
+// A tab's window and group are mirrored in Tab::windowId and Tab::groupId.
+class TabTable {
+private:
+    enum Lane { IN_WINDOW, IN_GROUP, BY_USE, LANES };
+    struct Slot {
+        Tab* tab;               // null while free
+        uint32_t generation;
+        uint32_t prev[LANES], next[LANES];  // next[IN_WINDOW] links the free list while free
+        time_t used;
+    };
+    static const uint32_t NONE = TabHandle::NONE;
+    vector<Slot> slots;
+    uint32_t freeSlots = NONE;
+    size_t count = 0;
+    unordered_map<int, uint32_t> byId;
+    unordered_map<int, Window> windows;
+    vector<int> windowOrder;
+    unordered_map<int, TabGroup> groups;
+    TabChain byUse;             // least recently used first
+    TabPool pool;
+    size_t depth;               // of every tab's navigation ring
+
+    TabHandle handleOf(uint32_t s) const { return s == NONE ? TabHandle() : TabHandle{s, slots[s].generation}; }
+
+    void link(TabChain& chain, Lane lane, uint32_t s) {
+        slots[s].prev[lane] = chain.tail;
+        slots[s].next[lane] = NONE;
+        (chain.tail != NONE ? slots[chain.tail].next[lane] : chain.head) = s;
+        chain.tail = s;
+        chain.size++;
+    }
+
+    // Hands the chain's active tab to a neighbour if it was this one.
+    void unlink(TabChain& chain, TabHandle& active, Lane lane, uint32_t s) {
+        Slot& slot = slots[s];
+        if (active.slot == s) active = handleOf(slot.next[lane] != NONE ? slot.next[lane] : slot.prev[lane]);
+        (slot.prev[lane] != NONE ? slots[slot.prev[lane]].next[lane] : chain.head) = slot.next[lane];
+        (slot.next[lane] != NONE ? slots[slot.next[lane]].prev[lane] : chain.tail) = slot.prev[lane];
+        chain.size--;
+    }
+
+    void leaveGroup(uint32_t s) {
+        Tab* tab = slots[s].tab;
+        if (!tab->groupId) return;
+        TabGroup& g = groups.at(tab->groupId);
+        unlink(g.tabs, g.active, IN_GROUP, s);
+        tab->groupId = 0;
+    }
+
+    void moveToWindow(uint32_t s, Window& to) {
+        Tab* tab = slots[s].tab;
+        Window& from = windows.at(tab->windowId);
+        unlink(from.tabs, from.active, IN_WINDOW, s);
+        link(to.tabs, IN_WINDOW, s);
+        tab->windowId = to.id;
+        if (to.active.slot == NONE) to.active = handleOf(s);
+    }
+
+public:
+    class iterator {
+    private:
+        const TabTable* table;
+        Lane lane;
+        size_t window;          // index into windowOrder when walking every window, else SIZE_MAX
+        uint32_t slot;
+        void skipEmpty() {
+            while (slot == NONE && window != SIZE_MAX && ++window < table->windowOrder.size())
+                slot = table->windows.at(table->windowOrder[window]).tabs.head;
+        }
+    public:
+        iterator(const TabTable* t, Lane l, size_t w, uint32_t s) : table(t), lane(l), window(w), slot(s) { skipEmpty(); }
+        Tab* operator*() const { return table->slots[slot].tab; }
+        TabHandle handle() const { return table->handleOf(slot); }
+        iterator& operator++() {
+            slot = table->slots[slot].next[lane];
+            skipEmpty();
+            return *this;
+        }
+        bool operator!=(const iterator& other) const { return slot != other.slot; }
+    };
+
+    struct Range {
+        iterator first, last;
+        iterator begin() const { return first; }
+        iterator end() const { return last; }
+    };
+
+    explicit TabTable(size_t tabDepth = NavigationRing::DEFAULT_DEPTH) : depth(tabDepth < 1 ? 1 : tabDepth) {}
+    TabTable(const TabTable&) = delete;
+    TabTable& operator=(const TabTable&) = delete;
+    ~TabTable() { clear(); }
+
+    // ------------------ Windows & groups ------------------
+    // Returns false if the id is taken.
+    bool openWindow(int id) {
+        if (!windows.insert({id, Window{id, {}, {}}}).second) return false;
+        windowOrder.push_back(id);
+        return true;
+    }
+
+    // Only an empty window closes.
+    bool closeWindow(int id) {
+        auto it = windows.find(id);
+        if (it == windows.end() || it->second.tabs.size) return false;
+        windows.erase(it);
+        windowOrder.erase(std::find(windowOrder.begin(), windowOrder.end(), id));
+        return true;
+    }
+
+    bool createGroup(int id, int windowId, const string& name) {
+        if (!windows.count(windowId)) return false;
+        return groups.insert({id, TabGroup{id, windowId, name, {}, {}}}).second;
+    }
+
+    // Only an empty group is removed.
+    bool removeGroup(int id) {
+        auto it = groups.find(id);
+        if (it == groups.end() || it->second.tabs.size) return false;
+        groups.erase(it);
+        return true;
+    }
+
+    Window* window(int id) {
+        auto it = windows.find(id);
+        return it == windows.end() ? nullptr : &it->second;
+    }
+    const Window* window(int id) const { return const_cast<TabTable*>(this)->window(id); }
+
+    TabGroup* group(int id) {
+        auto it = groups.find(id);
+        return it == groups.end() ? nullptr : &it->second;
+    }
+    const TabGroup* group(int id) const { return const_cast<TabTable*>(this)->group(id); }
+
+    const vector<int>& windowIds() const { return windowOrder; }
+    const unordered_map<int, TabGroup>& allGroups() const { return groups; }
+
+    // Adds the tab at the end of the group (0 takes it out of its group). A
+    // tab joining a group in another window moves to the end of that window.
+    bool setGroup(TabHandle h, int groupId) {
+        Tab* tab = get(h);
+        TabGroup* g = groupId ? group(groupId) : nullptr;
+        if (!tab || (groupId && !g)) return false;
+        if (tab->groupId == groupId) return true;
+        leaveGroup(h.slot);
+        if (!g) return true;
+        if (tab->windowId != g->windowId) moveToWindow(h.slot, windows.at(g->windowId));
+        link(g->tabs, IN_GROUP, h.slot);
+        tab->groupId = groupId;
+        if (g->active.slot == NONE) g->active = h;
+        return true;
+    }
+
+    // Moves every tab of the group to the end of another window, in group order.
+    bool moveGroup(int groupId, int windowId) {
+        TabGroup* g = group(groupId);
+        Window* to = window(windowId);
+        if (!g || !to) return false;
+        for (uint32_t s = g->tabs.head; s != NONE; s = slots[s].next[IN_GROUP]) moveToWindow(s, *to);
+        g->windowId = windowId;
+        return true;
+    }
+
+    // Makes the tab the active one of its window and group.
+    void activate(TabHandle h) {
+        Tab* tab = get(h);
+        if (!tab) return;
+        windows.at(tab->windowId).active = h;
+        if (tab->groupId) groups.at(tab->groupId).active = h;
+    }
+
+    Range windowTabs(int id) const {
+        const Window* w = window(id);
+        return {iterator(this, IN_WINDOW, SIZE_MAX, w ? w->tabs.head : NONE), end()};
+    }
+
+    Range groupTabs(int id) const {
+        const TabGroup* g = group(id);
+        return {iterator(this, IN_GROUP, SIZE_MAX, g ? g->tabs.head : NONE), end()};
+    }
+
+    // ------------------ Tabs ------------------
+    // Pages each tab keeps before the oldest are evicted.
+    size_t tabDepth() const { return depth; }
+
+    // Opens a tab at the end of a window, created if needed, and of a group
+    // (if given and in that window).
+    TabHandle open(int id, int windowId, int groupId = 0) {
+        openWindow(windowId);
+        uint32_t s = freeSlots;
+        if (s != NONE) freeSlots = slots[s].next[IN_WINDOW];
+        else {
+            s = slots.size();
+            slots.push_back({nullptr, 0, {NONE, NONE, NONE}, {NONE, NONE, NONE}, 0});
+        }
+        Tab* tab = slots[s].tab = pool.acquire(id, depth);
+        TabHandle h = handleOf(s);
+        Window& w = windows.at(windowId);
+        link(w.tabs, IN_WINDOW, s);
+        tab->windowId = windowId;
+        if (w.active.slot == NONE) w.active = h;
+        link(byUse, BY_USE, s);
+        slots[s].used = time(nullptr);
+        byId[id] = s;
+        count++;
+        TabGroup* g = groupId ? group(groupId) : nullptr;
+        if (g && g->windowId == windowId) setGroup(h, groupId);
+        return h;
+    }
+
+    // Returns false for a stale handle. The window and group stay, even if empty.
+    bool close(TabHandle h) {
+        Tab* tab = get(h);
+        if (!tab) return false;
+        leaveGroup(h.slot);
+        Window& w = windows.at(tab->windowId);
+        unlink(w.tabs, w.active, IN_WINDOW, h.slot);
+        TabHandle none;
+        unlink(byUse, none, BY_USE, h.slot);
+        byId.erase(tab->id);
+        pool.release(tab);
+        Slot& slot = slots[h.slot];
+        slot.tab = nullptr;
+        slot.generation++;
+        slot.next[IN_WINDOW] = freeSlots;
+        freeSlots = h.slot;
+        count--;
+        return true;
+    }
+
+    // Closes every tab; windows and groups stay, empty.
+    void clear() {
+        vector<TabHandle> live;
+        for (auto it = begin(); it != end(); ++it) live.push_back(it.handle());
+        for (auto h : live) close(h);
+    }
+
+    // The tab a handle refers to, or null once it has closed.
+    Tab* get(TabHandle h) const {
+        return h.slot < slots.size() && slots[h.slot].generation == h.generation ? slots[h.slot].tab : nullptr;
+    }
+
+    TabHandle find(int id) const {
+        auto it = byId.find(id);
+        return it == byId.end() ? TabHandle() : handleOf(it->second);
+    }
+
+    Tab* findTab(int id) const { return get(find(id)); }
+
+    // The tab at a position in the whole-table order, and back.
+    TabHandle at(size_t position) const {
+        for (int id : windowOrder) {
+            const TabChain& chain = windows.at(id).tabs;
+            if (position >= chain.size) {
+                position -= chain.size;
+                continue;
+            }
+            uint32_t s = chain.head;
+            while (position--) s = slots[s].next[IN_WINDOW];
+            return handleOf(s);
+        }
+        return TabHandle();
+    }
+
+    int positionOf(TabHandle h) const {
+        Tab* tab = get(h);
+        if (!tab) return -1;
+        int position = 0;
+        for (int id : windowOrder) {
+            if (id == tab->windowId) break;
+            position += windows.at(id).tabs.size;
+        }
+        for (uint32_t s = windows.at(tab->windowId).tabs.head; s != h.slot; s = slots[s].next[IN_WINDOW]) position++;
+        return position;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // ------------------ Order of use ------------------
+    // Makes the tab the most recently used.
+    void touch(int id, time_t now) {
+        auto it = byId.find(id);
+        if (it == byId.end()) return;
+        TabHandle none;
+        unlink(byUse, none, BY_USE, it->second);
+        link(byUse, BY_USE, it->second);
+        slots[it->second].used = now;
+    }
+
+    time_t lastUsed(TabHandle h) const { return get(h) ? slots[h.slot].used : 0; }
+    TabHandle leastRecent() const { return handleOf(byUse.head); }
+    TabHandle mostRecent() const { return handleOf(byUse.tail); }
+    TabHandle moreRecent(TabHandle h) const { return get(h) ? handleOf(slots[h.slot].next[BY_USE]) : TabHandle(); }
+    TabHandle lessRecent(TabHandle h) const { return get(h) ? handleOf(slots[h.slot].prev[BY_USE]) : TabHandle(); }
+
+    iterator begin() const {
+        return iterator(this, IN_WINDOW, 0, windowOrder.empty() ? NONE : windows.at(windowOrder[0]).tabs.head);
+    }
+    iterator end() const { return iterator(this, IN_WINDOW, SIZE_MAX, NONE); }
+};
+
+#endif
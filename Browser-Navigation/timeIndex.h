@@ -0,0 +1,80 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include "historyLog.h"
+#include <algorithm>
+#include <ctime>
+#include <deque>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// One page of a history listing, newest first. `next` is the cursor for the
+// page after it, or 0 when there is none.
+struct HistoryPage {
+    vector<Page> visits;
+    size_t next = 0;
+};
+
+// Time-ordered index over history positions.
+// History is in visit order, which is time order apart from a few stragglers
+// (visits from several threads within the same second, or journal entries
+// replayed with their recorded times), so rather than sorting it the index
+// keeps two bounds per block of BLOCK positions: the latest timestamp of any
+// entry up to the end of the block and the earliest of any entry from the
+// start of the block on. Both are non-decreasing across blocks, so one binary
+// search over each brackets every visit in a time range, and for history in
+// time order only the two blocks at its edges hold visits outside it.
+class TimeIndex {
+private:
+    static const size_t BLOCK = 64;
+    struct Block {
+        time_t latest;      // max over every position before this block's end
+        time_t earliest;    // min over every position from this block's start
+    };
+    deque<Block> blocks;
+    size_t origin = 0;      // position of blocks[0]'s first entry
+    size_t indexed = 0;     // one past the last position added
+
+public:
+    void build(const HistoryLog& history) {
+        blocks.clear();
+        origin = indexed = history.start();
+        for (auto& p : history) add(p.timestamp);
+    }
+
+    // Indexes the next position. A straggler only lowers the `earliest` of
+    // the recent blocks that are newer than it.
+    void add(time_t t) {
+        if ((indexed - origin) % BLOCK == 0)
+            blocks.push_back({blocks.empty() ? t : max(blocks.back().latest, t), t});
+        else {
+            blocks.back().latest = max(blocks.back().latest, t);
+            blocks.back().earliest = min(blocks.back().earliest, t);
+        }
+        for (size_t b = blocks.size() - 1; b-- > 0 && blocks[b].earliest > t;) blocks[b].earliest = t;
+        indexed++;
+    }
+
+    // Forgets whole blocks before `position`. The bounds of the rest may still
+    // count expired entries, which only widens the ranges returned.
+    void expire(size_t position) {
+        while (!blocks.empty() && origin + BLOCK <= position) {
+            blocks.pop_front();
+            origin += BLOCK;
+        }
+    }
+
+    // Positions [first, last) holding every visit in [from, to]; the caller
+    // filters out the ones in between that fall outside it.
+    pair<size_t, size_t> range(time_t from, time_t to) const {
+        size_t lo = partition_point(blocks.begin(), blocks.end(), [&](const Block& b) { return b.latest < from; }) -
+                    blocks.begin();
+        size_t hi = partition_point(blocks.begin(), blocks.end(), [&](const Block& b) { return b.earliest <= to; }) -
+                    blocks.begin();
+        if (lo >= hi) return {indexed, indexed};
+        return {origin + lo * BLOCK, min(indexed, origin + hi * BLOCK)};
+    }
+};
+
+#endif
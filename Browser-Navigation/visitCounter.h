@@ -0,0 +1,382 @@
+#ifndef VISITCOUNTER_H
+#define VISITCOUNTER_H
+
+#include "stringPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// The true visit count lies in [count - error, count]; error is 0 for exact counts.
+struct VisitEstimate {
+    UrlId urlId;
+    uint32_t count, error;
+};
+
+// Count-Min Sketch with conservative update: a depth x width grid of counters
+// in which every key increments one counter per row. An estimate is the
+// smallest of its counters, so it never undercounts and overcounts by at most
+// e / width * total with probability 1 - exp(-depth).
+class CountMinSketch {
+private:
+    size_t rows, columns;       // columns is a power of two
+    vector<uint32_t> table;
+
+    size_t cell(size_t row, UrlId key) const {
+        static const uint64_t SEEDS[] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+                                         0xD6E8FEB86659FD93ULL, 0xFF51AFD7ED558CCDULL, 0xC4CEB9FE1A85EC53ULL};
+        uint64_t h = ((uint64_t)key + 1) * SEEDS[row % 6] + row;
+        return row * columns + ((h ^ (h >> 29)) & (columns - 1));
+    }
+
+public:
+    CountMinSketch(size_t width = 0, size_t depth = 4) : rows(depth), columns(1) {
+        while (columns < width) columns <<= 1;
+        table.assign(width ? rows * columns : 0, 0);
+    }
+
+    void add(UrlId key, uint32_t n = 1) {
+        if (table.empty()) return;
+        uint32_t target = estimate(key) + n;
+        for (size_t r = 0; r < rows; r++) {
+            uint32_t& c = table[cell(r, key)];
+            c = max(c, target);
+        }
+    }
+
+    uint32_t estimate(UrlId key) const {
+        if (table.empty()) return 0;
+        uint32_t best = UINT32_MAX;
+        for (size_t r = 0; r < rows; r++) best = min(best, table[cell(r, key)]);
+        return best;
+    }
+
+    size_t width() const { return columns; }
+    size_t depth() const { return rows; }
+    const vector<uint32_t>& data() const { return table; }
+
+    // Adopts a saved table; ignored if its shape does not match this sketch.
+    void assign(const uint32_t* cells, size_t count) {
+        if (count == table.size()) table.assign(cells, cells + count);
+    }
+};
+
+// Visit counts kept ordered by count, so the most visited URLs are always a
+// prefix of the slot array and a top-K query just reads K slots.
+// Slots are sorted by count, descending, and equal counts form a group whose
+// first slot is tracked. An increment swaps the URL to the front of its group
+// and bumps it, which keeps the order in O(1) per visit.
+//
+// With a capacity the counter is bounded (Space-Saving): once every slot is
+// taken, a new URL replaces the least counted one and inherits its count as
+// error. Every visit also goes into a Count-Min Sketch, which answers for
+// URLs no longer holding a slot.
+class VisitCounter {
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    size_t capacity;                        // 0 = exact, unbounded
+    vector<UrlId> urls;                     // slot -> URL
+    vector<uint32_t> counts, errors;        // slot -> count, overestimate
+    vector<uint32_t> slotByUrl;             // exact mode: UrlId -> slot
+    unordered_map<UrlId, uint32_t> slotMap; // bounded mode: UrlId -> slot
+    unordered_map<uint32_t, uint32_t> groupStart;   // count -> first slot holding it
+    CountMinSketch sketch;
+    uint64_t visits;
+
+    uint32_t slotOf(UrlId url) const {
+        if (!capacity) return url < slotByUrl.size() ? slotByUrl[url] : NO_SLOT;
+        auto it = slotMap.find(url);
+        return it == slotMap.end() ? NO_SLOT : it->second;
+    }
+
+    void setSlot(UrlId url, uint32_t slot) {
+        if (capacity) {
+            slotMap[url] = slot;
+            return;
+        }
+        if (url >= slotByUrl.size()) slotByUrl.resize(max<size_t>(url + 1, slotByUrl.size() * 2), NO_SLOT);
+        slotByUrl[url] = slot;
+    }
+
+    void swapSlots(uint32_t a, uint32_t b) {
+        swap(urls[a], urls[b]);
+        swap(counts[a], counts[b]);
+        swap(errors[a], errors[b]);
+        setSlot(urls[a], a);
+        setSlot(urls[b], b);
+    }
+
+    // Adds n to the slot's count, keeping the group invariant; returns where it ends up.
+    // Each step moves it to the front of its group and up to the count above,
+    // so a large n costs one step per group passed rather than one per count.
+    uint32_t increment(uint32_t slot, uint32_t n) {
+        uint32_t target = counts[slot] + n;
+        while (counts[slot] < target) {
+            uint32_t c = counts[slot];
+            auto group = groupStart.find(c);
+            uint32_t first = group->second;
+            if (first != slot) swapSlots(first, slot);
+            if (first + 1 < counts.size() && counts[first + 1] == c) group->second = first + 1;
+            else groupStart.erase(group);
+            uint32_t next = first ? min(target, counts[first - 1]) : target;
+            counts[first] = next;
+            if (first == 0 || counts[first - 1] != next) groupStart.emplace(next, first);
+            slot = first;
+        }
+        return slot;
+    }
+
+    uint32_t newSlot(UrlId url) {
+        if (capacity && urls.size() == capacity) {
+            // Space-Saving: the least counted URL gives up its slot.
+            uint32_t victim = urls.size() - 1;
+            slotMap.erase(urls[victim]);
+            urls[victim] = url;
+            errors[victim] = counts[victim];
+            setSlot(url, victim);
+            return victim;
+        }
+        uint32_t slot = urls.size();
+        urls.push_back(url);
+        counts.push_back(0);
+        errors.push_back(0);
+        groupStart.emplace(0, slot);
+        setSlot(url, slot);
+        return slot;
+    }
+
+public:
+    explicit VisitCounter(size_t maxTracked = 0)
+        : capacity(maxTracked), sketch(maxTracked ? max<size_t>(1024, maxTracked) : 0), visits(0) {}
+
+    void add(UrlId url, uint32_t n = 1) {
+        uint32_t slot = slotOf(url);
+        if (slot == NO_SLOT) slot = newSlot(url);
+        increment(slot, n);
+        sketch.add(url, n);
+        visits += n;
+    }
+
+    // Replaces the contents with saved counts (any order). In bounded mode
+    // only the largest `capacity` keep a slot; the rest survive in the sketch.
+    void assign(vector<VisitEstimate> entries) {
+        auto byCount = [](const VisitEstimate& a, const VisitEstimate& b) { return a.count > b.count; };
+        if (!is_sorted(entries.begin(), entries.end(), byCount))
+            stable_sort(entries.begin(), entries.end(), byCount);
+        urls.clear();
+        counts.clear();
+        errors.clear();
+        slotByUrl.clear();
+        slotMap.clear();
+        groupStart.clear();
+        sketch = CountMinSketch(sketch.data().empty() ? 0 : sketch.width(), sketch.depth());
+        visits = 0;
+        for (auto& e : entries) {
+            visits += e.count;
+            sketch.add(e.urlId, e.count);
+            if (capacity && urls.size() == capacity) continue;
+            uint32_t slot = urls.size();
+            urls.push_back(e.urlId);
+            counts.push_back(e.count);
+            errors.push_back(capacity ? e.error : 0);
+            setSlot(e.urlId, slot);
+            groupStart.emplace(e.count, slot);
+        }
+    }
+
+    // Restores the saved sketch, which also remembers URLs that lost their slot.
+    void assignSketch(const uint32_t* cells, size_t count) { sketch.assign(cells, count); }
+
+    VisitEstimate estimate(UrlId url) const {
+        uint32_t slot = slotOf(url);
+        if (slot != NO_SLOT) return {url, counts[slot], errors[slot]};
+        if (!capacity) return {url, 0, 0};
+        // Never held a slot, or lost it: neither bound can be below the true count.
+        uint32_t bound = min(sketch.estimate(url), urls.size() == capacity ? counts.back() : 0);
+        return {url, bound, bound};
+    }
+
+    uint32_t count(UrlId url) const { return estimate(url).count; }
+
+    // The k most visited URLs, most visited first, in O(k).
+    vector<VisitEstimate> top(size_t k) const {
+        vector<VisitEstimate> out;
+        for (size_t i = 0; i < min(k, urls.size()); i++) out.push_back({urls[i], counts[i], errors[i]});
+        return out;
+    }
+
+    // Whether the i-th entry of top() is certainly among the top i + 1: its
+    // lowest possible count beats anything that could be ranked below it.
+    bool guaranteed(size_t i) const {
+        uint32_t rival = i + 1 < counts.size() ? counts[i + 1] : 0;
+        if (capacity && urls.size() == capacity) rival = max(rival, counts.back());
+        return counts[i] - errors[i] >= rival;
+    }
+
+    // Largest overcount any estimate can carry: the smallest tracked count in
+    // bounded mode once full (Space-Saving guarantees it is at most visits / capacity).
+    uint32_t errorBound() const { return capacity && urls.size() == capacity ? counts.back() : 0; }
+
+    // Count-Min Sketch overcount bound (e / width * visits), holding with probability 1 - exp(-depth).
+    double sketchErrorBound() const { return capacity ? exp(1.0) / sketch.width() * visits : 0; }
+
+    VisitEstimate operator[](size_t slot) const { return {urls[slot], counts[slot], errors[slot]}; }
+    size_t size() const { return urls.size(); }
+    bool empty() const { return urls.empty(); }
+    bool bounded() const { return capacity != 0; }
+    uint64_t total() const { return visits; }
+    const CountMinSketch& sketchTable() const { return sketch; }
+};
+
+// A VisitCounter split by URL into SHARDS, each behind its own mutex, so
+// threads counting different URLs rarely wait for each other. Queries merge
+// the heads of the shards. In bounded mode each shard tracks an equal share
+// of the capacity and keeps its own sketch.
+class ShardedVisitCounter {
+public:
+    static const size_t SHARD_BITS = 4, SHARDS = size_t(1) << SHARD_BITS;
+
+private:
+    struct Shard {
+        mutable mutex lock;
+        VisitCounter counter;
+    };
+
+    unique_ptr<Shard[]> shards;
+    size_t capacity;
+
+    Shard& shardOf(UrlId url) const { return shards[((uint64_t)url * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS)]; }
+
+    static bool moreVisited(const VisitEstimate& a, const VisitEstimate& b) {
+        return a.count != b.count ? a.count > b.count : a.urlId < b.urlId;
+    }
+
+public:
+    explicit ShardedVisitCounter(size_t maxTracked = 0) : shards(new Shard[SHARDS]), capacity(maxTracked) {
+        for (size_t s = 0; s < SHARDS; s++) shards[s].counter = VisitCounter((maxTracked + SHARDS - 1) / SHARDS);
+    }
+
+    void add(UrlId url, uint32_t n = 1) {
+        Shard& shard = shardOf(url);
+        lock_guard<mutex> guard(shard.lock);
+        shard.counter.add(url, n);
+    }
+
+    VisitEstimate estimate(UrlId url) const {
+        Shard& shard = shardOf(url);
+        lock_guard<mutex> guard(shard.lock);
+        return shard.counter.estimate(url);
+    }
+
+    uint32_t count(UrlId url) const { return estimate(url).count; }
+
+    // The k most visited URLs, most visited first, in O(k * SHARDS).
+    vector<VisitEstimate> top(size_t k) const {
+        vector<VisitEstimate> out;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            auto head = shards[s].counter.top(k);
+            out.insert(out.end(), head.begin(), head.end());
+        }
+        size_t n = min(k, out.size());
+        partial_sort(out.begin(), out.begin() + n, out.end(), moreVisited);
+        out.resize(n);
+        return out;
+    }
+
+    // Whether the i-th entry of top() is certainly among the top i + 1.
+    bool guaranteed(size_t i) const {
+        auto head = top(i + 2);
+        if (i >= head.size()) return false;
+        uint32_t rival = max(i + 1 < head.size() ? head[i + 1].count : 0, errorBound());
+        return head[i].count - head[i].error >= rival;
+    }
+
+    // A URL without a slot may have been counted up to its shard's bound, so the largest one holds for all.
+    uint32_t errorBound() const {
+        uint32_t bound = 0;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            bound = max(bound, shards[s].counter.errorBound());
+        }
+        return bound;
+    }
+
+    double sketchErrorBound() const {
+        double bound = 0;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            bound = max(bound, shards[s].counter.sketchErrorBound());
+        }
+        return bound;
+    }
+
+    // Every tracked count, most visited first.
+    vector<VisitEstimate> entries() const {
+        vector<VisitEstimate> out;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            for (size_t i = 0; i < shards[s].counter.size(); i++) out.push_back(shards[s].counter[i]);
+        }
+        sort(out.begin(), out.end(), moreVisited);
+        return out;
+    }
+
+    // Replaces the contents with saved counts (any order).
+    void assign(const vector<VisitEstimate>& saved) {
+        vector<vector<VisitEstimate>> parts(SHARDS);
+        for (auto& e : saved) parts[&shardOf(e.urlId) - shards.get()].push_back(e);
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            shards[s].counter.assign(move(parts[s]));
+        }
+    }
+
+    // Every shard's sketch, one after another.
+    vector<uint32_t> sketchCells() const {
+        vector<uint32_t> cells;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            auto& data = shards[s].counter.sketchTable().data();
+            cells.insert(cells.end(), data.begin(), data.end());
+        }
+        return cells;
+    }
+
+    // Restores sketchCells(); ignored unless it splits evenly into the shards.
+    void assignSketch(const uint32_t* cells, size_t count) {
+        if (count % SHARDS) return;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            shards[s].counter.assignSketch(cells + s * (count / SHARDS), count / SHARDS);
+        }
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            n += shards[s].counter.size();
+        }
+        return n;
+    }
+
+    bool empty() const { return size() == 0; }
+    bool bounded() const { return capacity != 0; }
+
+    uint64_t total() const {
+        uint64_t n = 0;
+        for (size_t s = 0; s < SHARDS; s++) {
+            lock_guard<mutex> guard(shards[s].lock);
+            n += shards[s].counter.total();
+        }
+        return n;
+    }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef VISITQUEUE_H
+#define VISITQUEUE_H
+
+#include "structures.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Bounded lock-free queue carrying visits from any number of threads to one
+// consumer thread, which hands them to `absorb` in batches.
+// Every cell holds a sequence number: a producer may claim position p (a CAS
+// on `tail`) once cell p % CAPACITY reads p, writes the page and sets it to
+// p + 1; the consumer takes cells in order once they read p + 1 and returns
+// them with p + CAPACITY. A full queue makes producers yield until the
+// consumer catches up. Positions double as tickets, so flush() only waits for
+// the consumer to pass the tail it saw.
+class VisitQueue {
+public:
+    static const size_t CAPACITY = 1 << 16, BATCH = 1024;
+
+private:
+    struct Cell {
+        atomic<uint64_t> sequence;
+        Page page;
+    };
+
+    unique_ptr<Cell[]> cells;
+    alignas(64) atomic<uint64_t> tail;      // next position to claim
+    alignas(64) atomic<uint64_t> applied;   // positions absorbed so far
+    uint64_t head;                          // consumer only
+    atomic<bool> idle, stopping;
+    mutex lock;
+    condition_variable wake, drained;
+    function<void(const Page*, size_t)> absorb;
+    thread consumer;
+
+    bool ready() const { return cells[head & (CAPACITY - 1)].sequence.load(memory_order_acquire) == head + 1; }
+
+    void run() {
+        vector<Page> batch;
+        batch.reserve(BATCH);
+        for (;;) {
+            while (batch.size() < BATCH && ready()) {
+                Cell& cell = cells[head & (CAPACITY - 1)];
+                batch.push_back(cell.page);
+                cell.sequence.store(head + CAPACITY, memory_order_release);
+                head++;
+            }
+            if (!batch.empty()) {
+                absorb(batch.data(), batch.size());
+                batch.clear();
+                {
+                    lock_guard<mutex> guard(lock);
+                    applied.store(head, memory_order_release);
+                }
+                drained.notify_all();
+                continue;
+            }
+            // Pairs with the fence in push(): either the producer sees `idle`
+            // and wakes us, or we see its cell here.
+            idle.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            {
+                unique_lock<mutex> held(lock);
+                wake.wait(held, [this] { return ready() || stopping; });
+            }
+            idle.store(false, memory_order_relaxed);
+            if (!ready() && stopping) return;
+        }
+    }
+
+public:
+    VisitQueue() : cells(new Cell[CAPACITY]), tail(0), applied(0), head(0), idle(false), stopping(false) {
+        for (size_t i = 0; i < CAPACITY; i++) cells[i].sequence.store(i, memory_order_relaxed);
+    }
+    VisitQueue(const VisitQueue&) = delete;
+    VisitQueue& operator=(const VisitQueue&) = delete;
+    ~VisitQueue() { stop(); }
+
+    void start(function<void(const Page*, size_t)> consume) {
+        absorb = move(consume);
+        consumer = thread([this] { run(); });
+    }
+
+    void push(const Page& p) {
+        uint64_t pos = tail.load(memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & (CAPACITY - 1)];
+            uint64_t sequence = cell->sequence.load(memory_order_acquire);
+            if (sequence == pos) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+            } else {
+                if (sequence < pos) this_thread::yield();     // full
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+        cell->page = p;
+        cell->sequence.store(pos + 1, memory_order_release);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (idle.load(memory_order_relaxed)) {
+            lock_guard<mutex> guard(lock);
+            wake.notify_one();
+        }
+    }
+
+    // Returns once every visit pushed before the call has been absorbed.
+    void flush() {
+        uint64_t target = tail.load(memory_order_acquire);
+        unique_lock<mutex> held(lock);
+        drained.wait(held, [&] { return applied.load(memory_order_acquire) >= target; });
+    }
+
+    // Absorbs what is left and ends the consumer; pushes must have stopped.
+    void stop() {
+        if (!consumer.joinable()) return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        consumer.join();
+    }
+
+    size_t pending() const { return tail.load(memory_order_relaxed) - applied.load(memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// A few threads that run batches of independent tasks, such as the state.bin
+// sections being serialized during a save. run() returns once the whole
+// batch is done, so a batch takes as long as its slowest task rather than
+// the sum of all of them. The calling thread works through the batch too.
+class WorkerPool {
+private:
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, finished;
+    deque<function<void()>> tasks;
+    size_t running;                 // taken but not finished
+    bool stopping;
+
+    // Runs the next task with `held` released; returns false when there is none.
+    bool runOne(unique_lock<mutex>& held) {
+        if (tasks.empty()) return false;
+        function<void()> task = move(tasks.front());
+        tasks.pop_front();
+        running++;
+        held.unlock();
+        task();
+        held.lock();
+        if (--running == 0 && tasks.empty()) finished.notify_all();
+        return true;
+    }
+
+    void work() {
+        unique_lock<mutex> held(lock);
+        for (;;) {
+            wake.wait(held, [this] { return stopping || !tasks.empty(); });
+            if (!runOne(held)) return;
+        }
+    }
+
+public:
+    explicit WorkerPool(size_t threads) : running(0), stopping(false) {
+        for (size_t i = 0; i < threads; i++) workers.emplace_back([this] { work(); });
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    // Tasks must not throw or call run() themselves. Batches from several
+    // threads may overlap; each caller then also waits for the others' tasks.
+    void run(vector<function<void()>> batch) {
+        unique_lock<mutex> held(lock);
+        for (auto& task : batch) tasks.push_back(move(task));
+        wake.notify_all();
+        while (runOne(held)) {}
+        finished.wait(held, [this] { return tasks.empty() && running == 0; });
+    }
+};
+
+// Shared by loads and saves: up to three workers plus the caller. On a single
+// core there are no workers and the caller runs every task itself.
+inline WorkerPool& ioPool() {
+    static WorkerPool pool(min(3u, max(1u, thread::hardware_concurrency()) - 1));
+    return pool;
+}
+
+#endif